@@ -0,0 +1,888 @@
+#include "HS_Hook.h"
+#include "HS_Decoder.h"
+#include "HS_Context.h"
+#include "HS_RWLock.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+using namespace HSLL;
+
+struct HSBenchRange
+{
+	ptrU8 pStart;
+	unsigned32 uSize;
+};
+
+static void HSCollectTextRanges(std::vector<HSBenchRange>& vecRanges);
+
+struct HSBenchResult
+{
+	std::string strSuite;
+	std::string strName;
+	unsigned32 uParam; // Hook count, thread count or table size, 0 if the result has none
+	double dValue;
+	const char* pUnit;
+};
+
+struct HSBenchConfig
+{
+	bool bQuick;         // Fewer iterations and shorter runs, for a smoke test
+	const char* pSuite;  // Only run this suite, all if null
+	const char* pOut;    // JSON output file, stdout if null
+};
+
+static HSBenchConfig g_stConfig = { false, nullptr, nullptr };
+static std::vector<HSBenchResult> g_vecResults;
+static bool g_bFailed = false;
+static volatile signed32 g_sSink = 0;
+static volatile ptrAny g_pSink = nullptr;
+
+static unsigned64 HSNowNs()
+{
+	return (unsigned64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static unsigned32 HSScale(unsigned32 uIter)
+{
+	return g_stConfig.bQuick ? (uIter / 20 ? uIter / 20 : 1) : uIter;
+}
+
+static bool HSWantSuite(const char* pSuite)
+{
+	return g_stConfig.pSuite == nullptr || strcmp(g_stConfig.pSuite, pSuite) == 0;
+}
+
+static void HSReport(const char* pSuite, const char* pName, unsigned32 uParam, double dValue, const char* pUnit)
+{
+	g_vecResults.push_back(HSBenchResult{ pSuite, pName, uParam, dValue, pUnit });
+	fprintf(stderr, "%-8s %-24s %6u %14.2f %s\n", pSuite, pName, uParam, dValue, pUnit);
+}
+
+static void HSFail(const char* pSuite, const char* pWhat)
+{
+	g_bFailed = true;
+	fprintf(stderr, "%-8s failed: %s\n", pSuite, pWhat);
+}
+
+static volatile signed32 g_sTargetBias = 0;
+
+/**
+ * @brief Distinct hookable targets, each instance has its own constants so none are folded together
+ * @details The volatile load keeps the x86-64 build longer than a jump and gives it a RIP-relative operand to relocate
+ */
+template <unsigned32 N>
+HS_NOINLINE signed32 HSBenchTarget(signed32 sValue)
+{
+	return sValue * (signed32)(N * 2 + 3) + (signed32)N + g_sTargetBias;
+}
+
+constexpr unsigned32 HS_BENCH_TARGET_NUM = 512;
+
+template <unsigned32... N>
+static const ptrAny* HSBenchTargets(std::integer_sequence<unsigned32, N...>)
+{
+	static const ptrAny s_pTargets[] = { (ptrAny)&HSBenchTarget<N>... };
+	return s_pTargets;
+}
+
+static const ptrAny* g_pTargets = HSBenchTargets(std::make_integer_sequence<unsigned32, HS_BENCH_TARGET_NUM>());
+
+HS_NOINLINE static signed32 HSBenchCall(signed32 sValue)
+{
+	return (sValue ^ 0x5A5A) * 7 + 3;
+}
+
+static HSHookHandle<signed32(signed32)> g_oCallHandle;
+
+HS_NOINLINE static signed32 HSBenchDetour(signed32 sValue)
+{
+	return sValue + 1;
+}
+
+HS_NOINLINE static signed32 HSBenchDetourHandle(signed32 sValue)
+{
+	return g_oCallHandle(sValue) + 1;
+}
+
+HS_NOINLINE static signed32 HSBenchDetourLookup(signed32 sValue)
+{
+	return HSHook::Original(&HSBenchCall)(sValue) + 1;
+}
+
+// Called through a volatile pointer, the compiler can neither inline nor hoist the call
+static signed32(*volatile g_pfnCall)(signed32) = &HSBenchCall;
+
+static double HSTimeCalls(unsigned32 uIter)
+{
+	double dBest = 0;
+
+	// Best of a few rounds, a preemption in one round does not count
+	for (unsigned32 uRound = 0; uRound < 5; ++uRound)
+	{
+		signed32 sSum = 0;
+		unsigned64 uStart = HSNowNs();
+
+		for (unsigned32 i = 0; i < uIter; ++i)
+		{
+			sSum += g_pfnCall((signed32)i);
+		}
+
+		double dNs = (double)(HSNowNs() - uStart) / uIter;
+		g_sSink = sSum;
+
+		if (uRound == 0 || dNs < dBest)
+		{
+			dBest = dNs;
+		}
+	}
+
+	return dBest;
+}
+
+/**
+ * @brief Cost of one call: unhooked, through a detour that returns at once, and through a
+ *        detour that calls the original by handle or by HSHook::Original
+ */
+static void HSBenchCallOverhead()
+{
+	unsigned32 uIter = HSScale(10000000);
+
+	HSReport("call", "unhooked", 0, HSTimeCalls(uIter), "ns/call");
+
+	if (HSHook::Install((ptrAny)&HSBenchCall, (ptrAny)&HSBenchDetour))
+	{
+		HSReport("call", "detour", 0, HSTimeCalls(uIter), "ns/call");
+		HSHook::Remove((ptrAny)&HSBenchCall);
+	}
+	else
+	{
+		HSFail("call", "install detour");
+	}
+
+	if (HSHook::Install(&HSBenchCall, &HSBenchDetourHandle, g_oCallHandle))
+	{
+		HSReport("call", "detour_original_handle", 0, HSTimeCalls(uIter), "ns/call");
+		HSHook::Remove(g_oCallHandle);
+	}
+	else
+	{
+		HSFail("call", "install handle detour");
+	}
+
+	if (HSHook::Install((ptrAny)&HSBenchCall, (ptrAny)&HSBenchDetourLookup))
+	{
+		HSReport("call", "detour_original_lookup", 0, HSTimeCalls(uIter), "ns/call");
+		HSHook::Remove((ptrAny)&HSBenchCall);
+	}
+	else
+	{
+		HSFail("call", "install lookup detour");
+	}
+}
+
+static double HSTimeLookups(ptrAny pSrc, unsigned32 uIter)
+{
+	unsigned64 uStart = HSNowNs();
+
+	for (unsigned32 i = 0; i < uIter; ++i)
+	{
+		g_pSink = HSHook::Original(pSrc);
+	}
+
+	return (double)(HSNowNs() - uStart) / uIter;
+}
+
+/**
+ * @brief Install and Remove latency one by one and in a transaction, and the Original lookup
+ *        cost, as the number of installed hooks grows
+ */
+static void HSBenchInstall()
+{
+	static const unsigned32 uSizes[] = { 1, 4, 16, 64, 256, 512 };
+	unsigned32 uLookups = HSScale(1000000);
+
+	for (unsigned32 uNum : uSizes)
+	{
+		unsigned64 uStart = HSNowNs();
+		unsigned32 uDone = 0;
+
+		while (uDone < uNum && HSHook::Install(g_pTargets[uDone], (ptrAny)&HSBenchDetour))
+		{
+			uDone++;
+		}
+
+		if (uDone < uNum)
+		{
+			HSFail("install", "sequential install");
+		}
+		else
+		{
+			HSReport("install", "install", uNum, (double)(HSNowNs() - uStart) / uNum, "ns/op");
+			HSReport("original", "lookup_hit", uNum, HSTimeLookups(g_pTargets[uNum / 2], uLookups), "ns/op");
+			HSReport("original", "lookup_miss", uNum, HSTimeLookups((ptrAny)&HSBenchCall, uLookups), "ns/op");
+		}
+
+		uStart = HSNowNs();
+
+		for (unsigned32 i = 0; i < uDone; ++i)
+		{
+			HSHook::Remove(g_pTargets[i]);
+		}
+
+		if (uDone == uNum)
+		{
+			HSReport("install", "remove", uNum, (double)(HSNowNs() - uStart) / uNum, "ns/op");
+		}
+
+		HSHook::Transaction oInstall;
+		oInstall.Begin();
+		uStart = HSNowNs();
+
+		for (unsigned32 i = 0; i < uNum; ++i)
+		{
+			oInstall.Add(g_pTargets[i], (ptrAny)&HSBenchDetour);
+		}
+
+		if (!oInstall.Commit())
+		{
+			HSFail("install", "transaction install");
+			continue;
+		}
+
+		HSReport("install", "transaction_install", uNum, (double)(HSNowNs() - uStart) / uNum, "ns/op");
+
+		HSHook::Transaction oRemove;
+		oRemove.Begin();
+		uStart = HSNowNs();
+
+		for (unsigned32 i = 0; i < uNum; ++i)
+		{
+			oRemove.Remove(g_pTargets[i]);
+		}
+
+		if (!oRemove.Commit())
+		{
+			HSFail("install", "transaction remove");
+			continue;
+		}
+
+		HSReport("install", "transaction_remove", uNum, (double)(HSNowNs() - uStart) / uNum, "ns/op");
+	}
+}
+
+/**
+ * @brief Latency of switching a prepared group of hooks on and off
+ */
+static void HSBenchGroup()
+{
+	static const unsigned32 uSizes[] = { 1, 16, 64, 256 };
+	unsigned32 uRounds = HSScale(200);
+
+	for (unsigned32 uNum : uSizes)
+	{
+		HSHook::Group oGroup;
+		bool bAdded = true;
+
+		for (unsigned32 i = 0; i < uNum && bAdded; ++i)
+		{
+			bAdded = oGroup.Add(g_pTargets[i], (ptrAny)&HSBenchDetour);
+		}
+
+		if (!bAdded)
+		{
+			HSFail("group", "add");
+			oGroup.Clear();
+			continue;
+		}
+
+		unsigned64 uEnable = 0;
+		unsigned64 uDisable = 0;
+
+		for (unsigned32 i = 0; i < uRounds; ++i)
+		{
+			unsigned64 uStart = HSNowNs();
+			oGroup.Enable();
+			unsigned64 uMid = HSNowNs();
+			oGroup.Disable();
+			uEnable += uMid - uStart;
+			uDisable += HSNowNs() - uMid;
+		}
+
+		HSReport("group", "enable", uNum, (double)uEnable / uRounds, "ns/toggle");
+		HSReport("group", "disable", uNum, (double)uDisable / uRounds, "ns/toggle");
+		oGroup.Clear();
+	}
+}
+
+// Built for x86-64 the first instruction (the RIP-relative bias load) is longer than the entry jump,
+// a caller preempted in the entry is not inside the bytes a Live patch rewrites. Nothing guarantees
+// that layout elsewhere, Quiesce moves such callers out of the way instead
+HS_NOINLINE static signed32 HSBenchLiveLookupTarget(signed32 sValue)
+{
+	return (sValue ^ 0x3C3C3C) * 5 + g_sTargetBias;
+}
+
+HS_NOINLINE static signed32 HSBenchLiveHandleTarget(signed32 sValue)
+{
+	return (sValue ^ 0x3C3C3C) * 5 + g_sTargetBias;
+}
+
+static HSHookHandle<signed32(signed32)> g_oLiveHandle;
+
+HS_NOINLINE static signed32 HSBenchLiveLookup(signed32 sValue)
+{
+	return HSHook::Original(&HSBenchLiveLookupTarget)(sValue) + 1;
+}
+
+HS_NOINLINE static signed32 HSBenchLiveHandle(signed32 sValue)
+{
+	return g_oLiveHandle(sValue) + 1;
+}
+
+static signed32(*volatile g_pfnLiveLookup)(signed32) = &HSBenchLiveLookupTarget;
+static signed32(*volatile g_pfnLiveHandle)(signed32) = &HSBenchLiveHandleTarget;
+
+/**
+ * @brief Install/Remove latency while caller threads keep calling the targets, once per patch
+ *        mode that allows it
+ * @details One target's detour calls the original through HSHook::Original, the other through a
+ *          handle. Every call must return the unhooked value or one more, anything else (or a
+ *          crash) means a caller ran into code that was being patched or already released.
+ *          Callers hold an HSEpochGuard across each call, as any caller racing Remove has to.
+ */
+static void HSRunLive(const char* pMode, HSPatchMode eMode, unsigned32 uThreads)
+{
+	std::atomic<bool> bStop(false);
+	std::atomic<unsigned32> uReady(0);
+	std::atomic<unsigned64> uCalls(0);
+	std::atomic<unsigned64> uWrong(0);
+	std::vector<std::thread> vecThreads;
+
+	for (unsigned32 i = 0; i < uThreads; ++i)
+	{
+		vecThreads.emplace_back([&, i]()
+			{
+				unsigned64 uCount = 0;
+				unsigned64 uBad = 0;
+				signed32 sValue = (signed32)i;
+
+				uReady.fetch_add(1, std::memory_order_release);
+
+				while (!bStop.load(std::memory_order_relaxed))
+				{
+					// A trampoline removed meanwhile is only freed once this call is out of it
+					HSEpochGuard oGuard;
+					signed32 sExpect = (sValue ^ 0x3C3C3C) * 5 + g_sTargetBias;
+					signed32 sLookup = g_pfnLiveLookup(sValue);
+					signed32 sHandle = g_pfnLiveHandle(sValue);
+
+					uBad += (sLookup != sExpect && sLookup != sExpect + 1) + (sHandle != sExpect && sHandle != sExpect + 1);
+					uCount += 2;
+					sValue++;
+				}
+
+				uCalls.fetch_add(uCount, std::memory_order_relaxed);
+				uWrong.fetch_add(uBad, std::memory_order_relaxed);
+			});
+	}
+
+	while (uReady.load(std::memory_order_acquire) < uThreads)
+	{
+		std::this_thread::yield();
+	}
+
+	HSHook::SetPatchMode(eMode);
+
+	unsigned32 uCycles = HSScale(400);
+	unsigned32 uDone = 0;
+	unsigned64 uInstallNs = 0;
+	unsigned64 uRemoveNs = 0;
+	unsigned64 uMaxNs = 0;
+	unsigned64 uStart = HSNowNs();
+
+	for (; uDone < uCycles; ++uDone)
+	{
+		unsigned64 uT0 = HSNowNs();
+
+		if (!HSHook::Install((ptrAny)&HSBenchLiveLookupTarget, (ptrAny)&HSBenchLiveLookup))
+		{
+			break;
+		}
+
+		unsigned64 uT1 = HSNowNs();
+
+		if (!HSHook::Install(&HSBenchLiveHandleTarget, &HSBenchLiveHandle, g_oLiveHandle))
+		{
+			HSHook::Remove((ptrAny)&HSBenchLiveLookupTarget);
+			break;
+		}
+
+		unsigned64 uT2 = HSNowNs();
+
+		// Let the callers run through the hooked targets before they go away again
+		std::this_thread::yield();
+
+		unsigned64 uT3 = HSNowNs();
+		bool bRemoved = HSHook::Remove((ptrAny)&HSBenchLiveLookupTarget);
+		unsigned64 uT4 = HSNowNs();
+		bRemoved &= HSHook::Remove(g_oLiveHandle);
+		unsigned64 uT5 = HSNowNs();
+
+		if (!bRemoved)
+		{
+			break;
+		}
+
+		uInstallNs += (uT1 - uT0) + (uT2 - uT1);
+		uRemoveNs += (uT4 - uT3) + (uT5 - uT4);
+		uMaxNs = std::max(uMaxNs, std::max(std::max(uT1 - uT0, uT2 - uT1), std::max(uT4 - uT3, uT5 - uT4)));
+		std::this_thread::yield();
+	}
+
+	double dSeconds = (double)(HSNowNs() - uStart) / 1e9;
+	bStop.store(true, std::memory_order_relaxed);
+
+	for (std::thread& oThread : vecThreads)
+	{
+		oThread.join();
+	}
+
+	HSHook::SetPatchMode(HSPatchMode_Direct);
+	std::string strMode = pMode;
+
+	if (uDone < uCycles)
+	{
+		HSFail("live", (strMode + " install/remove").c_str());
+	}
+
+	if (uWrong.load())
+	{
+		HSFail("live", (strMode + " wrong results during patching").c_str());
+	}
+
+	if (uDone)
+	{
+		HSReport("live", (strMode + "_install").c_str(), uThreads, (double)uInstallNs / (uDone * 2), "ns/op");
+		HSReport("live", (strMode + "_remove").c_str(), uThreads, (double)uRemoveNs / (uDone * 2), "ns/op");
+		HSReport("live", (strMode + "_patch_max").c_str(), uThreads, (double)uMaxNs, "ns");
+		HSReport("live", (strMode + "_calls").c_str(), uThreads, (double)uCalls.load() / dSeconds / 1e6, "Mcalls/s");
+	}
+}
+
+static void HSBenchLive()
+{
+	static const unsigned32 uThreads[] = { 1, 4 };
+
+	for (unsigned32 uNum : uThreads)
+	{
+		HSRunLive("live", HSPatchMode_Live, uNum);
+#if defined(__linux__)
+		HSRunLive("quiesce", HSPatchMode_Quiesce, uNum);
+#endif
+	}
+}
+
+/**
+ * @brief Linear-sweep decoding over the code of every loaded module
+ */
+static void HSBenchDecoder()
+{
+	std::vector<HSBenchRange> vecRanges;
+	HSCollectTextRanges(vecRanges);
+
+	if (vecRanges.empty())
+	{
+		HSFail("decoder", "no code ranges found");
+		return;
+	}
+
+	unsigned64 uTarget = g_stConfig.bQuick ? (1ull << 22) : (1ull << 26);
+	unsigned64 uBytes = 0;
+	unsigned64 uIns = 0;
+	unsigned64 uInvalid = 0;
+	unsigned64 uStart = HSNowNs();
+
+	while (uBytes < uTarget)
+	{
+		for (const HSBenchRange& stRange : vecRanges)
+		{
+			HSInsInfo stInfo;
+
+			// Stop short of the end, an instruction is at most 15 bytes
+			for (unsigned32 uPos = 0; uPos + 16 <= stRange.uSize;)
+			{
+				if (HSx86Decoder::ParseCode(stRange.pStart + uPos, stInfo) && stInfo.sTotalSize > 0)
+				{
+					uPos += (unsigned32)stInfo.sTotalSize;
+					uIns++;
+				}
+				else
+				{
+					uPos++;
+					uInvalid++;
+				}
+			}
+
+			uBytes += stRange.uSize;
+		}
+	}
+
+	double dSeconds = (double)(HSNowNs() - uStart) / 1e9;
+	HSReport("decoder", "throughput", (unsigned32)vecRanges.size(), (double)uBytes / dSeconds / (1 << 20), "MiB/s");
+	HSReport("decoder", "instructions", (unsigned32)vecRanges.size(), (double)uIns / dSeconds / 1e6, "Mins/s");
+	HSReport("decoder", "invalid_bytes", (unsigned32)vecRanges.size(), (double)uInvalid * 100 / (double)(uIns + uInvalid), "%");
+}
+
+/**
+ * @brief Lookup and update cost of the context table up to tens of thousands of hooks
+ */
+static void HSBenchContext()
+{
+	static const unsigned32 uSizes[] = { 64, 512, 4096, 50000 };
+	unsigned32 uLookups = HSScale(4000000);
+
+	for (unsigned32 uNum : uSizes)
+	{
+		// Addresses spaced like small functions aligned to 16 bytes
+		std::vector<unsignedP> vecKeys(uNum);
+
+		for (unsigned32 i = 0; i < uNum; ++i)
+		{
+			vecKeys[i] = (unsignedP)0x08048000 + (unsignedP)i * 48 + (unsignedP)(i % 3) * 16;
+		}
+
+		HSContextManager<ptrAny> oTable;
+		unsigned64 uStart = HSNowNs();
+
+		for (unsigned32 i = 0; i < uNum; ++i)
+		{
+			oTable.SetContext(vecKeys[i], (ptrAny)vecKeys[i]);
+		}
+
+		HSReport("context", "insert", uNum, (double)(HSNowNs() - uStart) / uNum, "ns/op");
+
+		// A prime stride visits every key and consecutive lookups land apart
+		unsigned32 uStride = 7919;
+		unsigned32 uPos = 0;
+		unsigned32 uHits = 0;
+		uStart = HSNowNs();
+
+		for (unsigned32 i = 0; i < uLookups; ++i)
+		{
+			uHits += oTable.FindContext(vecKeys[uPos]) != nullptr;
+			uPos = (uPos + uStride) % uNum;
+		}
+
+		HSReport("context", "lookup_hit", uNum, (double)(HSNowNs() - uStart) / uLookups, "ns/op");
+		uStart = HSNowNs();
+
+		for (unsigned32 i = 0; i < uLookups; ++i)
+		{
+			uHits += oTable.FindContext(vecKeys[uPos] + 8) != nullptr;
+			uPos = (uPos + uStride) % uNum;
+		}
+
+		HSReport("context", "lookup_miss", uNum, (double)(HSNowNs() - uStart) / uLookups, "ns/op");
+		g_sSink = (signed32)uHits;
+		uStart = HSNowNs();
+
+		for (unsigned32 i = 0; i < uNum; ++i)
+		{
+			oTable.RemoveContext(vecKeys[i]);
+		}
+
+		HSReport("context", "remove", uNum, (double)(HSNowNs() - uStart) / uNum, "ns/op");
+	}
+}
+
+struct HSBenchSpinLock
+{
+	HSSpinRWLock oLock;
+
+	signedP LockRead() { return oLock.LockRead(); }
+	void UnlockRead(signedP uSlot) { oLock.UnlockRead(uSlot); }
+	void LockWrite() { oLock.LockWrite(); }
+	void UnlockWrite() { oLock.UnlockWrite(); }
+};
+
+struct HSBenchSharedMutex
+{
+	std::shared_mutex oLock;
+
+	signedP LockRead() { oLock.lock_shared(); return 0; }
+	void UnlockRead(signedP) { oLock.unlock_shared(); }
+	void LockWrite() { oLock.lock(); }
+	void UnlockWrite() { oLock.unlock(); }
+};
+
+/**
+ * @brief Readers hammer the lock while one writer takes it about once a millisecond, like
+ *        lookups running during occasional installs
+ */
+template <typename Lock>
+static void HSRunLock(const char* pName, unsigned32 uThreads, unsigned32 uMillis)
+{
+	Lock oLock;
+	std::atomic<unsigned64> uReads(0);
+	std::atomic<unsigned32> uCheck(0);
+	volatile unsigned32 uShared = 0;
+	unsigned64 uWriteNs = 0;
+	unsigned64 uWriteMax = 0;
+	unsigned32 uWrites = 0;
+	std::vector<std::thread> vecThreads;
+
+	std::atomic<unsigned32> uReady(0);
+	std::atomic<unsigned64> uEnd(0);
+
+	for (unsigned32 i = 0; i < uThreads; ++i)
+	{
+		vecThreads.emplace_back([&]()
+			{
+				unsigned64 uCount = 0;
+				unsigned32 uSum = 0;
+				unsigned64 uStop;
+
+				uReady.fetch_add(1, std::memory_order_release);
+
+				while ((uStop = uEnd.load(std::memory_order_acquire)) == 0)
+				{
+					std::this_thread::yield();
+				}
+
+				// Readers stop on their own at the deadline, a reader-preferring lock may starve the writer until then
+				while ((uCount & 255) || HSNowNs() < uStop)
+				{
+					signedP uSlot = oLock.LockRead();
+					uSum += uShared;
+					oLock.UnlockRead(uSlot);
+					uCount++;
+				}
+
+				uCheck.fetch_add(uSum, std::memory_order_relaxed);
+				uReads.fetch_add(uCount, std::memory_order_relaxed);
+			});
+	}
+
+	// The clock starts once every reader runs, spawning many threads takes a while on few cores
+	while (uReady.load(std::memory_order_acquire) < uThreads)
+	{
+		std::this_thread::yield();
+	}
+
+	unsigned64 uStart = HSNowNs();
+	uEnd.store(uStart + (unsigned64)uMillis * 1000000, std::memory_order_release);
+
+	while (HSNowNs() < uEnd.load(std::memory_order_relaxed))
+	{
+		unsigned64 uBefore = HSNowNs();
+		oLock.LockWrite();
+		unsigned64 uWait = HSNowNs() - uBefore;
+		uShared = uShared + 1;
+		oLock.UnlockWrite();
+
+		uWriteNs += uWait;
+		uWriteMax = uWait > uWriteMax ? uWait : uWriteMax;
+		uWrites++;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	for (std::thread& oThread : vecThreads)
+	{
+		oThread.join();
+	}
+
+	double dSeconds = (double)(HSNowNs() - uStart) / 1e9;
+	g_sSink = (signed32)uCheck.load();
+
+	std::string strName = pName;
+	HSReport("rwlock", (strName + "_reads").c_str(), uThreads, (double)uReads.load() / dSeconds / 1e6, "Mreads/s");
+	HSReport("rwlock", (strName + "_write_avg").c_str(), uThreads, uWrites ? (double)uWriteNs / uWrites : 0, "ns");
+	HSReport("rwlock", (strName + "_write_max").c_str(), uThreads, (double)uWriteMax, "ns");
+}
+
+static void HSBenchRWLock()
+{
+	static const unsigned32 uThreads[] = { 1, 2, 4, 8, 16, 32, 64 };
+	unsigned32 uMillis = g_stConfig.bQuick ? 20 : 200;
+
+	for (unsigned32 uNum : uThreads)
+	{
+		HSRunLock<HSBenchSpinLock>("spin", uNum, uMillis);
+		HSRunLock<HSBenchSharedMutex>("shared_mutex", uNum, uMillis);
+	}
+}
+
+static void HSWriteString(FILE* pFile, const std::string& strValue)
+{
+	fputc('"', pFile);
+
+	for (char c : strValue)
+	{
+		if (c == '"' || c == '\\')
+		{
+			fputc('\\', pFile);
+		}
+
+		fputc(c, pFile);
+	}
+
+	fputc('"', pFile);
+}
+
+static bool HSWriteJson()
+{
+	FILE* pFile = g_stConfig.pOut ? fopen(g_stConfig.pOut, "w") : stdout;
+
+	if (pFile == nullptr)
+	{
+		fprintf(stderr, "cannot open %s\n", g_stConfig.pOut);
+		return false;
+	}
+
+	fprintf(pFile, "{\n  \"arch\": \"%s\",\n  \"pointer_bits\": %u,\n  \"quick\": %s,\n  \"results\": [\n",
+		sizeof(ptrAny) == 4 ? "i386" : "x86_64", (unsigned32)sizeof(ptrAny) * 8, g_stConfig.bQuick ? "true" : "false");
+
+	for (size_t i = 0; i < g_vecResults.size(); ++i)
+	{
+		const HSBenchResult& stResult = g_vecResults[i];
+
+		fputs("    { \"suite\": ", pFile);
+		HSWriteString(pFile, stResult.strSuite);
+		fputs(", \"name\": ", pFile);
+		HSWriteString(pFile, stResult.strName);
+		fprintf(pFile, ", \"param\": %u, \"value\": %.3f, \"unit\": ", stResult.uParam, stResult.dValue);
+		HSWriteString(pFile, stResult.pUnit);
+		fputs(i + 1 < g_vecResults.size() ? " },\n" : " }\n", pFile);
+	}
+
+	fputs("  ]\n}\n", pFile);
+
+	if (pFile != stdout)
+	{
+		fclose(pFile);
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--quick") == 0)
+		{
+			g_stConfig.bQuick = true;
+		}
+		else if (strcmp(argv[i], "--suite") == 0 && i + 1 < argc)
+		{
+			g_stConfig.pSuite = argv[++i];
+		}
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+		{
+			g_stConfig.pOut = argv[++i];
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [--quick] [--suite call|install|live|group|decoder|context|rwlock] [--out file.json]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	// Original lookups are reported by the install suite, which sets up the hooks they need
+	if (HSWantSuite("call"))
+		HSBenchCallOverhead();
+
+	if (HSWantSuite("install"))
+		HSBenchInstall();
+
+	if (HSWantSuite("live"))
+		HSBenchLive();
+
+	if (HSWantSuite("group"))
+		HSBenchGroup();
+
+	if (HSWantSuite("decoder"))
+		HSBenchDecoder();
+
+	if (HSWantSuite("context"))
+		HSBenchContext();
+
+	if (HSWantSuite("rwlock"))
+		HSBenchRWLock();
+
+	if (!HSWriteJson())
+	{
+		return 1;
+	}
+
+	return g_bFailed ? 1 : 0;
+}
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+static void HSAddModuleText(HMODULE hModule, std::vector<HSBenchRange>& vecRanges)
+{
+	if (hModule == nullptr)
+	{
+		return;
+	}
+
+	ptrU8 pBase = (ptrU8)hModule;
+	PIMAGE_NT_HEADERS pNt = (PIMAGE_NT_HEADERS)(pBase + ((PIMAGE_DOS_HEADER)pBase)->e_lfanew);
+	PIMAGE_SECTION_HEADER pSection = IMAGE_FIRST_SECTION(pNt);
+
+	for (WORD i = 0; i < pNt->FileHeader.NumberOfSections; ++i, ++pSection)
+	{
+		if (pSection->Characteristics & IMAGE_SCN_MEM_EXECUTE)
+		{
+			vecRanges.push_back(HSBenchRange{ pBase + pSection->VirtualAddress, (unsigned32)pSection->Misc.VirtualSize });
+		}
+	}
+}
+
+static void HSCollectTextRanges(std::vector<HSBenchRange>& vecRanges)
+{
+	HSAddModuleText(GetModuleHandleA("ntdll.dll"), vecRanges);
+	HSAddModuleText(GetModuleHandleA("kernel32.dll"), vecRanges);
+	HSAddModuleText(GetModuleHandleA("kernelbase.dll"), vecRanges);
+	HSAddModuleText(GetModuleHandleA(nullptr), vecRanges);
+}
+
+#elif defined(__unix__)
+#include <link.h>
+
+static int HSAddModuleText(struct dl_phdr_info* pInfo, size_t, void* pData)
+{
+	std::vector<HSBenchRange>& vecRanges = *(std::vector<HSBenchRange>*)pData;
+
+	for (ElfW(Half) i = 0; i < pInfo->dlpi_phnum; ++i)
+	{
+		const ElfW(Phdr)& stPhdr = pInfo->dlpi_phdr[i];
+
+		if (stPhdr.p_type == PT_LOAD && (stPhdr.p_flags & PF_X))
+		{
+			vecRanges.push_back(HSBenchRange{ (ptrU8)(pInfo->dlpi_addr + stPhdr.p_vaddr), (unsigned32)stPhdr.p_memsz });
+		}
+	}
+
+	return 0;
+}
+
+static void HSCollectTextRanges(std::vector<HSBenchRange>& vecRanges)
+{
+	dl_iterate_phdr(HSAddModuleText, &vecRanges);
+}
+#endif
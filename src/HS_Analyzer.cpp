@@ -0,0 +1,178 @@
+#include "HS_Analyzer.h"
+#if defined(_M_IX86) || defined(__i386__) || defined(_M_X64) || defined(__x86_64__)
+
+#include "HS_Decoder.h"
+#include <algorithm>
+
+namespace HSLL
+{
+	bool HSx86Analyzer::Analyze(ptrAny pFunc, HSFlowInfo& stInfo)
+	{
+		ptrU8 pCode = (ptrU8)pFunc;
+		unsigned32 uOffset = 0;
+		unsigned32 uFurthest = 0;
+
+		stInfo.uScanSize = 0;
+		stInfo.vecTargets.clear();
+
+		if (pCode == nullptr)
+		{
+			return false;
+		}
+
+		unsigned32 uLimit = FunctionSize(pFunc);
+		uLimit = (uLimit && uLimit < HS_MAX_SCAN_SIZE) ? uLimit : HS_MAX_SCAN_SIZE;
+
+		while (uOffset < uLimit)
+		{
+			HSInsInfo stIns;
+			ptrU8 pIns = pCode + uOffset;
+
+			// An instruction the decoder does not know (xbegin, new extensions) only ends what is known
+			if (!HSx86Decoder::ParseCode(pIns, stIns))
+			{
+				break;
+			}
+
+			uOffset += stIns.sTotalSize;
+			bool bEnd = stIns.bIsRet;
+
+			// ud2 and int3 trap, nothing falls through them
+			if ((pIns[0] == 0x0F && pIns[1] == 0x0B) || pIns[0] == 0xCC)
+			{
+				bEnd = true;
+			}
+			else if (stIns.bIsCall && IsNextFunction(pCode + uOffset))
+			{
+				bEnd = true; // Noreturn call at the end of the body
+			}
+
+			if (stIns.bIsJmp && !stIns.bNeedReloc)
+			{
+				bEnd = true; // Indirect jump
+			}
+			else if (stIns.bNeedReloc)
+			{
+				unsigned8 uOpcode = pIns[stIns.sImmOffset - 1];
+				signed32 sRel = (stIns.sImmSize == 1) ? *(signed8*)(pIns + stIns.sImmOffset)
+					: (stIns.sImmSize == 2) ? *(signed16*)(pIns + stIns.sImmOffset)
+					: *(signed32*)(pIns + stIns.sImmOffset);
+				signed32 sTarget = (signed32)uOffset + sRel;
+
+				// Targets outside the function belong to other functions or are tail calls
+				if (sTarget >= 0 && sTarget < (signed32)uLimit)
+				{
+					stInfo.vecTargets.push_back((unsigned32)sTarget);
+
+					if (stIns.bIsJmp && (unsigned32)sTarget > uFurthest)
+					{
+						uFurthest = (unsigned32)sTarget;
+					}
+				}
+
+				bEnd = stIns.bIsJmp && (uOpcode == 0xE9 || uOpcode == 0xEB);
+			}
+
+			// Code after an unconditional transfer is only reachable through a branch seen earlier
+			if (bEnd && uOffset > uFurthest)
+			{
+				break;
+			}
+		}
+
+		std::sort(stInfo.vecTargets.begin(), stInfo.vecTargets.end());
+		stInfo.vecTargets.erase(std::unique(stInfo.vecTargets.begin(), stInfo.vecTargets.end()), stInfo.vecTargets.end());
+		stInfo.uScanSize = uOffset;
+		return true;
+	}
+
+	bool HSx86Analyzer::HasTarget(const HSFlowInfo& stInfo, unsigned32 uStart, unsigned32 uEnd)
+	{
+		auto it = std::lower_bound(stInfo.vecTargets.begin(), stInfo.vecTargets.end(), uStart);
+		return it != stInfo.vecTargets.end() && *it < uEnd;
+	}
+
+	bool HSx86Analyzer::IsNextFunction(ptrU8 pCode)
+	{
+		// Alignment padding (int3, nop, multi-byte nop) and then an endbr on a 16-byte boundary
+		for (unsigned32 i = 0; i < 16;)
+		{
+			ptrU8 pIns = pCode + i;
+
+			if (pIns[0] == 0xF3 && pIns[1] == 0x0F && pIns[2] == 0x1E && (pIns[3] == 0xFA || pIns[3] == 0xFB))
+			{
+				return i && ((unsignedP)pIns & 15) == 0;
+			}
+
+			unsigned32 uPrefix = 0;
+
+			while (pIns[uPrefix] == 0x66 || pIns[uPrefix] == 0x2E)
+			{
+				uPrefix++;
+			}
+
+			HSInsInfo stIns;
+
+			if (pIns[0] == 0xCC || pIns[uPrefix] == 0x90)
+			{
+				i += uPrefix + 1;
+			}
+			else if (pIns[uPrefix] == 0x0F && pIns[uPrefix + 1] == 0x1F && HSx86Decoder::ParseCode(pIns, stIns))
+			{
+				i += stIns.sTotalSize;
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		return false;
+	}
+}
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+namespace HSLL
+{
+	unsigned32 HSx86Analyzer::FunctionSize(ptrAny pFunc)
+	{
+#if defined(_M_X64)
+		DWORD64 uImageBase;
+		PRUNTIME_FUNCTION pEntry = RtlLookupFunctionEntry((DWORD64)pFunc, &uImageBase, nullptr);
+
+		// Leaf functions have no entry, chained fragments only cover part of a function
+		if (pEntry && uImageBase + pEntry->BeginAddress == (DWORD64)pFunc)
+		{
+			return pEntry->EndAddress - pEntry->BeginAddress;
+		}
+#else
+		(void)pFunc;
+#endif
+		return 0;
+	}
+}
+#elif defined(__unix__)
+#include <dlfcn.h>
+#include <link.h>
+
+namespace HSLL
+{
+	unsigned32 HSx86Analyzer::FunctionSize(ptrAny pFunc)
+	{
+		Dl_info stInfo;
+		const ElfW(Sym)* pSym = nullptr;
+
+		// Only exported symbols are visible here, a local function keeps the fallback
+		if (dladdr1(pFunc, &stInfo, (void**)&pSym, RTLD_DL_SYMENT) && pSym && stInfo.dli_saddr == pFunc)
+		{
+			return (unsigned32)pSym->st_size;
+		}
+
+		return 0;
+	}
+}
+#endif
+
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+#if defined(_M_IX86) || defined(__i386__) || defined(_M_X64) || defined(__x86_64__)
+
+#include "HS_Type.h"
+#include <vector>
+
+namespace HSLL
+{
+	struct HSFlowInfo
+	{
+		unsigned32 uScanSize;               // Number of bytes decoded from the entry
+		std::vector<unsigned32> vecTargets; // Sorted offsets from the entry that some branch lands on
+	};
+
+	/**
+	 * @brief Linear control-flow scan of a function body
+	 * @details Decodes from the entry until a RET or an unconditional jump that lies past every
+	 *          forward branch seen so far, and records where relative branches land. The scan
+	 *          stays inside the function's extent when the platform knows it (the ELF symbol size,
+	 *          the x64 unwind table) and is capped at HS_MAX_SCAN_SIZE bytes. Without it a ud2, an
+	 *          int3 or a call followed by padding up to the next endbr ends the function, so a body
+	 *          that ends in a noreturn call does not run into its neighbour. A byte that does not
+	 *          decode ends the scan as well, what lies past it is simply not known. Indirect branch
+	 *          targets are not known either.
+	 */
+	class HSx86Analyzer
+	{
+	public:
+		static constexpr unsigned32 HS_MAX_SCAN_SIZE = 4096;
+
+		/**
+		 * @return false only for a null entry, the stolen bytes are decoded and checked by the caller
+		 */
+		static bool Analyze(ptrAny pFunc, HSFlowInfo& stInfo);
+
+		static bool HasTarget(const HSFlowInfo& stInfo, unsigned32 uStart, unsigned32 uEnd);
+
+	private:
+		/**
+		 * @brief Size of the function starting exactly at pFunc, 0 when unknown
+		 */
+		static unsigned32 FunctionSize(ptrAny pFunc);
+
+		static bool IsNextFunction(ptrU8 pCode);
+	};
+}
+
+#endif
@@ -1,145 +1,338 @@
 #pragma once
 #include "HS_Type.h"
+#include <new>
+#include <utility>
+
+#if (defined(_M_IX86) || defined(__i386__)) && (defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define HS_CONTEXT_SSE2 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace HSLL
 {
+	/**
+	 * @brief Open-addressing map from a non-zero address to a context
+	 * @details Linear probing over a power-of-two key array that is kept at most half full, so
+	 *          a lookup, hit or miss, stops at the first empty slot a few slots past the home
+	 *          position whatever the table size. Keys live in their own array and the first
+	 *          group is mirrored past the end, a probe compares four keys per SSE2 compare
+	 *          without wrapping. Removal shifts the following entries back, no tombstones are
+	 *          left. Contexts are allocated on their own and never move, a pointer stays valid
+	 *          until its key is removed. Not thread-safe, the caller serializes access.
+	 */
 	template <typename T>
 	class HSContextManager
 	{
 	public:
-		struct Context
+		HSContextManager() : m_pKeys(nullptr), m_pNodes(nullptr), m_pSpare(nullptr),
+			m_uCapacity(0), m_uShift(0), m_uCount(0), m_uSpareNum(0)
 		{
-			T stValue;
-			unsignedP uKey;
-			bool bOccupied;
-		};
+		}
 
-	public:
-		HSContextManager()
+		~HSContextManager()
 		{
-			uNowCount = 0;
+			for (unsigned32 i = 0; i < m_uCapacity; ++i)
+			{
+				delete m_pNodes[i];
+			}
 
-			for (unsigned32 i = 0; i < HS_MAX_CONTEXT_NODE_NUM; ++i)
+			while (m_pSpare)
 			{
-				pTable[i].bOccupied = false;
+				Node* pNext = m_pSpare->pNext;
+				delete m_pSpare;
+				m_pSpare = pNext;
 			}
+
+			delete[] m_pKeys;
+			delete[] m_pNodes;
+
+			// Static destructors that run later still find an empty table
+			m_pKeys = nullptr;
+			m_pNodes = nullptr;
+			m_uCapacity = m_uCount = m_uSpareNum = 0;
 		}
 
+		HSContextManager(const HSContextManager&) = delete;
+		HSContextManager& operator=(const HSContextManager&) = delete;
+
 	public:
-		bool IsFull()
+		unsigned32 GetCount() const
 		{
-			return uNowCount >= HS_MAX_CONTEXT_NODE_NUM;
+			return m_uCount;
+		}
+
+		unsigned32 GetCapacity() const
+		{
+			return m_uCapacity;
+		}
+
+		/**
+		 * @brief Makes room for uNum more keys, the next uNum SetContext calls cannot fail
+		 */
+		bool Reserve(unsigned32 uNum)
+		{
+			unsigned32 uNeed = m_uCount + uNum;
+
+			if (uNeed * 2 > m_uCapacity)
+			{
+				unsigned32 uCapacity = m_uCapacity ? m_uCapacity : HS_CONTEXT_MIN_CAPACITY;
+
+				while (uNeed * 2 > uCapacity)
+				{
+					uCapacity *= 2;
+				}
+
+				if (!Rehash(uCapacity))
+				{
+					return false;
+				}
+			}
+
+			while (m_uSpareNum < uNum)
+			{
+				Node* pNode = new (std::nothrow) Node();
+
+				if (pNode == nullptr)
+				{
+					return false;
+				}
+
+				pNode->pNext = m_pSpare;
+				m_pSpare = pNode;
+				m_uSpareNum++;
+			}
+
+			return true;
 		}
 
 		T* FindContext(unsignedP uKey)
 		{
-			unsigned32 uFoundPos, uEmptyPos;
+			unsigned32 uPos = FindPos(uKey);
 
-			if (FindSlot(uKey, uFoundPos, uEmptyPos))
+			if (uPos == HS_CONTEXT_INVALID)
 			{
-				return &pTable[uFoundPos].stValue;
+				return nullptr;
 			}
 
-			return nullptr;
+			return &m_pNodes[uPos]->stValue;
 		}
 
-		T* RemoveContext(unsignedP uKey)
+		bool RemoveContext(unsignedP uKey)
 		{
-			unsigned32 uFoundPos, uEmptyPos;
+			unsigned32 uHole = FindPos(uKey);
 
-			if (FindSlot(uKey, uFoundPos, uEmptyPos))
+			if (uHole == HS_CONTEXT_INVALID)
 			{
-				pTable[uFoundPos].bOccupied = false;
-				uNowCount--;
-				return &pTable[uFoundPos].stValue;
+				return false;
+			}
+
+			delete m_pNodes[uHole];
+
+			unsigned32 uMask = m_uCapacity - 1;
+			unsigned32 uNext = (uHole + 1) & uMask;
+
+			// Pull back every entry of the run that may sit in the hole, one whose home lies in (hole, next] stays
+			while (m_pKeys[uNext])
+			{
+				unsigned32 uHome = Hash(m_pKeys[uNext]);
+
+				if (((uNext - uHome) & uMask) >= ((uNext - uHole) & uMask))
+				{
+					SetKey(uHole, m_pKeys[uNext]);
+					m_pNodes[uHole] = m_pNodes[uNext];
+					uHole = uNext;
+				}
+
+				uNext = (uNext + 1) & uMask;
 			}
 
-			return nullptr;
+			SetKey(uHole, 0);
+			m_pNodes[uHole] = nullptr;
+			m_uCount--;
+			return true;
 		}
 
-		T* SetContext(unsignedP uKey, const T& stValue)
+		/**
+		 * @brief Calls fnVisit(uKey, stValue) for every entry, in table order
+		 */
+		template <typename Fn>
+		void ForEach(Fn fnVisit) const
 		{
-			unsigned32 uFoundPos, uEmptyPos;
+			for (unsigned32 i = 0; i < m_uCapacity; ++i)
+			{
+				if (m_pKeys[i])
+				{
+					fnVisit(m_pKeys[i], (const T&)m_pNodes[i]->stValue);
+				}
+			}
+		}
 
-			if (FindSlot(uKey, uFoundPos, uEmptyPos))
+		T* SetContext(unsignedP uKey, T stValue)
+		{
+			if (uKey == 0 || FindPos(uKey) != HS_CONTEXT_INVALID)
 			{
 				return nullptr;
 			}
 
-			if (uNowCount >= HS_MAX_CONTEXT_NODE_NUM)
+			if (!Reserve(1))
 			{
 				return nullptr;
 			}
 
-			pTable[uEmptyPos].uKey = uKey;
-			pTable[uEmptyPos].stValue = stValue;
-			pTable[uEmptyPos].bOccupied = true;
-			uNowCount++;
-			return &pTable[uEmptyPos].stValue;
+			Node* pNode = m_pSpare;
+			m_pSpare = pNode->pNext;
+			m_uSpareNum--;
+
+			pNode->stValue = std::move(stValue);
+			Place(uKey, pNode);
+			m_uCount++;
+			return &pNode->stValue;
 		}
 
 	private:
-		static constexpr unsigned32 HS_MAX_CONTEXT_NODE_NUM = 512;
-		static_assert(HS_MAX_CONTEXT_NODE_NUM > 0, "HS_MAX_CONTEXT_NODE_NUM must be > 0");
-		unsigned32 uNowCount;
-		Context pTable[HS_MAX_CONTEXT_NODE_NUM];
+		struct Node
+		{
+			T stValue;
+			Node* pNext; // Next spare node
+		};
+
+		static constexpr unsigned32 HS_CONTEXT_GROUP = 4;
+		static constexpr unsigned32 HS_CONTEXT_MIN_CAPACITY = 16;
+		static constexpr unsigned32 HS_CONTEXT_INVALID = 0xFFFFFFFF;
+
+		unsignedP* m_pKeys; // m_uCapacity keys, then a copy of the first HS_CONTEXT_GROUP - 1
+		Node** m_pNodes;
+		Node* m_pSpare;     // Nodes set aside by Reserve
+		unsigned32 m_uCapacity;
+		unsigned32 m_uShift;
+		unsigned32 m_uCount;
+		unsigned32 m_uSpareNum;
 
 		unsigned32 Hash(unsignedP uKey) const
 		{
-			return (uKey * 2654435761u) % HS_MAX_CONTEXT_NODE_NUM;
+			// Fibonacci hashing keeps the high bits, code addresses differ mostly above their alignment
+			unsigned32 uFold = (unsigned32)uKey ^ (unsigned32)((unsigned64)uKey >> 32);
+			return (uFold * 2654435761u) >> (32 - m_uShift);
+		}
+
+		static unsigned32 LowestBit(unsigned32 uMask)
+		{
+#if defined(_MSC_VER)
+			unsigned long uIndex;
+			_BitScanForward(&uIndex, uMask);
+			return (unsigned32)uIndex;
+#else
+			return (unsigned32)__builtin_ctz(uMask);
+#endif
 		}
 
-		unsigned32 NextPosition(unsigned32 uPos) const
+		void SetKey(unsigned32 uPos, unsignedP uKey)
 		{
-			return (uPos + 1) % HS_MAX_CONTEXT_NODE_NUM;
+			m_pKeys[uPos] = uKey;
+
+			if (uPos < HS_CONTEXT_GROUP - 1)
+			{
+				m_pKeys[m_uCapacity + uPos] = uKey;
+			}
+		}
+
+		void Place(unsignedP uKey, Node* pNode)
+		{
+			unsigned32 uMask = m_uCapacity - 1;
+			unsigned32 uPos = Hash(uKey);
+
+			while (m_pKeys[uPos])
+			{
+				uPos = (uPos + 1) & uMask;
+			}
+
+			SetKey(uPos, uKey);
+			m_pNodes[uPos] = pNode;
 		}
 
-		bool FindSlot(unsignedP uKey, unsigned32& uFoundPos, unsigned32& uEmptyPos)
+		unsigned32 FindPos(unsignedP uKey) const
 		{
-			unsigned32 uStartPos = Hash(uKey);
-			unsigned32 uPos = uStartPos;
-			bool bFoundEmpty = false;
+			if (m_uCount == 0 || uKey == 0)
+			{
+				return HS_CONTEXT_INVALID;
+			}
+
+			unsigned32 uMask = m_uCapacity - 1;
+			unsigned32 uPos = Hash(uKey);
 
-			do
+#if defined(HS_CONTEXT_SSE2)
+			__m128i vKey = _mm_set1_epi32((int)uKey);
+			__m128i vZero = _mm_setzero_si128();
+
+			// A key is stored once and its whole run from the home slot is occupied, so any match is the entry
+			while (true)
 			{
-				if (!pTable[uPos].bOccupied)
+				__m128i vKeys = _mm_loadu_si128((const __m128i*)(m_pKeys + uPos));
+				unsigned32 uHit = (unsigned32)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(vKeys, vKey)));
+
+				if (uHit)
+				{
+					return (uPos + LowestBit(uHit)) & uMask;
+				}
+
+				if (_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(vKeys, vZero))))
 				{
-					if (!bFoundEmpty)
-					{
-						uEmptyPos = uPos;
-						bFoundEmpty = true;
-					}
+					return HS_CONTEXT_INVALID;
 				}
-				else if (pTable[uPos].uKey == uKey)
+
+				uPos = (uPos + HS_CONTEXT_GROUP) & uMask;
+			}
+#else
+			while (m_pKeys[uPos])
+			{
+				if (m_pKeys[uPos] == uKey)
 				{
-					uFoundPos = uPos;
-					return true;
+					return uPos;
 				}
 
-				uPos = NextPosition(uPos);
+				uPos = (uPos + 1) & uMask;
+			}
 
-			} while (uPos != uStartPos);
+			return HS_CONTEXT_INVALID;
+#endif
+		}
 
-			if (bFoundEmpty)
+		bool Rehash(unsigned32 uCapacity)
+		{
+			unsignedP* pKeys = new (std::nothrow) unsignedP[uCapacity + HS_CONTEXT_GROUP - 1]();
+			Node** pNodes = new (std::nothrow) Node*[uCapacity]();
+
+			if (pKeys == nullptr || pNodes == nullptr)
 			{
+				delete[] pKeys;
+				delete[] pNodes;
 				return false;
 			}
 
-			uPos = uStartPos;
+			unsignedP* pOldKeys = m_pKeys;
+			Node** pOldNodes = m_pNodes;
+			unsigned32 uOldCapacity = m_uCapacity;
+
+			m_pKeys = pKeys;
+			m_pNodes = pNodes;
+			m_uCapacity = uCapacity;
+			m_uShift = LowestBit(uCapacity);
 
-			do
+			for (unsigned32 i = 0; i < uOldCapacity; ++i)
 			{
-				if (pTable[uPos].uKey == uKey)
+				if (pOldKeys[i])
 				{
-					uFoundPos = uPos;
-					return true;
+					Place(pOldKeys[i], pOldNodes[i]);
 				}
+			}
 
-				uPos = NextPosition(uPos);
-
-			} while (uPos != uStartPos);
-
-			return false;
+			delete[] pOldKeys;
+			delete[] pOldNodes;
+			return true;
 		}
 	};
 }
\ No newline at end of file
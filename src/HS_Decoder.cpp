@@ -1,10 +1,16 @@
 #include "HS_Decoder.h"
-#if defined(_M_IX86) || defined(__i386__)
+#if defined(_M_IX86) || defined(__i386__) || defined(_M_X64) || defined(__x86_64__)
 
 #include <string.h>
 
 namespace HSLL
 {
+#if defined(_M_X64) || defined(__x86_64__)
+	constexpr bool HS_X86_LONG_MODE = true;
+#else
+	constexpr bool HS_X86_LONG_MODE = false;
+#endif
+
 	enum HSX86Flag
 	{
 		X86Flag_Modrm = 1,
@@ -13,7 +19,11 @@ namespace HSLL
 		X86Flag_Imm8 = 8,
 		X86Flag_Imm16 = 16,
 		X86Flag_Imm32 = 32,
-		X86Flag_Reloc = 128
+		X86Flag_Cond = 64,   // Entry covers the 16 condition codes starting at uOpcode
+		X86Flag_Reloc = 128,
+		X86Flag_Moffs = 256, // Address-sized memory offset
+		X86Flag_Imm64 = 512, // The imm32 widens to imm64 with REX.W
+		X86Flag_Legacy = 1024 // Invalid in 64-bit mode, the byte is a prefix there or undefined
 	};
 
 	enum HSX86InsType
@@ -27,237 +37,831 @@ namespace HSLL
 	constexpr unsigned8 HS_X86_PREFIXES[] = { 0xF0, 0xF2, 0xF3, 0x2E, 0x36, 0x3E, 0x26, 0x64, 0x65, 0x66, 0x67 };
 	constexpr HSOpcodeInfo HS_X86_OPCODES[] =
 	{
-		/* ADD AL, imm8      */ {0x04, 0, X86Flag_Imm8, InsType_Normal},
-		/* ADD EAX, imm32    */ {0x05, 0, X86Flag_Imm32, InsType_Normal},
-		/* ADD r/m8, imm8    */ {0x80, 0, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
-		/* ADD r/m32, imm32  */ {0x81, 0, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
-		/* ADD r/m32, imm8   */ {0x83, 0, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
-		/* ADD r/m8, r8      */ {0x00, 0, X86Flag_Modrm, InsType_Normal},
-		/* ADD r/m32, r32    */ {0x01, 0, X86Flag_Modrm, InsType_Normal},
-		/* ADD r8, r/m8      */ {0x02, 0, X86Flag_Modrm, InsType_Normal},
-		/* ADD r32, r/m32    */ {0x03, 0, X86Flag_Modrm, InsType_Normal},
-
-		/* AND AL, imm8      */ {0x24, 0, X86Flag_Imm8, InsType_Normal},
-		/* AND EAX, imm32    */ {0x25, 0, X86Flag_Imm32, InsType_Normal},
-		/* AND r/m8, imm8    */ {0x80, 4, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
-		/* AND r/m32, imm32  */ {0x81, 4, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
-		/* AND r/m32, imm8   */ {0x83, 4, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
-		/* AND r/m8, r8      */ {0x20, 0, X86Flag_Modrm, InsType_Normal},
-		/* AND r/m32, r32    */ {0x21, 0, X86Flag_Modrm, InsType_Normal},
-		/* AND r8, r/m8      */ {0x22, 0, X86Flag_Modrm, InsType_Normal},
-		/* AND r32, r/m32    */ {0x23, 0, X86Flag_Modrm, InsType_Normal},
-
-		/* CALL rel32        */ {0xE8, 0, X86Flag_Imm32 | X86Flag_Reloc, InsType_Call},
-		/* CALL r/m32        */ {0xFF, 2, X86Flag_Modrm | X86Flag_RegOP, InsType_Call},
-
-		/* CMP r/m32, imm8   */ {0x83, 7, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
-		/* CMP r/m32, r32    */ {0x39, 0, X86Flag_Modrm, InsType_Normal},
-		/* CMP EAX, imm32    */ {0x3D, 0, X86Flag_Imm32, InsType_Normal},
-
-		/* DEC r/m32         */ {0xFF, 1, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
-		/* DEC r32           */ {0x48, 0, X86Flag_PlusR, InsType_Normal},
-
-		/* ENTER imm16, imm8 */ {0xC8, 0, X86Flag_Imm16 | X86Flag_Imm8, InsType_Normal},
-		/* FLD m32fp         */ {0xD9, 0, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
-		/* FLD m64fp         */ {0xDD, 0, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
-		/* FLD m80fp         */ {0xDB, 5, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
-		/* INT 3             */ {0xCC, 0, 0, InsType_Normal},
-
-		/* JMP rel8          */ {0xEB, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-		/* JO rel8           */ {0x70, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-		/* JNO rel8          */ {0x71, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-		/* JB/JNAE/JC rel8   */ {0x72, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-		/* JNB/JAE/JNC rel8  */ {0x73, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-		/* JZ/JE rel8        */ {0x74, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-		/* JNZ/JNE rel8      */ {0x75, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-		/* JBE/JNA rel8      */ {0x76, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-		/* JNBE/JA rel8      */ {0x77, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-		/* JS rel8           */ {0x78, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-		/* JNS rel8          */ {0x79, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-		/* JP/JPE rel8       */ {0x7A, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-		/* JNP/JPO rel8      */ {0x7B, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-		/* JL/JNGE rel8      */ {0x7C, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-		/* JNL/JGE rel8      */ {0x7D, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-		/* JLE/JNG rel8      */ {0x7E, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-		/* JNLE/JG rel8      */ {0x7F, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
-
-		/* JMP rel32         */ {0xE9, 0, X86Flag_Imm32 | X86Flag_Reloc, InsType_Jump},
-		/* JMP r/m32         */ {0xFF, 4, X86Flag_Modrm | X86Flag_RegOP, InsType_Jump},
-
-		/* LEA r32,m         */ {0x8D, 0, X86Flag_Modrm, InsType_Normal},
-		/* LEAVE             */ {0xC9, 0, 0, InsType_Normal},
-
-		/* MOV r/m8,r8       */ {0x88, 0, X86Flag_Modrm, InsType_Normal},
-		/* MOV r/m32,r32     */ {0x89, 0, X86Flag_Modrm, InsType_Normal},
-		/* MOV r8,r/m8       */ {0x8A, 0, X86Flag_Modrm, InsType_Normal},
-		/* MOV r32,r/m32     */ {0x8B, 0, X86Flag_Modrm, InsType_Normal},
-		/* MOV r/m16,Sreg    */ {0x8C, 0, X86Flag_Modrm, InsType_Normal},
-		/* MOV Sreg,r/m16    */ {0x8E, 0, X86Flag_Modrm, InsType_Normal},
-		/* MOV AL,moffs8     */ {0xA0, 0, X86Flag_Imm32, InsType_Normal},
-		/* MOV EAX,moffs32   */ {0xA1, 0, X86Flag_Imm32, InsType_Normal},
-		/* MOV moffs8,AL     */ {0xA2, 0, X86Flag_Imm32, InsType_Normal},
-		/* MOV moffs32,EAX   */ {0xA3, 0, X86Flag_Imm32, InsType_Normal},
-		/* MOV r8, imm8      */ {0xB0, 0, X86Flag_PlusR | X86Flag_Imm8, InsType_Normal},
-		/* MOV r32, imm32    */ {0xB8, 0, X86Flag_PlusR | X86Flag_Imm32, InsType_Normal},
-		/* MOV r/m8, imm8    */ {0xC6, 0, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
-		/* MOV r/m32, imm32  */ {0xC7, 0, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
-
-		/* NOP               */ {0x90, 0, 0, InsType_Normal},
-
-		/* OR AL, imm8       */ {0x0C, 0, X86Flag_Imm8, InsType_Normal},
-		/* OR EAX, imm32     */ {0x0D, 0, X86Flag_Imm32, InsType_Normal},
-		/* OR r/m8, imm8     */ {0x80, 1, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
-		/* OR r/m32, imm32   */ {0x81, 1, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
-		/* OR r/m32, imm8    */ {0x83, 1, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
-		/* OR r/m8, r8       */ {0x08, 0, X86Flag_Modrm, InsType_Normal},
-		/* OR r/m32, r32     */ {0x09, 0, X86Flag_Modrm, InsType_Normal},
-		/* OR r8, r/m8       */ {0x0A, 0, X86Flag_Modrm, InsType_Normal},
-		/* OR r32, r/m32     */ {0x0B, 0, X86Flag_Modrm, InsType_Normal},
-
-		/* POP r/m32         */ {0x8F, 0, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
-		/* POP r32           */ {0x58, 0, X86Flag_PlusR, InsType_Normal},
-		/* PUSH r/m32        */ {0xFF, 6, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
-		/* PUSH r32          */ {0x50, 0, X86Flag_PlusR, InsType_Normal},
-		/* PUSH imm8         */ {0x6A, 0, X86Flag_Imm8, InsType_Normal},
-		/* PUSH imm32        */ {0x68, 0, X86Flag_Imm32, InsType_Normal},
-
-		/* RET               */ {0xC3, 0, 0, InsType_Return},
-		/* RET imm16         */ {0xC2, 0, X86Flag_Imm16, InsType_Return},
-
-		/* SUB AL, imm8      */ {0x2C, 0, X86Flag_Imm8, InsType_Normal},
-		/* SUB EAX, imm32    */ {0x2D, 0, X86Flag_Imm32, InsType_Normal},
-		/* SUB r/m8, imm8    */ {0x80, 5, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
-		/* SUB r/m32, imm32  */ {0x81, 5, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
-		/* SUB r/m32, imm8   */ {0x83, 5, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
-		/* SUB r/m8, r8      */ {0x28, 0, X86Flag_Modrm, InsType_Normal},
-		/* SUB r/m32, r32    */ {0x29, 0, X86Flag_Modrm, InsType_Normal},
-		/* SUB r8, r/m8      */ {0x2A, 0, X86Flag_Modrm, InsType_Normal},
-		/* SUB r32, r/m32    */ {0x2B, 0, X86Flag_Modrm, InsType_Normal},
-
-		/* TEST AL, imm8     */ {0xA8, 0, X86Flag_Imm8, InsType_Normal},
-		/* TEST EAX, imm32   */ {0xA9, 0, X86Flag_Imm32, InsType_Normal},
-		/* TEST r/m8, imm8   */ {0xF6, 0, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
-		/* TEST r/m32, imm32 */ {0xF7, 0, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
-		/* TEST r/m8, r8     */ {0x84, 0, X86Flag_Modrm, InsType_Normal},
-		/* TEST r/m32, r32   */ {0x85, 0, X86Flag_Modrm, InsType_Normal},
-
-		/* XOR AL, imm8      */ {0x34, 0, X86Flag_Imm8, InsType_Normal},
-		/* XOR EAX, imm32    */ {0x35, 0, X86Flag_Imm32, InsType_Normal},
-		/* XOR r/m8, imm8    */ {0x80, 6, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
-		/* XOR r/m32, imm32  */ {0x81, 6, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
-		/* XOR r/m32, imm8   */ {0x83, 6, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
-		/* XOR r/m8, r8      */ {0x30, 0, X86Flag_Modrm, InsType_Normal},
-		/* XOR r/m32, r32    */ {0x31, 0, X86Flag_Modrm, InsType_Normal},
-		/* XOR r8, r/m8      */ {0x32, 0, X86Flag_Modrm, InsType_Normal},
-		/* XOR r32, r/m32    */ {0x33, 0, X86Flag_Modrm, InsType_Normal}
-	 };
+		/* AAA                    */ {0x37, 0, X86Flag_Legacy, InsType_Normal},
+		/* AAD imm8               */ {0xD5, 0, X86Flag_Imm8 | X86Flag_Legacy, InsType_Normal},
+		/* AAM imm8               */ {0xD4, 0, X86Flag_Imm8 | X86Flag_Legacy, InsType_Normal},
+		/* AAS                    */ {0x3F, 0, X86Flag_Legacy, InsType_Normal},
+
+		/* ADC AL, imm8           */ {0x14, 0, X86Flag_Imm8, InsType_Normal},
+		/* ADC EAX, imm32         */ {0x15, 0, X86Flag_Imm32, InsType_Normal},
+		/* ADC r/m8, imm8         */ {0x80, 2, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* ADC r/m32, imm32       */ {0x81, 2, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
+		/* ADC r/m32, imm8        */ {0x83, 2, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* ADC r/m8, r8           */ {0x10, 0, X86Flag_Modrm, InsType_Normal},
+		/* ADC r/m32, r32         */ {0x11, 0, X86Flag_Modrm, InsType_Normal},
+		/* ADC r8, r/m8           */ {0x12, 0, X86Flag_Modrm, InsType_Normal},
+		/* ADC r32, r/m32         */ {0x13, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* ADD AL, imm8           */ {0x04, 0, X86Flag_Imm8, InsType_Normal},
+		/* ADD EAX, imm32         */ {0x05, 0, X86Flag_Imm32, InsType_Normal},
+		/* ADD r/m8, imm8         */ {0x80, 0, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* ADD r/m32, imm32       */ {0x81, 0, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
+		/* ADD r/m32, imm8        */ {0x83, 0, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* ADD r/m8, r8           */ {0x00, 0, X86Flag_Modrm, InsType_Normal},
+		/* ADD r/m32, r32         */ {0x01, 0, X86Flag_Modrm, InsType_Normal},
+		/* ADD r8, r/m8           */ {0x02, 0, X86Flag_Modrm, InsType_Normal},
+		/* ADD r32, r/m32         */ {0x03, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* AND AL, imm8           */ {0x24, 0, X86Flag_Imm8, InsType_Normal},
+		/* AND EAX, imm32         */ {0x25, 0, X86Flag_Imm32, InsType_Normal},
+		/* AND r/m8, imm8         */ {0x80, 4, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* AND r/m32, imm32       */ {0x81, 4, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
+		/* AND r/m32, imm8        */ {0x83, 4, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* AND r/m8, r8           */ {0x20, 0, X86Flag_Modrm, InsType_Normal},
+		/* AND r/m32, r32         */ {0x21, 0, X86Flag_Modrm, InsType_Normal},
+		/* AND r8, r/m8           */ {0x22, 0, X86Flag_Modrm, InsType_Normal},
+		/* AND r32, r/m32         */ {0x23, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* ARPL r/m16, r16        */ {0x63, 0, X86Flag_Modrm, InsType_Normal},
+		/* BOUND r32, m           */ {0x62, 0, X86Flag_Modrm | X86Flag_Legacy, InsType_Normal},
+
+		/* CALL rel32             */ {0xE8, 0, X86Flag_Imm32 | X86Flag_Reloc, InsType_Call},
+		/* CALL r/m32             */ {0xFF, 2, X86Flag_Modrm | X86Flag_RegOP, InsType_Call},
+
+		/* CALLF m16:32           */ {0xFF, 3, X86Flag_Modrm | X86Flag_RegOP, InsType_Call},
+		/* CALLF ptr16:32         */ {0x9A, 0, X86Flag_Imm32 | X86Flag_Imm16 | X86Flag_Legacy, InsType_Normal},
+
+		/* CBW/CWDE               */ {0x98, 0, 0, InsType_Normal},
+		/* CLC                    */ {0xF8, 0, 0, InsType_Normal},
+		/* CLD                    */ {0xFC, 0, 0, InsType_Normal},
+		/* CLI                    */ {0xFA, 0, 0, InsType_Normal},
+		/* CMC                    */ {0xF5, 0, 0, InsType_Normal},
+
+		/* CMP AL, imm8           */ {0x3C, 0, X86Flag_Imm8, InsType_Normal},
+		/* CMP EAX, imm32         */ {0x3D, 0, X86Flag_Imm32, InsType_Normal},
+		/* CMP r/m8, imm8         */ {0x80, 7, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* CMP r/m32, imm32       */ {0x81, 7, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
+		/* CMP r/m32, imm8        */ {0x83, 7, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* CMP r/m8, r8           */ {0x38, 0, X86Flag_Modrm, InsType_Normal},
+		/* CMP r/m32, r32         */ {0x39, 0, X86Flag_Modrm, InsType_Normal},
+		/* CMP r8, r/m8           */ {0x3A, 0, X86Flag_Modrm, InsType_Normal},
+		/* CMP r32, r/m32         */ {0x3B, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* CMPS m8, m8            */ {0xA6, 0, 0, InsType_Normal},
+		/* CMPS m32, m32          */ {0xA7, 0, 0, InsType_Normal},
+
+		/* CWD/CDQ                */ {0x99, 0, 0, InsType_Normal},
+		/* DAA                    */ {0x27, 0, X86Flag_Legacy, InsType_Normal},
+		/* DAS                    */ {0x2F, 0, X86Flag_Legacy, InsType_Normal},
+
+		/* DEC r/m8               */ {0xFE, 1, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+		/* DEC r/m32              */ {0xFF, 1, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+		/* DEC r32                */ {0x48, 0, X86Flag_PlusR | X86Flag_Legacy, InsType_Normal},
+
+		/* DIV r/m8               */ {0xF6, 6, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+		/* DIV r/m32              */ {0xF7, 6, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+
+		/* ENTER imm16, imm8      */ {0xC8, 0, X86Flag_Imm16 | X86Flag_Imm8, InsType_Normal},
+
+		/* ESC D8 (x87)           */ {0xD8, 0, X86Flag_Modrm, InsType_Normal},
+		/* ESC D9 (x87)           */ {0xD9, 0, X86Flag_Modrm, InsType_Normal},
+		/* ESC DA (x87)           */ {0xDA, 0, X86Flag_Modrm, InsType_Normal},
+		/* ESC DB (x87)           */ {0xDB, 0, X86Flag_Modrm, InsType_Normal},
+		/* ESC DC (x87)           */ {0xDC, 0, X86Flag_Modrm, InsType_Normal},
+		/* ESC DD (x87)           */ {0xDD, 0, X86Flag_Modrm, InsType_Normal},
+		/* ESC DE (x87)           */ {0xDE, 0, X86Flag_Modrm, InsType_Normal},
+		/* ESC DF (x87)           */ {0xDF, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* HLT                    */ {0xF4, 0, 0, InsType_Normal},
+
+		/* IDIV r/m8              */ {0xF6, 7, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+		/* IDIV r/m32             */ {0xF7, 7, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+
+		/* IMUL r/m8              */ {0xF6, 5, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+		/* IMUL r/m32             */ {0xF7, 5, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+		/* IMUL r32, r/m32, imm32 */ {0x69, 0, X86Flag_Modrm | X86Flag_Imm32, InsType_Normal},
+		/* IMUL r32, r/m32, imm8  */ {0x6B, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal},
+
+		/* IN AL, imm8            */ {0xE4, 0, X86Flag_Imm8, InsType_Normal},
+		/* IN EAX, imm8           */ {0xE5, 0, X86Flag_Imm8, InsType_Normal},
+		/* IN AL, DX              */ {0xEC, 0, 0, InsType_Normal},
+		/* IN EAX, DX             */ {0xED, 0, 0, InsType_Normal},
+
+		/* INC r/m8               */ {0xFE, 0, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+		/* INC r/m32              */ {0xFF, 0, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+		/* INC r32                */ {0x40, 0, X86Flag_PlusR | X86Flag_Legacy, InsType_Normal},
+
+		/* INS m8, DX             */ {0x6C, 0, 0, InsType_Normal},
+		/* INS m32, DX            */ {0x6D, 0, 0, InsType_Normal},
+
+		/* INT 3                  */ {0xCC, 0, 0, InsType_Normal},
+		/* INT imm8               */ {0xCD, 0, X86Flag_Imm8, InsType_Normal},
+
+		/* INT1                   */ {0xF1, 0, 0, InsType_Normal},
+		/* INTO                   */ {0xCE, 0, X86Flag_Legacy, InsType_Normal},
+		/* IRET                   */ {0xCF, 0, 0, InsType_Return},
+		/* JMP rel8               */ {0xEB, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
+		/* Jcc rel8               */ {0x70, 0, X86Flag_Imm8 | X86Flag_Reloc | X86Flag_Cond, InsType_Jump},
+		/* JECXZ rel8             */ {0xE3, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
+
+		/* JMP rel32              */ {0xE9, 0, X86Flag_Imm32 | X86Flag_Reloc, InsType_Jump},
+		/* JMP r/m32              */ {0xFF, 4, X86Flag_Modrm | X86Flag_RegOP, InsType_Jump},
+
+		/* JMPF m16:32            */ {0xFF, 5, X86Flag_Modrm | X86Flag_RegOP, InsType_Jump},
+		/* JMPF ptr16:32          */ {0xEA, 0, X86Flag_Imm32 | X86Flag_Imm16 | X86Flag_Legacy, InsType_Normal},
+
+		/* LAHF                   */ {0x9F, 0, 0, InsType_Normal},
+		/* LDS r32, m16:32        */ {0xC5, 0, X86Flag_Modrm | X86Flag_Legacy, InsType_Normal},
+		/* LEA r32,m              */ {0x8D, 0, X86Flag_Modrm, InsType_Normal},
+		/* LEAVE                  */ {0xC9, 0, 0, InsType_Normal},
+		/* LES r32, m16:32        */ {0xC4, 0, X86Flag_Modrm | X86Flag_Legacy, InsType_Normal},
+
+		/* LODS m8                */ {0xAC, 0, 0, InsType_Normal},
+		/* LODS m32               */ {0xAD, 0, 0, InsType_Normal},
+
+		/* LOOP rel8              */ {0xE2, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
+		/* LOOPE rel8             */ {0xE1, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
+		/* LOOPNE rel8            */ {0xE0, 0, X86Flag_Imm8 | X86Flag_Reloc, InsType_Jump},
+
+		/* MOV r/m8,r8            */ {0x88, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOV r/m32,r32          */ {0x89, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOV r8,r/m8            */ {0x8A, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOV r32,r/m32          */ {0x8B, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOV r/m16,Sreg         */ {0x8C, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOV Sreg,r/m16         */ {0x8E, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOV AL,moffs8          */ {0xA0, 0, X86Flag_Moffs, InsType_Normal},
+		/* MOV EAX,moffs32        */ {0xA1, 0, X86Flag_Moffs, InsType_Normal},
+		/* MOV moffs8,AL          */ {0xA2, 0, X86Flag_Moffs, InsType_Normal},
+		/* MOV moffs32,EAX        */ {0xA3, 0, X86Flag_Moffs, InsType_Normal},
+		/* MOV r8, imm8           */ {0xB0, 0, X86Flag_PlusR | X86Flag_Imm8, InsType_Normal},
+		/* MOV r32, imm32         */ {0xB8, 0, X86Flag_PlusR | X86Flag_Imm32 | X86Flag_Imm64, InsType_Normal},
+		/* MOV r/m8, imm8         */ {0xC6, 0, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* MOV r/m32, imm32       */ {0xC7, 0, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
+
+		/* MOVS m8, m8            */ {0xA4, 0, 0, InsType_Normal},
+		/* MOVS m32, m32          */ {0xA5, 0, 0, InsType_Normal},
+
+		/* MUL r/m8               */ {0xF6, 4, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+		/* MUL r/m32              */ {0xF7, 4, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+
+		/* NEG r/m8               */ {0xF6, 3, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+		/* NEG r/m32              */ {0xF7, 3, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+
+		/* NOP                    */ {0x90, 0, 0, InsType_Normal},
+
+		/* NOT r/m8               */ {0xF6, 2, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+		/* NOT r/m32              */ {0xF7, 2, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+
+		/* OR AL, imm8            */ {0x0C, 0, X86Flag_Imm8, InsType_Normal},
+		/* OR EAX, imm32          */ {0x0D, 0, X86Flag_Imm32, InsType_Normal},
+		/* OR r/m8, imm8          */ {0x80, 1, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* OR r/m32, imm32        */ {0x81, 1, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
+		/* OR r/m32, imm8         */ {0x83, 1, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* OR r/m8, r8            */ {0x08, 0, X86Flag_Modrm, InsType_Normal},
+		/* OR r/m32, r32          */ {0x09, 0, X86Flag_Modrm, InsType_Normal},
+		/* OR r8, r/m8            */ {0x0A, 0, X86Flag_Modrm, InsType_Normal},
+		/* OR r32, r/m32          */ {0x0B, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* OUT imm8, AL           */ {0xE6, 0, X86Flag_Imm8, InsType_Normal},
+		/* OUT imm8, EAX          */ {0xE7, 0, X86Flag_Imm8, InsType_Normal},
+		/* OUT DX, AL             */ {0xEE, 0, 0, InsType_Normal},
+		/* OUT DX, EAX            */ {0xEF, 0, 0, InsType_Normal},
+
+		/* OUTS DX, m8            */ {0x6E, 0, 0, InsType_Normal},
+		/* OUTS DX, m32           */ {0x6F, 0, 0, InsType_Normal},
+
+		/* POP r/m32              */ {0x8F, 0, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+		/* POP r32                */ {0x58, 0, X86Flag_PlusR, InsType_Normal},
+		/* POP DS                 */ {0x1F, 0, X86Flag_Legacy, InsType_Normal},
+		/* POP ES                 */ {0x07, 0, X86Flag_Legacy, InsType_Normal},
+		/* POP SS                 */ {0x17, 0, X86Flag_Legacy, InsType_Normal},
+
+		/* POPA/POPAD             */ {0x61, 0, X86Flag_Legacy, InsType_Normal},
+		/* POPF/POPFD             */ {0x9D, 0, 0, InsType_Normal},
+
+		/* PUSH r/m32             */ {0xFF, 6, X86Flag_Modrm | X86Flag_RegOP, InsType_Normal},
+		/* PUSH r32               */ {0x50, 0, X86Flag_PlusR, InsType_Normal},
+		/* PUSH imm8              */ {0x6A, 0, X86Flag_Imm8, InsType_Normal},
+		/* PUSH imm32             */ {0x68, 0, X86Flag_Imm32, InsType_Normal},
+		/* PUSH CS                */ {0x0E, 0, X86Flag_Legacy, InsType_Normal},
+		/* PUSH DS                */ {0x1E, 0, X86Flag_Legacy, InsType_Normal},
+		/* PUSH ES                */ {0x06, 0, X86Flag_Legacy, InsType_Normal},
+		/* PUSH SS                */ {0x16, 0, X86Flag_Legacy, InsType_Normal},
+
+		/* PUSHA/PUSHAD           */ {0x60, 0, X86Flag_Legacy, InsType_Normal},
+		/* PUSHF/PUSHFD           */ {0x9C, 0, 0, InsType_Normal},
+
+		/* RET                    */ {0xC3, 0, 0, InsType_Return},
+		/* RET imm16              */ {0xC2, 0, X86Flag_Imm16, InsType_Return},
+
+		/* RETF                   */ {0xCB, 0, 0, InsType_Return},
+		/* RETF imm16             */ {0xCA, 0, X86Flag_Imm16, InsType_Return},
+
+		/* ROL..SAR r/m8, 1       */ {0xD0, 0, X86Flag_Modrm, InsType_Normal},
+		/* ROL..SAR r/m32, 1      */ {0xD1, 0, X86Flag_Modrm, InsType_Normal},
+		/* ROL..SAR r/m8, CL      */ {0xD2, 0, X86Flag_Modrm, InsType_Normal},
+		/* ROL..SAR r/m32, CL     */ {0xD3, 0, X86Flag_Modrm, InsType_Normal},
+		/* ROL..SAR r/m8, imm8    */ {0xC0, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal},
+		/* ROL..SAR r/m32, imm8   */ {0xC1, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal},
+
+		/* SAHF                   */ {0x9E, 0, 0, InsType_Normal},
+		/* SALC                   */ {0xD6, 0, X86Flag_Legacy, InsType_Normal},
+
+		/* SBB AL, imm8           */ {0x1C, 0, X86Flag_Imm8, InsType_Normal},
+		/* SBB EAX, imm32         */ {0x1D, 0, X86Flag_Imm32, InsType_Normal},
+		/* SBB r/m8, imm8         */ {0x80, 3, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* SBB r/m32, imm32       */ {0x81, 3, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
+		/* SBB r/m32, imm8        */ {0x83, 3, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* SBB r/m8, r8           */ {0x18, 0, X86Flag_Modrm, InsType_Normal},
+		/* SBB r/m32, r32         */ {0x19, 0, X86Flag_Modrm, InsType_Normal},
+		/* SBB r8, r/m8           */ {0x1A, 0, X86Flag_Modrm, InsType_Normal},
+		/* SBB r32, r/m32         */ {0x1B, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* SCAS m8                */ {0xAE, 0, 0, InsType_Normal},
+		/* SCAS m32               */ {0xAF, 0, 0, InsType_Normal},
+
+		/* STC                    */ {0xF9, 0, 0, InsType_Normal},
+		/* STD                    */ {0xFD, 0, 0, InsType_Normal},
+		/* STI                    */ {0xFB, 0, 0, InsType_Normal},
+
+		/* STOS m8                */ {0xAA, 0, 0, InsType_Normal},
+		/* STOS m32               */ {0xAB, 0, 0, InsType_Normal},
+
+		/* SUB AL, imm8           */ {0x2C, 0, X86Flag_Imm8, InsType_Normal},
+		/* SUB EAX, imm32         */ {0x2D, 0, X86Flag_Imm32, InsType_Normal},
+		/* SUB r/m8, imm8         */ {0x80, 5, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* SUB r/m32, imm32       */ {0x81, 5, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
+		/* SUB r/m32, imm8        */ {0x83, 5, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* SUB r/m8, r8           */ {0x28, 0, X86Flag_Modrm, InsType_Normal},
+		/* SUB r/m32, r32         */ {0x29, 0, X86Flag_Modrm, InsType_Normal},
+		/* SUB r8, r/m8           */ {0x2A, 0, X86Flag_Modrm, InsType_Normal},
+		/* SUB r32, r/m32         */ {0x2B, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* TEST AL, imm8          */ {0xA8, 0, X86Flag_Imm8, InsType_Normal},
+		/* TEST EAX, imm32        */ {0xA9, 0, X86Flag_Imm32, InsType_Normal},
+		/* TEST r/m8, imm8        */ {0xF6, 0, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* TEST r/m32, imm32      */ {0xF7, 0, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
+		/* TEST r/m8, imm8        */ {0xF6, 1, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* TEST r/m32, imm32      */ {0xF7, 1, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
+		/* TEST r/m8, r8          */ {0x84, 0, X86Flag_Modrm, InsType_Normal},
+		/* TEST r/m32, r32        */ {0x85, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* WAIT                   */ {0x9B, 0, 0, InsType_Normal},
+
+		/* XCHG EAX, r32          */ {0x91, 0, 0, InsType_Normal},
+		/* XCHG EAX, r32          */ {0x92, 0, 0, InsType_Normal},
+		/* XCHG EAX, r32          */ {0x93, 0, 0, InsType_Normal},
+		/* XCHG EAX, r32          */ {0x94, 0, 0, InsType_Normal},
+		/* XCHG EAX, r32          */ {0x95, 0, 0, InsType_Normal},
+		/* XCHG EAX, r32          */ {0x96, 0, 0, InsType_Normal},
+		/* XCHG EAX, r32          */ {0x97, 0, 0, InsType_Normal},
+		/* XCHG r/m8, r8          */ {0x86, 0, X86Flag_Modrm, InsType_Normal},
+		/* XCHG r/m32, r32        */ {0x87, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* XLAT                   */ {0xD7, 0, 0, InsType_Normal},
+
+		/* XOR AL, imm8           */ {0x34, 0, X86Flag_Imm8, InsType_Normal},
+		/* XOR EAX, imm32         */ {0x35, 0, X86Flag_Imm32, InsType_Normal},
+		/* XOR r/m8, imm8         */ {0x80, 6, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* XOR r/m32, imm32       */ {0x81, 6, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm32, InsType_Normal},
+		/* XOR r/m32, imm8        */ {0x83, 6, X86Flag_Modrm | X86Flag_RegOP | X86Flag_Imm8, InsType_Normal},
+		/* XOR r/m8, r8           */ {0x30, 0, X86Flag_Modrm, InsType_Normal},
+		/* XOR r/m32, r32         */ {0x31, 0, X86Flag_Modrm, InsType_Normal},
+		/* XOR r8, r/m8           */ {0x32, 0, X86Flag_Modrm, InsType_Normal},
+		/* XOR r32, r/m32         */ {0x33, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* ADD r/m8, imm8 (82)    */ {0x82, 0, X86Flag_Modrm | X86Flag_Imm8 | X86Flag_Legacy, InsType_Normal}
+	};
+
+	constexpr HSOpcodeInfo HS_X86_OPCODES_0F[] =
+	{
+		/* SLDT..VERW (grp 6)          */ {0x00, 0, X86Flag_Modrm, InsType_Normal},
+		/* SGDT..INVLPG (grp 7)        */ {0x01, 0, X86Flag_Modrm, InsType_Normal},
+		/* LAR r32, r/m16              */ {0x02, 0, X86Flag_Modrm, InsType_Normal},
+		/* LSL r32, r/m16              */ {0x03, 0, X86Flag_Modrm, InsType_Normal},
+		/* SYSCALL                     */ {0x05, 0, 0, InsType_Normal},
+		/* CLTS                        */ {0x06, 0, 0, InsType_Normal},
+		/* SYSRET                      */ {0x07, 0, 0, InsType_Normal},
+		/* INVD                        */ {0x08, 0, 0, InsType_Normal},
+		/* WBINVD                      */ {0x09, 0, 0, InsType_Normal},
+		/* UD2                         */ {0x0B, 0, 0, InsType_Normal},
+		/* PREFETCH (grp P)            */ {0x0D, 0, X86Flag_Modrm, InsType_Normal},
+		/* FEMMS                       */ {0x0E, 0, 0, InsType_Normal},
+		/* 3DNow! (suffix imm8)        */ {0x0F, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal},
+
+		/* MOVUPS/MOVSS xmm, m         */ {0x10, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVUPS/MOVSS m, xmm         */ {0x11, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVLPS/MOVHLPS              */ {0x12, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVLPS m64, xmm             */ {0x13, 0, X86Flag_Modrm, InsType_Normal},
+		/* UNPCKLPS                    */ {0x14, 0, X86Flag_Modrm, InsType_Normal},
+		/* UNPCKHPS                    */ {0x15, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVHPS/MOVLHPS              */ {0x16, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVHPS m64, xmm             */ {0x17, 0, X86Flag_Modrm, InsType_Normal},
+		/* PREFETCHh (grp 16)          */ {0x18, 0, X86Flag_Modrm, InsType_Normal},
+		/* NOP r/m32 (hint)            */ {0x19, 0, X86Flag_Modrm, InsType_Normal},
+		/* NOP r/m32 (hint)            */ {0x1A, 0, X86Flag_Modrm, InsType_Normal},
+		/* NOP r/m32 (hint)            */ {0x1B, 0, X86Flag_Modrm, InsType_Normal},
+		/* NOP r/m32 (hint)            */ {0x1C, 0, X86Flag_Modrm, InsType_Normal},
+		/* NOP r/m32 (hint)            */ {0x1D, 0, X86Flag_Modrm, InsType_Normal},
+		/* NOP r/m32 / ENDBR32         */ {0x1E, 0, X86Flag_Modrm, InsType_Normal},
+		/* NOP r/m32 / ENDBR32         */ {0x1F, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* MOV r32, CRn                */ {0x20, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOV r32, DRn                */ {0x21, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOV CRn, r32                */ {0x22, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOV DRn, r32                */ {0x23, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVAPS xmm, m               */ {0x28, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVAPS m, xmm               */ {0x29, 0, X86Flag_Modrm, InsType_Normal},
+		/* CVTPI2PS/CVTSI2SS           */ {0x2A, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVNTPS                     */ {0x2B, 0, X86Flag_Modrm, InsType_Normal},
+		/* CVTTPS2PI/CVTTSS2SI         */ {0x2C, 0, X86Flag_Modrm, InsType_Normal},
+		/* CVTPS2PI/CVTSS2SI           */ {0x2D, 0, X86Flag_Modrm, InsType_Normal},
+		/* UCOMISS                     */ {0x2E, 0, X86Flag_Modrm, InsType_Normal},
+		/* COMISS                      */ {0x2F, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* WRMSR                       */ {0x30, 0, 0, InsType_Normal},
+		/* RDTSC                       */ {0x31, 0, 0, InsType_Normal},
+		/* RDMSR                       */ {0x32, 0, 0, InsType_Normal},
+		/* RDPMC                       */ {0x33, 0, 0, InsType_Normal},
+		/* SYSENTER                    */ {0x34, 0, 0, InsType_Normal},
+		/* SYSEXIT                     */ {0x35, 0, 0, InsType_Normal},
+		/* GETSEC                      */ {0x37, 0, 0, InsType_Normal},
+
+		/* CMOVcc r32, r/m32           */ {0x40, 0, X86Flag_Modrm | X86Flag_Cond, InsType_Normal},
+
+		/* MOVMSKPS                    */ {0x50, 0, X86Flag_Modrm, InsType_Normal},
+		/* SQRTPS                      */ {0x51, 0, X86Flag_Modrm, InsType_Normal},
+		/* RSQRTPS                     */ {0x52, 0, X86Flag_Modrm, InsType_Normal},
+		/* RCPPS                       */ {0x53, 0, X86Flag_Modrm, InsType_Normal},
+		/* ANDPS                       */ {0x54, 0, X86Flag_Modrm, InsType_Normal},
+		/* ANDNPS                      */ {0x55, 0, X86Flag_Modrm, InsType_Normal},
+		/* ORPS                        */ {0x56, 0, X86Flag_Modrm, InsType_Normal},
+		/* XORPS                       */ {0x57, 0, X86Flag_Modrm, InsType_Normal},
+		/* ADDPS                       */ {0x58, 0, X86Flag_Modrm, InsType_Normal},
+		/* MULPS                       */ {0x59, 0, X86Flag_Modrm, InsType_Normal},
+		/* CVTPS2PD                    */ {0x5A, 0, X86Flag_Modrm, InsType_Normal},
+		/* CVTDQ2PS                    */ {0x5B, 0, X86Flag_Modrm, InsType_Normal},
+		/* SUBPS                       */ {0x5C, 0, X86Flag_Modrm, InsType_Normal},
+		/* MINPS                       */ {0x5D, 0, X86Flag_Modrm, InsType_Normal},
+		/* DIVPS                       */ {0x5E, 0, X86Flag_Modrm, InsType_Normal},
+		/* MAXPS                       */ {0x5F, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* PUNPCKLBW                   */ {0x60, 0, X86Flag_Modrm, InsType_Normal},
+		/* PUNPCKLWD                   */ {0x61, 0, X86Flag_Modrm, InsType_Normal},
+		/* PUNPCKLDQ                   */ {0x62, 0, X86Flag_Modrm, InsType_Normal},
+		/* PACKSSWB                    */ {0x63, 0, X86Flag_Modrm, InsType_Normal},
+		/* PCMPGTB                     */ {0x64, 0, X86Flag_Modrm, InsType_Normal},
+		/* PCMPGTW                     */ {0x65, 0, X86Flag_Modrm, InsType_Normal},
+		/* PCMPGTD                     */ {0x66, 0, X86Flag_Modrm, InsType_Normal},
+		/* PACKUSWB                    */ {0x67, 0, X86Flag_Modrm, InsType_Normal},
+		/* PUNPCKHBW                   */ {0x68, 0, X86Flag_Modrm, InsType_Normal},
+		/* PUNPCKHWD                   */ {0x69, 0, X86Flag_Modrm, InsType_Normal},
+		/* PUNPCKHDQ                   */ {0x6A, 0, X86Flag_Modrm, InsType_Normal},
+		/* PACKSSDW                    */ {0x6B, 0, X86Flag_Modrm, InsType_Normal},
+		/* PUNPCKLQDQ                  */ {0x6C, 0, X86Flag_Modrm, InsType_Normal},
+		/* PUNPCKHQDQ                  */ {0x6D, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVD mm, r/m32              */ {0x6E, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVQ/MOVDQA mm, m           */ {0x6F, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* PSHUFW/PSHUFD imm8          */ {0x70, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal},
+		/* PSRLW..PSLLW imm8 (grp 12)  */ {0x71, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal},
+		/* PSRLD..PSLLD imm8 (grp 13)  */ {0x72, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal},
+		/* PSRLQ..PSLLDQ imm8 (grp 14) */ {0x73, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal},
+		/* PCMPEQB                     */ {0x74, 0, X86Flag_Modrm, InsType_Normal},
+		/* PCMPEQW                     */ {0x75, 0, X86Flag_Modrm, InsType_Normal},
+		/* PCMPEQD                     */ {0x76, 0, X86Flag_Modrm, InsType_Normal},
+		/* EMMS                        */ {0x77, 0, 0, InsType_Normal},
+		/* VMREAD r/m32, r32           */ {0x78, 0, X86Flag_Modrm, InsType_Normal},
+		/* VMWRITE r32, r/m32          */ {0x79, 0, X86Flag_Modrm, InsType_Normal},
+		/* HADDPD/HADDPS               */ {0x7C, 0, X86Flag_Modrm, InsType_Normal},
+		/* HSUBPD/HSUBPS               */ {0x7D, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVD r/m32, mm              */ {0x7E, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVQ/MOVDQA m, mm           */ {0x7F, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* Jcc rel32                   */ {0x80, 0, X86Flag_Imm32 | X86Flag_Reloc | X86Flag_Cond, InsType_Jump},
+
+		/* SETcc r/m8                  */ {0x90, 0, X86Flag_Modrm | X86Flag_Cond, InsType_Normal},
+
+		/* PUSH FS                     */ {0xA0, 0, 0, InsType_Normal},
+		/* POP FS                      */ {0xA1, 0, 0, InsType_Normal},
+		/* CPUID                       */ {0xA2, 0, 0, InsType_Normal},
+		/* BT r/m32, r32               */ {0xA3, 0, X86Flag_Modrm, InsType_Normal},
+		/* SHLD r/m32, r32, imm8       */ {0xA4, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal},
+		/* SHLD r/m32, r32, CL         */ {0xA5, 0, X86Flag_Modrm, InsType_Normal},
+		/* PUSH GS                     */ {0xA8, 0, 0, InsType_Normal},
+		/* POP GS                      */ {0xA9, 0, 0, InsType_Normal},
+		/* RSM                         */ {0xAA, 0, 0, InsType_Normal},
+		/* BTS r/m32, r32              */ {0xAB, 0, X86Flag_Modrm, InsType_Normal},
+		/* SHRD r/m32, r32, imm8       */ {0xAC, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal},
+		/* SHRD r/m32, r32, CL         */ {0xAD, 0, X86Flag_Modrm, InsType_Normal},
+		/* FXSAVE..CLFLUSH (grp 15)    */ {0xAE, 0, X86Flag_Modrm, InsType_Normal},
+		/* IMUL r32, r/m32             */ {0xAF, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* CMPXCHG r/m8, r8            */ {0xB0, 0, X86Flag_Modrm, InsType_Normal},
+		/* CMPXCHG r/m32, r32          */ {0xB1, 0, X86Flag_Modrm, InsType_Normal},
+		/* LSS r32, m16:32             */ {0xB2, 0, X86Flag_Modrm, InsType_Normal},
+		/* BTR r/m32, r32              */ {0xB3, 0, X86Flag_Modrm, InsType_Normal},
+		/* LFS r32, m16:32             */ {0xB4, 0, X86Flag_Modrm, InsType_Normal},
+		/* LGS r32, m16:32             */ {0xB5, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVZX r32, r/m8             */ {0xB6, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVZX r32, r/m16            */ {0xB7, 0, X86Flag_Modrm, InsType_Normal},
+		/* POPCNT r32, r/m32           */ {0xB8, 0, X86Flag_Modrm, InsType_Normal},
+		/* UD1 r32, r/m32              */ {0xB9, 0, X86Flag_Modrm, InsType_Normal},
+		/* BT..BTC r/m32, imm8 (grp 8) */ {0xBA, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal},
+		/* BTC r/m32, r32              */ {0xBB, 0, X86Flag_Modrm, InsType_Normal},
+		/* BSF/TZCNT r32, r/m32        */ {0xBC, 0, X86Flag_Modrm, InsType_Normal},
+		/* BSR/LZCNT r32, r/m32        */ {0xBD, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVSX r32, r/m8             */ {0xBE, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVSX r32, r/m16            */ {0xBF, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* XADD r/m8, r8               */ {0xC0, 0, X86Flag_Modrm, InsType_Normal},
+		/* XADD r/m32, r32             */ {0xC1, 0, X86Flag_Modrm, InsType_Normal},
+		/* CMPPS xmm, m, imm8          */ {0xC2, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal},
+		/* MOVNTI m32, r32             */ {0xC3, 0, X86Flag_Modrm, InsType_Normal},
+		/* PINSRW mm, r/m16, imm8      */ {0xC4, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal},
+		/* PEXTRW r32, mm, imm8        */ {0xC5, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal},
+		/* SHUFPS xmm, m, imm8         */ {0xC6, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal},
+		/* CMPXCHG8B/RDRAND (grp 9)    */ {0xC7, 0, X86Flag_Modrm, InsType_Normal},
+		/* BSWAP r32                   */ {0xC8, 0, X86Flag_PlusR, InsType_Normal},
+
+		/* ADDSUBPD                    */ {0xD0, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSRLW                       */ {0xD1, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSRLD                       */ {0xD2, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSRLQ                       */ {0xD3, 0, X86Flag_Modrm, InsType_Normal},
+		/* PADDQ                       */ {0xD4, 0, X86Flag_Modrm, InsType_Normal},
+		/* PMULLW                      */ {0xD5, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVQ m64, xmm               */ {0xD6, 0, X86Flag_Modrm, InsType_Normal},
+		/* PMOVMSKB                    */ {0xD7, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSUBUSB                     */ {0xD8, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSUBUSW                     */ {0xD9, 0, X86Flag_Modrm, InsType_Normal},
+		/* PMINUB                      */ {0xDA, 0, X86Flag_Modrm, InsType_Normal},
+		/* PAND                        */ {0xDB, 0, X86Flag_Modrm, InsType_Normal},
+		/* PADDUSB                     */ {0xDC, 0, X86Flag_Modrm, InsType_Normal},
+		/* PADDUSW                     */ {0xDD, 0, X86Flag_Modrm, InsType_Normal},
+		/* PMAXUB                      */ {0xDE, 0, X86Flag_Modrm, InsType_Normal},
+		/* PANDN                       */ {0xDF, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* PAVGB                       */ {0xE0, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSRAW                       */ {0xE1, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSRAD                       */ {0xE2, 0, X86Flag_Modrm, InsType_Normal},
+		/* PAVGW                       */ {0xE3, 0, X86Flag_Modrm, InsType_Normal},
+		/* PMULHUW                     */ {0xE4, 0, X86Flag_Modrm, InsType_Normal},
+		/* PMULHW                      */ {0xE5, 0, X86Flag_Modrm, InsType_Normal},
+		/* CVTTPD2DQ                   */ {0xE6, 0, X86Flag_Modrm, InsType_Normal},
+		/* MOVNTQ/MOVNTDQ              */ {0xE7, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSUBSB                      */ {0xE8, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSUBSW                      */ {0xE9, 0, X86Flag_Modrm, InsType_Normal},
+		/* PMINSW                      */ {0xEA, 0, X86Flag_Modrm, InsType_Normal},
+		/* POR                         */ {0xEB, 0, X86Flag_Modrm, InsType_Normal},
+		/* PADDSB                      */ {0xEC, 0, X86Flag_Modrm, InsType_Normal},
+		/* PADDSW                      */ {0xED, 0, X86Flag_Modrm, InsType_Normal},
+		/* PMAXSW                      */ {0xEE, 0, X86Flag_Modrm, InsType_Normal},
+		/* PXOR                        */ {0xEF, 0, X86Flag_Modrm, InsType_Normal},
+
+		/* LDDQU                       */ {0xF0, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSLLW                       */ {0xF1, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSLLD                       */ {0xF2, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSLLQ                       */ {0xF3, 0, X86Flag_Modrm, InsType_Normal},
+		/* PMULUDQ                     */ {0xF4, 0, X86Flag_Modrm, InsType_Normal},
+		/* PMADDWD                     */ {0xF5, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSADBW                      */ {0xF6, 0, X86Flag_Modrm, InsType_Normal},
+		/* MASKMOVQ                    */ {0xF7, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSUBB                       */ {0xF8, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSUBW                       */ {0xF9, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSUBD                       */ {0xFA, 0, X86Flag_Modrm, InsType_Normal},
+		/* PSUBQ                       */ {0xFB, 0, X86Flag_Modrm, InsType_Normal},
+		/* PADDB                       */ {0xFC, 0, X86Flag_Modrm, InsType_Normal},
+		/* PADDW                       */ {0xFD, 0, X86Flag_Modrm, InsType_Normal},
+		/* PADDD                       */ {0xFE, 0, X86Flag_Modrm, InsType_Normal},
+		/* UD0 r32, r/m32              */ {0xFF, 0, X86Flag_Modrm, InsType_Normal}
+	};
 
+	// Three-byte maps: every 0F 38 opcode takes a ModR/M byte, every 0F 3A opcode adds an imm8
+	constexpr HSOpcodeInfo HS_X86_OPCODE_0F38 = { 0x38, 0, X86Flag_Modrm, InsType_Normal };
+	constexpr HSOpcodeInfo HS_X86_OPCODE_0F3A = { 0x3A, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal };
 
-	bool HSx86Decoder::CheckBounds(signed32 uCurrent, signed32 sIncrement, signed32 uMaxLen)
+	// VEX and EVEX carry the map in their payload, only VZEROUPPER/VZEROALL go without a ModR/M byte
+	constexpr HSOpcodeInfo HS_X86_OPCODE_VEX = { 0, 0, X86Flag_Modrm, InsType_Normal };
+	constexpr HSOpcodeInfo HS_X86_OPCODE_VEX_IMM8 = { 0, 0, X86Flag_Modrm | X86Flag_Imm8, InsType_Normal };
+	constexpr HSOpcodeInfo HS_X86_OPCODE_VZERO = { 0x77, 0, 0, InsType_Normal };
+
+	constexpr unsigned32 HS_X86_MAX_GROUPS = 32;
+
+	enum HSX86PrefixKind
 	{
-		return (uCurrent >= 0) && (sIncrement >= 0) && ((uCurrent + sIncrement) <= uMaxLen);
-	}
+		X86Prefix_Other = 1,
+		X86Prefix_OperandSize = 2,
+		X86Prefix_AddressSize = 4,
+		X86Prefix_Rex = 8
+	};
 
-	signed32 HSx86Decoder::ParsePrefixes(const ptrU8 pCode, signed32& sLen, signed32& sOperandSize)
+	enum HSX86ModrmKind
 	{
-		signed32 sStartLen = sLen;
+		X86Modrm_DispMask = 7,
+		X86Modrm_Sib = 8
+	};
 
-		while (CheckBounds(sLen, 1, 15))
+	struct HSX86OpcodeTable
+	{
+		signed16 aIndex[256];                      // Entry for opcodes without a /r group, -1 if unsupported
+		unsigned8 aGroup[256];                     // Group number + 1 for opcodes selected by ModRM.reg
+		signed16 aGroupIndex[HS_X86_MAX_GROUPS][8]; // Entry per ModRM.reg value, -1 if unsupported
+		unsigned32 uGroupNum;
+	};
+
+	constexpr HSX86OpcodeTable BuildOpcodeTable(const HSOpcodeInfo* pList, unsigned32 uNum, bool bLongMode)
+	{
+		HSX86OpcodeTable stTable{};
+
+		for (unsigned32 i = 0; i < 256; i++)
+		{
+			stTable.aIndex[i] = -1;
+			stTable.aGroup[i] = 0;
+		}
+
+		for (unsigned32 i = 0; i < HS_X86_MAX_GROUPS; i++)
+		{
+			for (unsigned32 j = 0; j < 8; j++)
+			{
+				stTable.aGroupIndex[i][j] = -1;
+			}
+		}
+
+		// Earlier entries win, matching the order of the opcode list
+		for (unsigned32 i = 0; i < uNum; i++)
 		{
-			bool bFoundPrefix = false;
+			const HSOpcodeInfo& stInfo = pList[i];
+
+			if (bLongMode && (stInfo.uFlags & X86Flag_Legacy))
+			{
+				continue;
+			}
 
-			for (size_t i = 0; i < sizeof(HS_X86_PREFIXES) / sizeof(HS_X86_PREFIXES[0]); i++)
+			if (stInfo.uFlags & X86Flag_RegOP)
 			{
-				if (pCode[sLen] == HS_X86_PREFIXES[i])
+				if (stTable.aGroup[stInfo.uOpcode] == 0)
 				{
-					bFoundPrefix = true;
+					stTable.aGroup[stInfo.uOpcode] = (unsigned8)(++stTable.uGroupNum);
+				}
 
-					if (HS_X86_PREFIXES[i] == 0x66)
-					{
-						sOperandSize = 2;
-					}
+				signed16& sSlot = stTable.aGroupIndex[stTable.aGroup[stInfo.uOpcode] - 1][stInfo.uRegOpcode];
 
-					sLen++;
-					break;
+				if (sSlot < 0)
+				{
+					sSlot = (signed16)i;
 				}
+
+				continue;
 			}
 
-			if (!bFoundPrefix)
+			unsigned32 uCount = (stInfo.uFlags & X86Flag_PlusR) ? 8 : (stInfo.uFlags & X86Flag_Cond) ? 16 : 1;
+
+			for (unsigned32 j = 0; j < uCount; j++)
 			{
-				break;
+				if (stTable.aIndex[stInfo.uOpcode + j] < 0)
+				{
+					stTable.aIndex[stInfo.uOpcode + j] = (signed16)i;
+				}
 			}
 		}
 
-		return sLen - sStartLen;
+		return stTable;
 	}
 
-	bool HSx86Decoder::MatchOpcode(const ptrU8 pCode, signed32& sLen, signed32& sOpcodeIndex, signed32 sOperandSize)
+	struct HSX86ByteTable
+	{
+		unsigned8 aValue[256];
+	};
+
+	constexpr HSX86ByteTable BuildPrefixTable(bool bLongMode)
 	{
-		if (!CheckBounds(sLen, 0, 15))
+		HSX86ByteTable stTable{};
+
+		for (unsigned8 uPrefix : HS_X86_PREFIXES)
 		{
-			return false;
+			stTable.aValue[uPrefix] = X86Prefix_Other;
 		}
 
-		for (unsigned32 i = 0; i < sizeof(HS_X86_OPCODES) / sizeof(HS_X86_OPCODES[0]); i++)
+		// INC/DEC r32 in 32-bit code
+		for (unsigned32 i = 0x40; bLongMode && i <= 0x4F; i++)
 		{
-			bool bFoundOpcode = false;
+			stTable.aValue[i] = X86Prefix_Rex;
+		}
+
+		stTable.aValue[0x66] = X86Prefix_OperandSize;
+		stTable.aValue[0x67] = X86Prefix_AddressSize;
+		return stTable;
+	}
+
+	constexpr HSX86ByteTable BuildModrmTable(bool b16Bit)
+	{
+		HSX86ByteTable stTable{};
 
-			if (pCode[sLen] == HS_X86_OPCODES[i].uOpcode)
+		for (unsigned32 i = 0; i < 256; i++)
+		{
+			unsigned32 uMod = i >> 6;
+			unsigned32 uRM = i & 0x07;
+			unsigned32 uValue = 0;
+
+			if (uMod == 3)
+			{
+				stTable.aValue[i] = 0;
+				continue;
+			}
+
+			if (b16Bit)
 			{
-				if (HS_X86_OPCODES[i].uFlags & X86Flag_RegOP)
+				if (uMod == 1)
 				{
-					if (!CheckBounds(sLen, 2, 15))
-					{
-						continue;
-					}
-
-					unsigned8 uModRM = pCode[sLen + 1];
-					unsigned8 uRegOp = (uModRM >> 3) & 0x07;
-					bFoundOpcode = (uRegOp == HS_X86_OPCODES[i].uRegOpcode);
+					uValue = 1;
 				}
-				else
+				else if (uMod == 2 || (uMod == 0 && uRM == 6))
 				{
-					bFoundOpcode = true;
+					uValue = 2;
 				}
 			}
-
-			if (!bFoundOpcode && (HS_X86_OPCODES[i].uFlags & X86Flag_PlusR))
+			else
 			{
-				if ((pCode[sLen] & 0xF8) == HS_X86_OPCODES[i].uOpcode)
+				if (uRM == 4)
 				{
-					bFoundOpcode = true;
+					uValue |= X86Modrm_Sib;
 				}
+
+				if (uMod == 1)
+				{
+					uValue |= 1;
+				}
+				else if (uMod == 2 || (uMod == 0 && uRM == 5))
+				{
+					uValue |= 4;
+				}
+			}
+
+			stTable.aValue[i] = (unsigned8)uValue;
+		}
+
+		return stTable;
+	}
+
+	constexpr HSX86OpcodeTable HS_X86_OPCODE_TABLE = BuildOpcodeTable(HS_X86_OPCODES, sizeof(HS_X86_OPCODES) / sizeof(HS_X86_OPCODES[0]), HS_X86_LONG_MODE);
+	constexpr HSX86OpcodeTable HS_X86_OPCODE_TABLE_0F = BuildOpcodeTable(HS_X86_OPCODES_0F, sizeof(HS_X86_OPCODES_0F) / sizeof(HS_X86_OPCODES_0F[0]), HS_X86_LONG_MODE);
+	constexpr HSX86ByteTable HS_X86_PREFIX_TABLE = BuildPrefixTable(HS_X86_LONG_MODE);
+	constexpr HSX86ByteTable HS_X86_MODRM_TABLE = BuildModrmTable(false);
+	constexpr HSX86ByteTable HS_X86_MODRM16_TABLE = BuildModrmTable(true);
+
+	static_assert(HS_X86_OPCODE_TABLE.uGroupNum <= HS_X86_MAX_GROUPS, "HS_X86_MAX_GROUPS is too small");
+	static_assert(HS_X86_OPCODE_TABLE_0F.uGroupNum <= HS_X86_MAX_GROUPS, "HS_X86_MAX_GROUPS is too small");
+
+
+	bool HSx86Decoder::CheckBounds(signed32 uCurrent, signed32 sIncrement, signed32 uMaxLen)
+	{
+		return (uCurrent >= 0) && (sIncrement >= 0) && ((uCurrent + sIncrement) <= uMaxLen);
+	}
+
+	signed32 HSx86Decoder::ParsePrefixes(const ptrU8 pCode, signed32& sLen, signed32& sOperandSize, signed32& sAddressSize)
+	{
+		signed32 sStartLen = sLen;
+		bool bRexW = false;
+
+		while (CheckBounds(sLen, 1, 15))
+		{
+			unsigned8 uKind = HS_X86_PREFIX_TABLE.aValue[pCode[sLen]];
+
+			if (!uKind)
+			{
+				break;
 			}
 
-			if (bFoundOpcode)
+			// A REX prefix only counts when the opcode follows it directly
+			bRexW = uKind == X86Prefix_Rex && (pCode[sLen] & 0x08);
+
+			if (uKind == X86Prefix_OperandSize)
+			{
+				sOperandSize = 2;
+			}
+			else if (uKind == X86Prefix_AddressSize)
 			{
-				sOpcodeIndex = static_cast<signed32>(i);
-				sLen++;
-				return true;
+				sAddressSize = HS_X86_LONG_MODE ? 4 : 2;
 			}
+
+			sLen++;
 		}
-		return false;
+
+		if (bRexW)
+		{
+			sOperandSize = 8;
+		}
+
+		return sLen - sStartLen;
 	}
 
-	void HSx86Decoder::SetRelocationInfo(HSInsInfo& stInsInfo, const HSOpcodeInfo& stOpcodeInfo, signed32& sLen, signed32 sOperandSize)
+	const HSOpcodeInfo* HSx86Decoder::MatchOpcode(const ptrU8 pCode, signed32& sLen)
 	{
-		if (stOpcodeInfo.uFlags & X86Flag_Reloc)
+		const HSX86OpcodeTable* pTable = &HS_X86_OPCODE_TABLE;
+		const HSOpcodeInfo* pList = HS_X86_OPCODES;
+
+		if (!CheckBounds(sLen, 1, 15))
 		{
-			stInsInfo.bNeedReloc = true;
-			stInsInfo.sRelocOffset = sLen;
+			return nullptr;
+		}
 
-			if (stOpcodeInfo.uFlags & X86Flag_Imm8)
+		if (pCode[sLen] == 0xC4 || pCode[sLen] == 0xC5 || pCode[sLen] == 0x62)
+		{
+			if (!CheckBounds(sLen, 2, 15))
+			{
+				return nullptr;
+			}
+
+			// Outside 64-bit mode the same bytes are LES, LDS and BOUND unless a register operand follows
+			if (HS_X86_LONG_MODE || (pCode[sLen + 1] & 0xC0) == 0xC0)
 			{
-				stInsInfo.sRelocSize = 1;
+				return MatchVex(pCode, sLen);
 			}
-			else if (stOpcodeInfo.uFlags & X86Flag_Imm32)
+		}
+
+		if (pCode[sLen] == 0x0F)
+		{
+			if (!CheckBounds(sLen, 2, 15))
 			{
-				stInsInfo.sRelocSize = 4;
+				return nullptr;
 			}
-			else if (stOpcodeInfo.uFlags & X86Flag_Imm16)
+
+			sLen++;
+
+			if (pCode[sLen] == 0x38 || pCode[sLen] == 0x3A)
 			{
-				stInsInfo.sRelocSize = 2;
+				if (!CheckBounds(sLen, 2, 15))
+				{
+					return nullptr;
+				}
+
+				unsigned8 uMap = pCode[sLen];
+				sLen += 2;
+				return uMap == 0x38 ? &HS_X86_OPCODE_0F38 : &HS_X86_OPCODE_0F3A;
 			}
+
+			pTable = &HS_X86_OPCODE_TABLE_0F;
+			pList = HS_X86_OPCODES_0F;
+		}
+
+		unsigned8 uOpcode = pCode[sLen];
+		unsigned8 uGroup = pTable->aGroup[uOpcode];
+		signed32 sIndex = pTable->aIndex[uOpcode];
+
+		if (uGroup)
+		{
+			if (!CheckBounds(sLen, 2, 15))
+			{
+				return nullptr;
+			}
+
+			sIndex = pTable->aGroupIndex[uGroup - 1][(pCode[sLen + 1] >> 3) & 0x07];
+		}
+
+		if (sIndex < 0)
+		{
+			return nullptr;
+		}
+
+		sLen++;
+		return &pList[sIndex];
+	}
+
+	const HSOpcodeInfo* HSx86Decoder::MatchVex(const ptrU8 pCode, signed32& sLen)
+	{
+		// C5 has one payload byte and implies map 0F, C4 has two with the map in the low 5 bits,
+		// EVEX (62) has three with the map in the low 3 bits
+		unsigned8 uLead = pCode[sLen];
+		signed32 sPayload = uLead == 0xC5 ? 1 : uLead == 0xC4 ? 2 : 3;
+		unsigned8 uMap = uLead == 0xC5 ? 1 : uLead == 0xC4 ? (pCode[sLen + 1] & 0x1F) : (pCode[sLen + 1] & 0x07);
+
+		if (!CheckBounds(sLen, sPayload + 2, 15))
+		{
+			return nullptr;
+		}
+
+		sLen += sPayload + 1;
+		unsigned8 uOpcode = pCode[sLen++];
+
+		switch (uMap)
+		{
+		case 1:
+			if (uOpcode == 0x77)
+			{
+				return &HS_X86_OPCODE_VZERO;
+			}
+
+			// Shifts by immediate, compares, PINSRW/PEXTRW and shuffles
+			return ((uOpcode >= 0x70 && uOpcode <= 0x73) || uOpcode == 0xC2 || (uOpcode >= 0xC4 && uOpcode <= 0xC6))
+				? &HS_X86_OPCODE_VEX_IMM8 : &HS_X86_OPCODE_VEX;
+		case 2:
+		case 5:
+		case 6:
+			return &HS_X86_OPCODE_VEX;
+		case 3:
+			return &HS_X86_OPCODE_VEX_IMM8;
+		default:
+			return nullptr;
+		}
+	}
+
+	void HSx86Decoder::SetRelocationInfo(HSInsInfo& stInsInfo, const HSOpcodeInfo& stOpcodeInfo)
+	{
+		if ((stOpcodeInfo.uFlags & X86Flag_Reloc) && stInsInfo.bHasImmediate)
+		{
+			stInsInfo.bNeedReloc = true;
+			stInsInfo.sRelocOffset = stInsInfo.sImmOffset;
+			stInsInfo.sRelocSize = stInsInfo.sImmSize;
 		}
 	}
 
@@ -268,7 +872,7 @@ namespace HSLL
 		stInsInfo.bIsCall = (stOpcodeInfo.uInsType == InsType_Call);
 	}
 
-	bool HSx86Decoder::ParseModRM(const ptrU8 pCode, signed32& sLen, HSInsInfo& stInsInfo, signed32 sOperandSize)
+	bool HSx86Decoder::ParseModRM(const ptrU8 pCode, signed32& sLen, HSInsInfo& stInsInfo, signed32 sAddressSize)
 	{
 		stInsInfo.bHasModrm = true;
 		stInsInfo.sModrmOffset = sLen;
@@ -279,110 +883,81 @@ namespace HSLL
 		}
 
 		unsigned8 uModrm = pCode[sLen++];
-		unsigned8 uMod = uModrm >> 6;
-		unsigned8 uRM = uModrm & 0x07;
+		unsigned8 uKind = (sAddressSize == 2 ? HS_X86_MODRM16_TABLE : HS_X86_MODRM_TABLE).aValue[uModrm];
+		signed32 sDispSize = uKind & X86Modrm_DispMask;
 
-		if (uMod == 3)
+		// In 64-bit mode mod 00 rm 101 is disp32 from the end of the instruction instead of an absolute address
+		if (HS_X86_LONG_MODE && (uModrm & 0xC7) == 0x05)
 		{
-			return true;
+			stInsInfo.bRipRelative = true;
+			stInsInfo.sDispOffset = (signed8)sLen;
 		}
 
-		if (uRM == 4) // SIB byte present
+		if (uKind & X86Modrm_Sib)
 		{
 			if (!CheckBounds(sLen, 1, 15))
 			{
 				return false;
 			}
 
-			unsigned8 uSib = pCode[sLen++];
-			unsigned8 uBase = uSib & 0x07;
-			unsigned8 uIndex = (uSib >> 3) & 0x07;
-			unsigned8 uScale = (uSib >> 6) & 0x03;
-
-			if (uMod == 0)
-			{
-				if (uBase == 5)
-				{
-					if (!CheckBounds(sLen, 4, 15))
-						return false;
-					sLen += 4;
-				}
-			}
-			else if (uMod == 1)
-			{
-				if (!CheckBounds(sLen, 1, 15))
-					return false;
-				sLen += 1;
-			}
-			else if (uMod == 2)
+			// SIB base 101 with mod 00 means disp32 and no base register
+			if ((uModrm >> 6) == 0 && (pCode[sLen] & 0x07) == 5)
 			{
-				if (!CheckBounds(sLen, 4, 15))
-					return false;
-				sLen += 4;
+				sDispSize = 4;
 			}
+
+			sLen++;
 		}
-		else
+
+		if (!CheckBounds(sLen, sDispSize, 15))
 		{
-			if (uMod == 0)
-			{
-				if (uRM == 5) // disp32 only
-				{
-					if (!CheckBounds(sLen, 4, 15))
-						return false;
-					sLen += 4;
-				}
-			}
-			else if (uMod == 1)
-			{
-				if (!CheckBounds(sLen, 1, 15))
-					return false;
-				sLen += 1;
-			}
-			else if (uMod == 2)
-			{
-				if (!CheckBounds(sLen, 4, 15))
-					return false;
-				sLen += 4;
-			}
+			return false;
 		}
 
+		sLen += sDispSize;
 		return true;
 	}
 
-	void HSx86Decoder::ParseImmediate(const HSOpcodeInfo& stOpcodeInfo, signed32& sLen, signed32 sOperandSize, HSInsInfo& pInfo)
+	bool HSx86Decoder::ParseImmediate(const HSOpcodeInfo& stOpcodeInfo, signed32& sLen, signed32 sOperandSize, signed32 sAddressSize, HSInsInfo& pInfo)
 	{
-		if (stOpcodeInfo.uFlags & X86Flag_Imm8)
+		signed32 sImmSize = 0;
+
+		// Immediates of one instruction are adjacent, e.g. ENTER iw ib or a far pointer
+		if (stOpcodeInfo.uFlags & X86Flag_Imm32)
 		{
-			if (CheckBounds(sLen, 1, 15))
-			{
-				pInfo.bHasImmediate = true;
-				pInfo.sImmOffset = sLen;
-				pInfo.sImmSize = 1;
-				sLen += 1;
-			}
+			sImmSize += (sOperandSize == 8 && (stOpcodeInfo.uFlags & X86Flag_Imm64)) ? 8 : (sOperandSize == 2) ? 2 : 4;
 		}
-		else if (stOpcodeInfo.uFlags & X86Flag_Imm16)
+
+		if (stOpcodeInfo.uFlags & X86Flag_Moffs)
 		{
-			if (CheckBounds(sLen, 2, 15))
-			{
-				pInfo.bHasImmediate = true;
-				pInfo.sImmOffset = sLen;
-				pInfo.sImmSize = 2;
-				sLen += 2;
-			}
+			sImmSize += sAddressSize;
 		}
-		else if (stOpcodeInfo.uFlags & X86Flag_Imm32)
+
+		if (stOpcodeInfo.uFlags & X86Flag_Imm16)
 		{
-			signed32 sImmSize = (sOperandSize == 2) ? 2 : 4;
+			sImmSize += 2;
+		}
 
-			if (CheckBounds(sLen, sImmSize, 15))
-			{
-				pInfo.bHasImmediate = true;
-				pInfo.sImmOffset = sLen;
-				pInfo.sImmSize = sImmSize;
-				sLen += sImmSize;
-			}
+		if (stOpcodeInfo.uFlags & X86Flag_Imm8)
+		{
+			sImmSize += 1;
 		}
+
+		if (sImmSize == 0)
+		{
+			return true;
+		}
+
+		if (!CheckBounds(sLen, sImmSize, 15))
+		{
+			return false;
+		}
+
+		pInfo.bHasImmediate = true;
+		pInfo.sImmOffset = sLen;
+		pInfo.sImmSize = sImmSize;
+		sLen += sImmSize;
+		return true;
 	}
 
 	void HSx86Decoder::InitializeInsInfo(HSInsInfo& stInsInfo)
@@ -399,6 +974,8 @@ namespace HSLL
 		stInsInfo.bIsJmp = false;
 		stInsInfo.bIsRet = false;
 		stInsInfo.bIsCall = false;
+		stInsInfo.bRipRelative = false;
+		stInsInfo.sDispOffset = -1;
 	}
 
 	bool HSx86Decoder::ParseCode(const ptrAny pIns, HSInsInfo& stInsInfo)
@@ -410,35 +987,35 @@ namespace HSLL
 
 		signed32 sLen = 0;
 		signed32 sOperandSize = 4;
-		signed32 sOpcodeIndex = -1;
+		signed32 sAddressSize = HS_X86_LONG_MODE ? 8 : 4;
 		const ptrU8 pCode = (ptrU8)pIns;
 
 		InitializeInsInfo(stInsInfo);
-		ParsePrefixes(pCode, sLen, sOperandSize);
+		ParsePrefixes(pCode, sLen, sOperandSize, sAddressSize);
 
-		if (!MatchOpcode(pCode, sLen, sOpcodeIndex, sOperandSize))
-		{
-			return false;
-		}
+		const HSOpcodeInfo* pMatchedOpcode = MatchOpcode(pCode, sLen);
 
-		if (sOpcodeIndex < 0 || static_cast<size_t>(sOpcodeIndex) >= sizeof(HS_X86_OPCODES) / sizeof(HS_X86_OPCODES[0]))
+		if (pMatchedOpcode == nullptr)
 		{
 			return false;
 		}
 
-		const HSOpcodeInfo& stMatchedOpcode = HS_X86_OPCODES[sOpcodeIndex];
-		SetInstructionType(stInsInfo, stMatchedOpcode);
+		SetInstructionType(stInsInfo, *pMatchedOpcode);
 
-		if (stMatchedOpcode.uFlags & X86Flag_Modrm)
+		if (pMatchedOpcode->uFlags & X86Flag_Modrm)
 		{
-			if (!ParseModRM(pCode, sLen, stInsInfo, sOperandSize))
+			if (!ParseModRM(pCode, sLen, stInsInfo, sAddressSize))
 			{
 				return false;
 			}
 		}
 
-		ParseImmediate(stMatchedOpcode, sLen, sOperandSize, stInsInfo);
-		SetRelocationInfo(stInsInfo, stMatchedOpcode, sLen, sOperandSize);
+		if (!ParseImmediate(*pMatchedOpcode, sLen, sOperandSize, sAddressSize, stInsInfo))
+		{
+			return false;
+		}
+
+		SetRelocationInfo(stInsInfo, *pMatchedOpcode);
 
 		if (sLen > 15 || sLen <= 0)
 		{
@@ -449,8 +1026,66 @@ namespace HSLL
 		return true;
 	}
 
-	bool HSx86Decoder::CallJmpConvert(const HSInsInfo& stInfoBefore, unsigned32 uPosBefore, ptrU8 pInsBefore,
-		HSInsInfo& stInfoAfter, unsigned32 uPosAfter, ptrU8 pInsAfter)
+	bool HSx86Decoder::GetBranchTarget(const HSInsInfo& stInfo, unsignedP uPos, const ptrU8 pIns, unsignedP& uTarget)
+	{
+		if (!stInfo.bHasImmediate)
+		{
+			return false;
+		}
+
+		unsignedP uNext = uPos + stInfo.sTotalSize;
+
+		// A 16-bit operand size truncates EIP after the jump, which cannot be expressed with rel32
+		switch (stInfo.sImmSize)
+		{
+		case 1:
+			uTarget = uNext + *(signed8*)(pIns + stInfo.sImmOffset);
+			return true;
+		case 4:
+			uTarget = uNext + *(signed32*)(pIns + stInfo.sImmOffset);
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	bool HSx86Decoder::IsPcThunk(unsignedP uTarget, unsigned8& uReg)
+	{
+		// __x86.get_pc_thunk.reg: mov reg, [esp]; ret
+		const ptrU8 pThunk = (ptrU8)uTarget;
+
+		if (pThunk[0] != 0x8B || (pThunk[1] & 0xC7) != 0x04 || pThunk[2] != 0x24 || pThunk[3] != 0xC3)
+		{
+			return false;
+		}
+
+		uReg = (pThunk[1] >> 3) & 0x07;
+		return true;
+	}
+
+	bool HSx86Decoder::WriteRel32(ptrU8 pIns, signed32 sOffset, unsignedP uPos, unsignedP uTarget, HSInsInfo& stInfo)
+	{
+		signedP sRel = (signedP)(uTarget - (uPos + sOffset + 4));
+
+		// rel32 reaches all of a 32-bit address space, a 64-bit copy may sit too far from the target
+		if (sRel != (signed32)sRel)
+		{
+			return false;
+		}
+
+		stInfo.sTotalSize = (signed8)(sOffset + 4);
+		stInfo.bNeedReloc = true;
+		stInfo.sRelocOffset = (signed8)sOffset;
+		stInfo.sRelocSize = 4;
+		stInfo.bHasImmediate = true;
+		stInfo.sImmOffset = (signed8)sOffset;
+		stInfo.sImmSize = 4;
+		*(signed32*)(pIns + sOffset) = (signed32)sRel;
+		return true;
+	}
+
+	bool HSx86Decoder::CallJmpConvert(const HSInsInfo& stInfoBefore, unsignedP uPosBefore, ptrU8 pInsBefore,
+		HSInsInfo& stInfoAfter, unsignedP uPosAfter, ptrU8 pInsAfter)
 	{
 		if (pInsBefore == nullptr || pInsAfter == nullptr)
 		{
@@ -465,72 +1100,101 @@ namespace HSLL
 			return false;
 		}
 
-		if (!stInfoBefore.bHasImmediate)
+		unsignedP uTargetAddr = 0;
+
+		if (!GetBranchTarget(stInfoBefore, uPosBefore, pInsBefore, uTargetAddr))
 		{
 			return false;
 		}
 
-		unsigned32 uTargetAddr = 0;
+		unsignedP uNextAddr = uPosBefore + stInfoBefore.sTotalSize;
+		signed32 sOpcodeOffset = stInfoBefore.sImmOffset - 1;
+		unsigned8 uOpcode = pInsBefore[sOpcodeOffset];
+		bool bTwoByte = sOpcodeOffset > 0 && pInsBefore[sOpcodeOffset - 1] == 0x0F;
+
+		stInfoAfter.bIsJmp = stInfoBefore.bIsJmp;
+		stInfoAfter.bIsCall = stInfoBefore.bIsCall;
 
-		if (stInfoBefore.bHasImmediate)
+		if (stInfoBefore.bIsCall)
 		{
-			switch (stInfoBefore.sImmSize)
-			{
-			case 1:
+			unsigned8 uReg;
+
+			if (HS_X86_LONG_MODE && uTargetAddr == uNextAddr)
 			{
-				signed8 sOffset = *(signed8*)(pInsBefore + stInfoBefore.sImmOffset);
-				uTargetAddr = uPosBefore + stInfoBefore.sTotalSize + sOffset;
-				break;
+				// A PUSH imm32 cannot hold a 64-bit return address, 64-bit code reads RIP directly anyway
+				return false;
 			}
-			case 2:
+
+			if (uTargetAddr == uNextAddr)
 			{
-				signed16 sOffset = *(signed16*)(pInsBefore + stInfoBefore.sImmOffset);
-				uTargetAddr = uPosBefore + stInfoBefore.sTotalSize + sOffset;
-				break;
+				// call $+5; pop reg only wants the return address, push it directly
+				pInsAfter[0] = 0x68; // PUSH imm32
+				*(unsigned32*)(pInsAfter + 1) = (unsigned32)uNextAddr;
 			}
-			case 4:
+			else if (!HS_X86_LONG_MODE && IsPcThunk(uTargetAddr, uReg))
 			{
-				signed32 sOffset = *(signed32*)(pInsBefore + stInfoBefore.sImmOffset);
-				uTargetAddr = uPosBefore + stInfoBefore.sTotalSize + sOffset;
-				break;
+				pInsAfter[0] = 0xB8 + uReg; // MOV reg, imm32
+				*(unsigned32*)(pInsAfter + 1) = (unsigned32)uNextAddr;
 			}
-			default:
-				return false;
+			else
+			{
+				pInsAfter[0] = 0xE8; // CALL rel32
+				return WriteRel32(pInsAfter, 1, uPosAfter, uTargetAddr, stInfoAfter);
 			}
-		}
 
-		unsigned32 uNewInstructionEnd = uPosAfter + 5;
-		signed32 sNewOffset = (signed32)uTargetAddr - (signed32)uNewInstructionEnd;
-
-		if (sNewOffset > (signed32)0x7FFFFFFF || sNewOffset < -(signed32)0x80000000)
-		{
-			return false;
+			stInfoAfter.bIsCall = false;
+			stInfoAfter.sTotalSize = 5;
+			stInfoAfter.bHasImmediate = true;
+			stInfoAfter.sImmOffset = 1;
+			stInfoAfter.sImmSize = 4;
+			return true;
 		}
 
-		if (stInfoBefore.bIsJmp)
+		if (uOpcode == 0xEB || uOpcode == 0xE9)
 		{
 			pInsAfter[0] = 0xE9; // JMP rel32
+			return WriteRel32(pInsAfter, 1, uPosAfter, uTargetAddr, stInfoAfter);
 		}
-		else if (stInfoBefore.bIsCall)
+		else if ((uOpcode & 0xF0) == 0x70 || (bTwoByte && (uOpcode & 0xF0) == 0x80))
 		{
-			pInsAfter[0] = 0xE8; // CALL rel32
+			pInsAfter[0] = 0x0F; // Jcc rel32
+			pInsAfter[1] = 0x80 | (uOpcode & 0x0F);
+			return WriteRel32(pInsAfter, 2, uPosAfter, uTargetAddr, stInfoAfter);
 		}
-		else
+		else if (uOpcode >= 0xE0 && uOpcode <= 0xE3)
+		{
+			// LOOPcc/JECXZ only have rel8: keep the prefixes and branch over a jmp to a JMP rel32
+			// Ex 02; EB 05; E9 rel32
+			memcpy(pInsAfter, pInsBefore, sOpcodeOffset);
+			pInsAfter[sOpcodeOffset] = uOpcode;
+			pInsAfter[sOpcodeOffset + 1] = 0x02;
+			pInsAfter[sOpcodeOffset + 2] = 0xEB;
+			pInsAfter[sOpcodeOffset + 3] = 0x05;
+			pInsAfter[sOpcodeOffset + 4] = 0xE9;
+			return WriteRel32(pInsAfter, sOpcodeOffset + 5, uPosAfter, uTargetAddr, stInfoAfter);
+		}
+
+		return false;
+	}
+
+	bool HSx86Decoder::RipRelativeConvert(const HSInsInfo& stInfo, unsignedP uPosBefore, ptrU8 pInsBefore, unsignedP uPosAfter, ptrU8 pInsAfter)
+	{
+		if (pInsBefore == nullptr || pInsAfter == nullptr || !stInfo.bRipRelative)
 		{
 			return false;
 		}
 
-		*(signed32*)(pInsAfter + 1) = sNewOffset;
-		stInfoAfter.bNeedReloc = true;
-		stInfoAfter.bHasImmediate = true;
-		stInfoAfter.bIsJmp = stInfoBefore.bIsJmp;
-		stInfoAfter.bIsCall = stInfoBefore.bIsCall;
-		stInfoAfter.sTotalSize = 5;
-		stInfoAfter.sRelocOffset = 1;
-		stInfoAfter.sRelocSize = 4;
-		stInfoAfter.sImmOffset = 1;
-		stInfoAfter.sImmSize = 4;
+		// The displacement counts from the end of the instruction, immediates included
+		unsignedP uTarget = uPosBefore + stInfo.sTotalSize + *(signed32*)(pInsBefore + stInfo.sDispOffset);
+		signedP sDisp = (signedP)(uTarget - (uPosAfter + stInfo.sTotalSize));
+
+		if (sDisp != (signed32)sDisp)
+		{
+			return false;
+		}
 
+		memcpy(pInsAfter, pInsBefore, stInfo.sTotalSize);
+		*(signed32*)(pInsAfter + stInfo.sDispOffset) = (signed32)sDisp;
 		return true;
 	}
 }
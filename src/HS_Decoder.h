@@ -1,5 +1,5 @@
 #pragma once
-#if defined(_M_IX86) || defined(__i386__)
+#if defined(_M_IX86) || defined(__i386__) || defined(_M_X64) || defined(__x86_64__)
 
 #include "HS_Type.h"
 
@@ -13,19 +13,21 @@ namespace HSLL
 		bool bIsJmp;          // Whether the instruction is a jump
 		bool bIsRet;          // Whether the instruction is a return
 		bool bIsCall;         // Whether the instruction is a call
+		bool bRipRelative;    // Whether the memory operand is addressed relative to the next instruction (64-bit)
 		signed8 sTotalSize;   // Total size of the instruction in bytes
 		signed8 sRelocOffset; // Offset of the relocation operand from the start of the instruction
 		signed8 sRelocSize;   // Size of the relocation operand in bytes
 		signed8 sImmOffset;   // Offset of the immediate value from the start of the instruction
 		signed8 sImmSize;     // Size of the immediate value in bytes
 		signed8 sModrmOffset; // Offset of the ModR/M byte
+		signed8 sDispOffset;  // Offset of the RIP-relative displacement
 	};
 
 	struct HSOpcodeInfo
 	{
 		unsigned8 uOpcode;    // Opcode
 		unsigned8 uRegOpcode; // Register opcode
-		unsigned8 uFlags;     // Flags
+		unsigned16 uFlags;    // Flags
 		unsigned8 uInsType;   // Instruction type: 0-Normal, 1-Jump, 2-Return, 3-Call
 	};
 
@@ -34,24 +36,43 @@ namespace HSLL
 	public:
 		static bool ParseCode(const ptrAny pIns, HSInsInfo& stInsInfo);
 
-		static bool CallJmpConvert(const HSInsInfo& stInfoBefore, unsigned32 uPosBefore,
-			ptrU8 pInsBefore, HSInsInfo& stInfoAfter, unsigned32 uPosAfter, ptrU8 pInsAfter);
+		/**
+		 * @brief Rewrites a relative branch so it reaches the same target from uPosAfter
+		 * @details JMP and Jcc become their rel32 forms, LOOPcc/JECXZ are chained to a JMP rel32.
+		 *          PC getters (call $+5, __x86.get_pc_thunk.*) are replaced by an instruction that
+		 *          loads the original return address (32-bit only). Writes at most 15 bytes. Fails
+		 *          when the target lies out of rel32 reach of uPosAfter.
+		 */
+		static bool CallJmpConvert(const HSInsInfo& stInfoBefore, unsignedP uPosBefore,
+			ptrU8 pInsBefore, HSInsInfo& stInfoAfter, unsignedP uPosAfter, ptrU8 pInsAfter);
+
+		/**
+		 * @brief Copies an instruction with a RIP-relative operand so it addresses the same memory from uPosAfter
+		 */
+		static bool RipRelativeConvert(const HSInsInfo& stInfo, unsignedP uPosBefore, ptrU8 pInsBefore, unsignedP uPosAfter, ptrU8 pInsAfter);
 
 	private:
+		static bool GetBranchTarget(const HSInsInfo& stInfo, unsignedP uPos, const ptrU8 pIns, unsignedP& uTarget);
+
+		static bool IsPcThunk(unsignedP uTarget, unsigned8& uReg);
+
+		static bool WriteRel32(ptrU8 pIns, signed32 sOffset, unsignedP uPos, unsignedP uTarget, HSInsInfo& stInfo);
 
 		static bool CheckBounds(signed32 uCurrent, signed32 sIncrement, signed32 uMaxLen);
 
-		static signed32 ParsePrefixes(const ptrU8 pCode, signed32& sLen, signed32& sOperandSize);
+		static signed32 ParsePrefixes(const ptrU8 pCode, signed32& sLen, signed32& sOperandSize, signed32& sAddressSize);
+
+		static const HSOpcodeInfo* MatchOpcode(const ptrU8 pCode, signed32& sLen);
 
-		static bool MatchOpcode(const ptrU8 pCode, signed32& sLen, signed32& sOpcodeIndex, signed32 sOperandSize);
+		static const HSOpcodeInfo* MatchVex(const ptrU8 pCode, signed32& sLen);
 
-		static void SetRelocationInfo(HSInsInfo& stInsInfo, const HSOpcodeInfo& stOpcodeInfo, signed32& sLen, signed32 sOperandSize);
+		static void SetRelocationInfo(HSInsInfo& stInsInfo, const HSOpcodeInfo& stOpcodeInfo);
 
 		static void SetInstructionType(HSInsInfo& stInsInfo, const HSOpcodeInfo& stOpcodeInfo);
 
-		static bool ParseModRM(const ptrU8 pCode, signed32& sLen, HSInsInfo& stInsInfo, signed32 sOperandSize);
+		static bool ParseModRM(const ptrU8 pCode, signed32& sLen, HSInsInfo& stInsInfo, signed32 sAddressSize);
 
-		static void ParseImmediate(const HSOpcodeInfo& stOpcodeInfo, signed32& sLen, signed32 sOperandSize, HSInsInfo& pInfo);
+		static bool ParseImmediate(const HSOpcodeInfo& stOpcodeInfo, signed32& sLen, signed32 sOperandSize, signed32 sAddressSize, HSInsInfo& pInfo);
 
 		static void InitializeInsInfo(HSInsInfo& stInsInfo);
 	};
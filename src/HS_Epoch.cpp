@@ -0,0 +1,156 @@
+#include "HS_Epoch.h"
+#include <atomic>
+#include <vector>
+#include <new>
+
+namespace HSLL
+{
+	struct alignas(64) HSEpochThread
+	{
+		std::atomic<unsigned32> uEpoch; // Epoch the thread entered in, 0 while it is outside
+		std::atomic<bool> bUsed;        // Owned by a live thread
+		HSEpochThread* pNext;
+	};
+
+	struct HSEpochLocal
+	{
+		HSEpochThread* pThread;
+		unsigned32 uDepth;
+		bool bExited; // Set once the record is handed back, later sections of this thread fail
+
+		~HSEpochLocal()
+		{
+			if (pThread)
+			{
+				pThread->uEpoch.store(0, std::memory_order_release);
+				pThread->bUsed.store(false, std::memory_order_release);
+			}
+
+			pThread = nullptr;
+			bExited = true;
+		}
+	};
+
+	struct HSRetired
+	{
+		ptrAny pObject;
+		HSReclaimFn pfnFree;
+		unsigned32 uEpoch;
+	};
+
+	static std::atomic<unsigned32> g_uEpoch(1);
+	static std::atomic<HSEpochThread*> g_pThreads(nullptr); // Records are never freed, only reused
+	static thread_local HSEpochLocal g_oLocal = { nullptr, 0, false };
+	static std::vector<HSRetired> g_vecRetired;
+
+	static HSEpochThread* HSAcquireThread()
+	{
+		for (HSEpochThread* pThread = g_pThreads.load(std::memory_order_acquire); pThread; pThread = pThread->pNext)
+		{
+			bool bUsed = false;
+
+			if (!pThread->bUsed.load(std::memory_order_relaxed)
+				&& pThread->bUsed.compare_exchange_strong(bUsed, true, std::memory_order_acquire, std::memory_order_relaxed))
+			{
+				return pThread;
+			}
+		}
+
+		HSEpochThread* pThread = new (std::nothrow) HSEpochThread();
+
+		if (pThread == nullptr)
+		{
+			return nullptr;
+		}
+
+		pThread->uEpoch.store(0, std::memory_order_relaxed);
+		pThread->bUsed.store(true, std::memory_order_relaxed);
+		pThread->pNext = g_pThreads.load(std::memory_order_relaxed);
+
+		while (!g_pThreads.compare_exchange_weak(pThread->pNext, pThread, std::memory_order_release, std::memory_order_relaxed))
+		{
+		}
+
+		return pThread;
+	}
+
+	bool HSEpochManager::Enter()
+	{
+		HSEpochLocal& stLocal = g_oLocal;
+
+		if (stLocal.uDepth++ > 0)
+		{
+			return true;
+		}
+
+		if (stLocal.pThread == nullptr)
+		{
+			stLocal.pThread = stLocal.bExited ? nullptr : HSAcquireThread();
+
+			if (stLocal.pThread == nullptr)
+			{
+				stLocal.uDepth--;
+				return false;
+			}
+		}
+
+		// Acquire pairs with Retire: from a later epoch on the unpublishing store is visible. The
+		// announcement itself has to be visible before any shared pointer is read.
+		stLocal.pThread->uEpoch.store(g_uEpoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		return true;
+	}
+
+	void HSEpochManager::Leave()
+	{
+		HSEpochLocal& stLocal = g_oLocal;
+
+		if (--stLocal.uDepth == 0)
+		{
+			stLocal.pThread->uEpoch.store(0, std::memory_order_release);
+		}
+	}
+
+	void HSEpochManager::Retire(ptrAny pObject, HSReclaimFn pfnFree)
+	{
+		// The object is already unpublished, a reader entering from the next epoch on cannot find it
+		g_vecRetired.push_back(HSRetired{ pObject, pfnFree, g_uEpoch.fetch_add(1, std::memory_order_seq_cst) });
+	}
+
+	void HSEpochManager::Reclaim()
+	{
+		if (g_vecRetired.empty())
+		{
+			return;
+		}
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		unsigned32 uOldest = g_uEpoch.load(std::memory_order_relaxed);
+
+		for (HSEpochThread* pThread = g_pThreads.load(std::memory_order_acquire); pThread; pThread = pThread->pNext)
+		{
+			unsigned32 uEpoch = pThread->uEpoch.load(std::memory_order_acquire);
+
+			if (uEpoch && uEpoch < uOldest)
+			{
+				uOldest = uEpoch;
+			}
+		}
+
+		unsigned32 uKeep = 0;
+
+		for (const HSRetired& stRetired : g_vecRetired)
+		{
+			if (stRetired.uEpoch < uOldest)
+			{
+				stRetired.pfnFree(stRetired.pObject);
+			}
+			else
+			{
+				g_vecRetired[uKeep++] = stRetired;
+			}
+		}
+
+		g_vecRetired.resize(uKeep);
+	}
+}
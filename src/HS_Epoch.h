@@ -0,0 +1,68 @@
+#pragma once
+#include "HS_Type.h"
+
+namespace HSLL
+{
+	using HSReclaimFn = void(*)(ptrAny pObject);
+
+	/**
+	 * @brief Epoch-based deferred reclamation for data that readers use without a lock
+	 * @details A reader marks its thread active in the current global epoch for the span of
+	 *          a lookup, a single store to its own cache line. Writers unpublish an object,
+	 *          retire it with the epoch of the moment and advance the epoch. Reclaim frees an
+	 *          object once every thread that is still active entered a later epoch, since such
+	 *          threads started after the object was unpublished. Thread records are allocated
+	 *          on first use, handed back when the thread exits and reused by later threads.
+	 *          Retire and Reclaim are not thread-safe, the caller serializes them.
+	 */
+	class HSEpochManager
+	{
+	public:
+		/**
+		 * @brief Marks the calling thread active, sections nest
+		 * @return false if no thread record could be set up, the caller has to fall back to a lock
+		 */
+		static bool Enter();
+
+		static void Leave();
+
+		static void Retire(ptrAny pObject, HSReclaimFn pfnFree);
+
+		/**
+		 * @brief Frees every retired object whose grace period is over
+		 */
+		static void Reclaim();
+	};
+
+	/**
+	 * @brief Epoch section for the lifetime of the guard
+	 * @details Wrapping a call through HSHook::Original, a handle or a Static<> slot in a guard
+	 *          also keeps the trampoline and relay alive until the call returns, even if the hook
+	 *          is removed meanwhile. A call that can race Remove needs one, outside a guard a
+	 *          removed trampoline may be freed under the caller.
+	 */
+	class HSEpochGuard
+	{
+	public:
+		HSEpochGuard() : m_bActive(HSEpochManager::Enter()) {}
+
+		~HSEpochGuard()
+		{
+			if (m_bActive)
+			{
+				HSEpochManager::Leave();
+			}
+		}
+
+		bool IsActive() const
+		{
+			return m_bActive;
+		}
+
+		HSEpochGuard(const HSEpochGuard&) = delete;
+		HSEpochGuard& operator=(const HSEpochGuard&) = delete;
+
+	private:
+		bool m_bActive;
+	};
+}
@@ -0,0 +1,272 @@
+#include "HS_Filter.h"
+#if defined(_M_IX86) || defined(__i386__)
+
+#include <string.h>
+
+namespace HSLL
+{
+	static_assert(sizeof(((HSFilterData*)nullptr)->pCounters) / sizeof(unsigned32) == HSFilterManager::HS_FILTER_MAX_NUM,
+		"HSFilterData needs one counter per filter");
+
+	HSFilter HSFilter::Caller(ptrAny pModule)
+	{
+		HSFilter stFilter = { HSFilterType_Caller, 0, 0, 0 };
+
+		if (!HSFilterManager::GetModuleRange(pModule, stFilter.uMin, stFilter.uMax))
+		{
+			stFilter.uMin = stFilter.uMax = 0;
+		}
+
+		return stFilter;
+	}
+
+	static ptrU8 HSEmit(ptrU8 pCode, const unsigned8* pBytes, unsigned32 uSize)
+	{
+		memcpy(pCode, pBytes, uSize);
+		return pCode + uSize;
+	}
+
+	static ptrU8 HSEmit32(ptrU8 pCode, unsigned32 uValue)
+	{
+		*(ptrU32)pCode = uValue;
+		return pCode + 4;
+	}
+
+	unsigned32 HSFilterManager::Emit(const HSFilter* pFilters, unsigned32 uNum, ptrU8 pCode, HSFilterData* pData)
+	{
+		ptrU8 pFixups[HS_FILTER_MAX_NUM]; // rel32 of each jump to the reject path
+		unsigned32 uFixupNum = 0;
+		ptrU8 pCur = pCode;
+
+		if (uNum == 0 || uNum > HS_FILTER_MAX_NUM)
+		{
+			return 0;
+		}
+
+		static const unsigned8 pSave[] = { 0x50, 0x52 }; // push eax, push edx
+		pCur = HSEmit(pCur, pSave, sizeof(pSave));
+
+		for (unsigned32 i = 0; i < uNum; i++)
+		{
+			const HSFilter& stFilter = pFilters[i];
+
+			switch (stFilter.eType)
+			{
+			case HSFilterType_EveryNth:
+			{
+				if (stFilter.uArg == 0)
+				{
+					return 0;
+				}
+
+				// dec dword ptr [counter], jnz reject, mov dword ptr [counter], N
+				pData->pCounters[i] = stFilter.uArg;
+				static const unsigned8 pDec[] = { 0xFF, 0x0D };
+				static const unsigned8 pJnz[] = { 0x0F, 0x85 };
+				static const unsigned8 pMov[] = { 0xC7, 0x05 };
+				pCur = HSEmit32(HSEmit(pCur, pDec, sizeof(pDec)), (unsigned32)&pData->pCounters[i]);
+				pCur = HSEmit(pCur, pJnz, sizeof(pJnz));
+				pFixups[uFixupNum++] = pCur;
+				pCur = HSEmit32(HSEmit(pCur + 4, pMov, sizeof(pMov)), (unsigned32)&pData->pCounters[i]);
+				pCur = HSEmit32(pCur, stFilter.uArg);
+				break;
+			}
+			case HSFilterType_Sample:
+			{
+				unsigned8 uSegment;
+				unsigned32 uOffset;
+
+				if (stFilter.uArg == 0 || !GetSampleSlot(uSegment, uOffset))
+				{
+					return 0;
+				}
+
+				// mov eax, seg:[state], a thread's first draw seeds from its stack pointer
+				pCur[0] = uSegment;
+				pCur[1] = 0xA1;
+				pCur = HSEmit32(pCur + 2, uOffset);
+
+				// test eax,eax, jnz +2, mov eax,esp, then xorshift32 through edx: 13, 17, 5
+				static const unsigned8 pStep[] = { 0x85, 0xC0, 0x75, 0x02, 0x89, 0xE0,
+					0x89, 0xC2, 0xC1, 0xE2, 0x0D, 0x31, 0xD0,
+					0x89, 0xC2, 0xC1, 0xEA, 0x11, 0x31, 0xD0,
+					0x89, 0xC2, 0xC1, 0xE2, 0x05, 0x31, 0xD0 };
+				pCur = HSEmit(pCur, pStep, sizeof(pStep));
+
+				// mov seg:[state], eax, cmp eax, 2^32/N, jae reject
+				pCur[0] = uSegment;
+				pCur[1] = 0xA3;
+				pCur = HSEmit32(pCur + 2, uOffset);
+				pCur[0] = 0x3D;
+				pCur = HSEmit32(pCur + 1, stFilter.uArg == 1 ? 0xFFFFFFFF : 0xFFFFFFFF / stFilter.uArg);
+				pCur[0] = 0x0F;
+				pCur[1] = 0x83;
+				pFixups[uFixupNum++] = pCur + 2;
+				pCur += 6;
+				break;
+			}
+			case HSFilterType_ArgRange:
+			case HSFilterType_Caller:
+			{
+				if (stFilter.uMin > stFilter.uMax || (stFilter.eType == HSFilterType_Caller && stFilter.uMin == stFilter.uMax)
+					|| (stFilter.eType == HSFilterType_ArgRange && stFilter.uArg >= HS_FILTER_MAX_ARG))
+				{
+					return 0;
+				}
+
+				// mov eax, [esp + disp32], past the two saved registers: return address at 8, arguments from 12
+				pCur[0] = 0x8B;
+				pCur[1] = 0x84;
+				pCur[2] = 0x24;
+				pCur = HSEmit32(pCur + 3, stFilter.eType == HSFilterType_Caller ? 8 : 12 + stFilter.uArg * 4);
+
+				// sub eax, min, cmp eax, max - min, ja reject: one unsigned compare covers both bounds
+				unsigned32 uSpan = (unsigned32)(stFilter.uMax - stFilter.uMin) - (stFilter.eType == HSFilterType_Caller ? 1 : 0);
+				pCur[0] = 0x2D;
+				pCur = HSEmit32(pCur + 1, (unsigned32)stFilter.uMin);
+				pCur[0] = 0x3D;
+				pCur = HSEmit32(pCur + 1, uSpan);
+				pCur[0] = 0x0F;
+				pCur[1] = 0x87;
+				pFixups[uFixupNum++] = pCur + 2;
+				pCur += 6;
+				break;
+			}
+			default:
+				return 0;
+			}
+		}
+
+		// pop edx, pop eax, jmp dword ptr [pNext]; reject: pop edx, pop eax, jmp dword ptr [pFail]
+		static const unsigned8 pLeave[] = { 0x5A, 0x58, 0xFF, 0x25 };
+		pCur = HSEmit32(HSEmit(pCur, pLeave, sizeof(pLeave)), (unsigned32)&pData->pNext);
+
+		for (unsigned32 i = 0; i < uFixupNum; i++)
+		{
+			*(ptrS32)pFixups[i] = (signed32)(pCur - pFixups[i] - 4);
+		}
+
+		pCur = HSEmit32(HSEmit(pCur, pLeave, sizeof(pLeave)), (unsigned32)&pData->pFail);
+		return (unsigned32)(pCur - pCode);
+	}
+}
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+namespace HSLL
+{
+	bool HSFilterManager::GetSampleSlot(unsigned8& uSegment, unsigned32& uOffset)
+	{
+		static DWORD uIndex = TlsAlloc();
+
+		// Only the 64 slots inside the TEB are reachable with a single fs: access
+		if (uIndex == TLS_OUT_OF_INDEXES || uIndex >= 64)
+		{
+			return false;
+		}
+
+		uSegment = 0x64;
+		uOffset = 0xE10 + uIndex * 4;
+		return true;
+	}
+
+	bool HSFilterManager::GetModuleRange(ptrAny pAddr, unsignedP& uStart, unsignedP& uEnd)
+	{
+		HMODULE hModule;
+
+		if (!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+			(LPCSTR)pAddr, &hModule))
+		{
+			return false;
+		}
+
+		PIMAGE_DOS_HEADER pDos = (PIMAGE_DOS_HEADER)hModule;
+		PIMAGE_NT_HEADERS pNt = (PIMAGE_NT_HEADERS)((ptrU8)hModule + pDos->e_lfanew);
+		uStart = (unsignedP)hModule;
+		uEnd = uStart + pNt->OptionalHeader.SizeOfImage;
+		return true;
+	}
+}
+#elif defined(__unix__)
+#include <link.h>
+
+namespace HSLL
+{
+#if defined(__linux__)
+	static __thread unsigned32 g_uSampleState __attribute__((tls_model("initial-exec"))) = 0;
+#endif
+
+	bool HSFilterManager::GetSampleSlot(unsigned8& uSegment, unsigned32& uOffset)
+	{
+#if defined(__linux__)
+		// Static TLS sits at the same offset from every thread's pointer, which %gs:0 holds
+		unsignedP uThread;
+		__asm__ __volatile__("movl %%gs:0, %0" : "=r"(uThread));
+		uSegment = 0x65;
+		uOffset = (unsigned32)((unsignedP)&g_uSampleState - uThread);
+		return true;
+#else
+		(void)uSegment;
+		(void)uOffset;
+		return false;
+#endif
+	}
+
+	struct HSModuleQuery
+	{
+		unsignedP uAddr;
+		unsignedP uStart;
+		unsignedP uEnd;
+	};
+
+	static signed32 HSFindModule(dl_phdr_info* pInfo, size_t, ptrAny pParam)
+	{
+		HSModuleQuery* pQuery = (HSModuleQuery*)pParam;
+		unsignedP uStart = ~(unsignedP)0;
+		unsignedP uEnd = 0;
+		bool bFound = false;
+
+		for (unsigned32 i = 0; i < pInfo->dlpi_phnum; i++)
+		{
+			const ElfW(Phdr)& stPhdr = pInfo->dlpi_phdr[i];
+
+			if (stPhdr.p_type != PT_LOAD)
+			{
+				continue;
+			}
+
+			unsignedP uSegStart = pInfo->dlpi_addr + stPhdr.p_vaddr;
+			unsignedP uSegEnd = uSegStart + stPhdr.p_memsz;
+			uStart = uSegStart < uStart ? uSegStart : uStart;
+			uEnd = uSegEnd > uEnd ? uSegEnd : uEnd;
+			bFound |= pQuery->uAddr >= uSegStart && pQuery->uAddr < uSegEnd;
+		}
+
+		if (!bFound)
+		{
+			return 0;
+		}
+
+		pQuery->uStart = uStart;
+		pQuery->uEnd = uEnd;
+		return 1;
+	}
+
+	bool HSFilterManager::GetModuleRange(ptrAny pAddr, unsignedP& uStart, unsignedP& uEnd)
+	{
+		HSModuleQuery stQuery = { (unsignedP)pAddr, 0, 0 };
+
+		if (dl_iterate_phdr(HSFindModule, &stQuery) == 0)
+		{
+			return false;
+		}
+
+		uStart = stQuery.uStart;
+		uEnd = stQuery.uEnd;
+		return true;
+	}
+}
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+#if defined(_M_IX86) || defined(__i386__)
+
+#include "HS_Type.h"
+
+namespace HSLL
+{
+	enum HSFilterType
+	{
+		HSFilterType_EveryNth = 0, // Passes every uArg-th call of the target, counted across all threads without locking
+		HSFilterType_Sample = 1,   // Passes a call with probability 1/uArg from a per-thread xorshift state
+		HSFilterType_ArgRange = 2, // Passes when stack argument uArg lies in [uMin, uMax], compared unsigned
+		HSFilterType_Caller = 3    // Passes when the return address lies in [uMin, uMax)
+	};
+
+	struct HSFilter
+	{
+		HSFilterType eType;
+		unsigned32 uArg; // N for EveryNth and Sample, 0-based stack argument index for ArgRange
+		unsignedP uMin;
+		unsignedP uMax;
+
+		static HSFilter EveryNth(unsigned32 uNum)
+		{
+			return HSFilter{ HSFilterType_EveryNth, uNum, 0, 0 };
+		}
+
+		static HSFilter Sample(unsigned32 uOneIn)
+		{
+			return HSFilter{ HSFilterType_Sample, uOneIn, 0, 0 };
+		}
+
+		static HSFilter ArgRange(unsigned32 uIndex, unsignedP uMin, unsignedP uMax)
+		{
+			return HSFilter{ HSFilterType_ArgRange, uIndex, uMin, uMax };
+		}
+
+		/**
+		 * @brief Passes calls coming from the module that contains pModule
+		 * @details The module bounds are looked up once here, an unknown address gives an
+		 *          empty range that SetFilter rejects.
+		 */
+		static HSFilter Caller(ptrAny pModule);
+	};
+
+	/**
+	 * @brief Cells a filter stub reads and writes, kept out of the code pages
+	 */
+	struct alignas(64) HSFilterData
+	{
+		ptrAny pNext; // Where a passing call continues, the stats stub or the chain head
+		ptrAny pFail; // Where a rejected call continues, the trampoline
+		unsigned32 pCounters[8];
+	};
+
+	/**
+	 * @brief Generates pre-dispatch stubs that decide in a few instructions whether a call
+	 *        reaches the detours
+	 * @details The stub saves eax and edx, runs the filters in order and jumps through
+	 *          pNext when all of them pass or through pFail as soon as one rejects. Register
+	 *          arguments and the stack are left exactly as the caller set them up.
+	 */
+	class HSFilterManager
+	{
+	public:
+		static constexpr unsigned32 HS_FILTER_MAX_NUM = 8;
+		static constexpr unsigned32 HS_FILTER_MAX_CODE_SIZE = 512;
+		static constexpr unsigned32 HS_FILTER_MAX_ARG = 64;
+
+		/**
+		 * @brief Writes the stub for pFilters at pCode, which is also where it will run
+		 * @return Size of the stub, 0 if a filter is invalid or unsupported on this platform
+		 */
+		static unsigned32 Emit(const HSFilter* pFilters, unsigned32 uNum, ptrU8 pCode, HSFilterData* pData);
+
+		static bool GetModuleRange(ptrAny pAddr, unsignedP& uStart, unsignedP& uEnd);
+
+	private:
+		static bool GetSampleSlot(unsigned8& uSegment, unsigned32& uOffset);
+	};
+}
+
+#endif
@@ -1,28 +1,334 @@
 #include "HS_Hook.h"
-#if defined(_M_IX86) || defined(__i386__)
+#if defined(_M_IX86) || defined(__i386__) || defined(_M_X64) || defined(__x86_64__)
 
 #include "HS_Decoder.h"
+#include "HS_Analyzer.h"
 #include "HS_Context.h"
 #include "HS_RWLock.hpp"
+#include "HS_Prot.h"
+#include "HS_Patch.h"
+#include "HS_Stats.h"
+#include "HS_Filter.h"
+#include "HS_Shadow.h"
+#include "HS_Epoch.h"
+#include "HS_Import.h"
+#include "HS_Symbol.h"
 #include <string.h>
+#include <atomic>
+#include <algorithm>
+#include <new>
 
 namespace HSLL
 {
+	constexpr unsigned32 HS_MAX_FIXED_SIZE = 128;
+	constexpr unsigned32 HS_MAX_BACKUP_INS = 16;
+
+	constexpr unsigned32 HS_PADDING_SIZE = 5;
+	constexpr unsigned32 HS_JMP_SIZE = 5;      // JMP rel32
+	constexpr unsigned32 HS_ABS_JMP_SIZE = 14; // JMP qword ptr [rip], then the 64-bit target
+
+#if defined(_M_X64) || defined(__x86_64__)
+	constexpr unsigned32 HS_MAX_JMP_SIZE = HS_ABS_JMP_SIZE;
+#else
+	constexpr unsigned32 HS_MAX_JMP_SIZE = HS_JMP_SIZE;
+#endif
+
+	struct HSInsMap
+	{
+		unsigned8 uNum;                          // Number of relocated instructions, 0 without trampoline code
+		bool bHasCall;                           // Relocated code calls out, so a return address may point into it
+		unsigned8 uStolen;                       // Number of stolen bytes, relocated or skipped
+		unsigned8 pIns[HS_MAX_BACKUP_INS + 1];   // Offset of each stolen instruction, then the stolen size
+		unsigned8 pFixed[HS_MAX_BACKUP_INS + 1]; // Offset of each relocated instruction, then the jump back
+	};
+
+	struct HSHookLink
+	{
+		ptrAny pDst;       // Replacement function
+		ptrAny* pSlot;     // Receives the next link, the trampoline for the last one
+		signed32 sPriority;
+	};
+
 	struct HSStaticContext
 	{
-		ptrAny pMem;
-		ptrAny pCover;
-		unsigned32 uSize;
+		ptrAny pMem;      // Trampoline block owned by the pool
+		ptrAny pOriginal; // Entry that runs the original function
+		ptrU8 pPatch;     // First patched byte, before the entry in padding mode
+		ptrAny pCover;    // Backup of the patched bytes
+		unsigned32 uSize; // Number of patched bytes
+		unsigned32 uJmpSize; // Size of the jump at pPatch, HS_ABS_JMP_SIZE when no memory near the target was found
+		ptrAny pRelay;    // Absolute jump near the target that the entry jump goes through, null while the head is in rel32 reach
+		HSInsMap stMap;   // Lets a stopped thread move between the target and the trampoline
+		std::vector<HSHookLink> vecLinks; // Dispatch chain, highest priority first, the entry jump goes to the head
+		ptrAny pGroup;    // Owning hook group, null for ordinary hooks
+		bool bEnabled;    // The patch is written, a disabled group hook keeps its trampoline resident
+		unsigned8 pPatchCode[HS_MAX_JMP_SIZE + 2]; // Bytes written at pPatch when enabled
+#if defined(HS_HAS_STUBS)
+		unsigned32 uStatsId; // Instrumentation stub kept pointing at the chain head, HS_STATS_INVALID without one
+		bool bStats;         // The entry jump goes through the instrumentation stub
+		HSFilterData* pFilter; // Cells of the filter stub, null without one
+		ptrAny pFilterStub;    // Runs before the instrumentation stub and the chain
+#endif
+	};
+
+	struct HSHookPlan
+	{
+		ptrAny pSrc;
+		ptrAny pDst;
+		ptrAny* pSlot;
+		signed32 sPriority;
+		ptrAny pGroup;
+		ptrU8 pMem;
+		ptrAny pOriginal;
+		ptrU8 pPatch;
+		unsigned32 uPatchSize;
+		unsigned32 uJmpSize;
+		ptrAny pRelay;
+		unsigned32 uNum;
+		unsigned32 uCodeSize; // Relocated code plus the jump back, 0 when the stolen bytes are NOPs
+		unsigned32 uFixedSize;
+		unsigned32 uBackUpSize;
+		HSInsInfo pBackupInfo[HS_MAX_BACKUP_INS];
+		unsigned8 pPatchCode[HS_MAX_JMP_SIZE + 2];
+		HSInsMap stMap;
+	};
+
+	struct HSLinkOp
+	{
+		ptrAny pSrc;
+		HSStaticContext* pContext;
+		std::vector<HSHookLink> vecLinks; // Chain after the operation
+		ptrAny* pUnlinked;                // Slot of a removed link, reset to the target afterwards
+		bool bNewHead;                    // The entry jump has to be re-pointed
+		ptrAny pRelay;                    // Relay the new entry jump goes through, replaces the context's one
+		unsigned8 pJmpCode[HS_MAX_JMP_SIZE];
+	};
+
+#if defined(HS_HAS_STUBS)
+	struct HSExitRecord
+	{
+		HSShadowOwner stOwner;            // First, the shadow stack hands it back to HSExitLeave
+		ptrAny pSrc;
+		ptrAny pStub;
+		std::atomic<unsigned64> uCallback; // Callback in the low half and user pointer in the high half, swapped as one
+	};
+#endif
+
+	struct HSCellContext
+	{
+		ptrAny pDst;                   // Replacement every cell points at
+		ptrAny* pSlot;                 // Handle cell, set back to the target on removal, may be null
+		std::vector<ptrAny*> vecCells; // Pointer cells the calls go through, GOT entries for imports
+		std::vector<ptrAny> vecSaved;  // What each cell held before, written back on removal
+	};
+
+	struct HSVtableCopy
+	{
+		ptrAny* pVtable; // Shared vtable the object pointed at, address point
+		ptrAny* pMem;    // Private copy, RTTI prefix included
+		unsigned32 uNum; // Function entries copied after the address point
+	};
+
+#if defined(_MSC_VER)
+	constexpr unsigned32 HS_VTABLE_PREFIX = 1; // Complete object locator
+#else
+	constexpr unsigned32 HS_VTABLE_PREFIX = 2; // Offset to top and typeinfo
+#endif
+
+	struct HSSnapshotEntry
+	{
+		ptrAny pSrc;      // Null marks an empty slot
+		ptrAny pOriginal;
 	};
 
-	struct HSRuntimeContext
+	/**
+	 * @brief Immutable copy of the hook table that Original reads without the lock
+	 */
+	struct HSHookSnapshot
 	{
-		ptrAny pRet;
+		unsigned32 uMask;
+		unsigned32 uShift;
+		HSSnapshotEntry* pEntries;
 	};
 
 	static HSSpinRWLock g_oHookLock;
+	static HSTrampolinePool g_oTrampolinePool;
+	static HSProtManager g_oProtManager;
 	static HSContextManager<HSStaticContext> g_oStaticManager;
-	thread_local HSContextManager<HSRuntimeContext> g_oRuntimeManager;
+	static HSContextManager<HSCellContext> g_oCellManager;
+	static HSContextManager<HSVtableCopy> g_oVtableManager;
+	static HSPatchMode g_ePatchMode = HSPatchMode_Direct;
+
+	static void HSStoreCell(ptrAny* pCell, ptrAny pValue)
+	{
+		// One aligned store, a thread in a stub jumps either to the old or the new target
+		*(ptrAny volatile*)pCell = pValue;
+	}
+
+	static std::atomic<HSHookSnapshot*> g_pSnapshot(nullptr);
+
+	static unsigned32 HSSnapshotHash(ptrAny pSrc, unsigned32 uShift)
+	{
+		return ((unsigned32)(unsignedP)pSrc * 2654435761u) >> (32 - uShift);
+	}
+
+	static ptrAny HSSnapshotFind(const HSHookSnapshot* pSnapshot, ptrAny pSrc)
+	{
+		if (pSnapshot == nullptr || pSrc == nullptr)
+		{
+			return nullptr;
+		}
+
+		for (unsigned32 uPos = HSSnapshotHash(pSrc, pSnapshot->uShift); pSnapshot->pEntries[uPos].pSrc; uPos = (uPos + 1) & pSnapshot->uMask)
+		{
+			if (pSnapshot->pEntries[uPos].pSrc == pSrc)
+			{
+				return pSnapshot->pEntries[uPos].pOriginal;
+			}
+		}
+
+		return nullptr;
+	}
+
+	static HSHookSnapshot* HSAllocSnapshot(unsigned32 uNum)
+	{
+		unsigned32 uShift = 4;
+
+		// At most half full, a miss stops at the first empty slot
+		while ((1u << uShift) < uNum * 2)
+		{
+			uShift++;
+		}
+
+		HSHookSnapshot* pSnapshot = new (std::nothrow) HSHookSnapshot{ (1u << uShift) - 1, uShift, nullptr };
+
+		if (pSnapshot == nullptr)
+		{
+			return nullptr;
+		}
+
+		pSnapshot->pEntries = new (std::nothrow) HSSnapshotEntry[1u << uShift]();
+
+		if (pSnapshot->pEntries == nullptr)
+		{
+			delete pSnapshot;
+			return nullptr;
+		}
+
+		return pSnapshot;
+	}
+
+	static void HSFreeSnapshot(ptrAny pObject)
+	{
+		HSHookSnapshot* pSnapshot = (HSHookSnapshot*)pObject;
+		delete[] pSnapshot->pEntries;
+		delete pSnapshot;
+	}
+
+	static void HSFreeTrampoline(ptrAny pMem)
+	{
+		g_oTrampolinePool.Free(pMem);
+	}
+
+	static void HSFreeVtableCopy(ptrAny pMem)
+	{
+		delete[] (ptrAny*)pMem;
+	}
+
+	static void HSSnapshotInsert(HSHookSnapshot* pSnapshot, ptrAny pSrc, ptrAny pOriginal)
+	{
+		unsigned32 uPos = HSSnapshotHash(pSrc, pSnapshot->uShift);
+
+		while (pSnapshot->pEntries[uPos].pSrc)
+		{
+			uPos = (uPos + 1) & pSnapshot->uMask;
+		}
+
+		pSnapshot->pEntries[uPos] = HSSnapshotEntry{ pSrc, pOriginal };
+	}
+
+	/**
+	 * @brief Adds every stored hook to pSnapshot, which may already hold extra entries, and publishes it
+	 */
+	static void HSPublishSnapshot(HSHookSnapshot* pSnapshot)
+	{
+		g_oStaticManager.ForEach([pSnapshot](unsignedP uKey, const HSStaticContext& stContext)
+			{
+				HSSnapshotInsert(pSnapshot, (ptrAny)uKey, stContext.pOriginal);
+			});
+
+		// The code of a cell hook's target is untouched, calling it is calling the original
+		g_oCellManager.ForEach([pSnapshot](unsignedP uKey, const HSCellContext&)
+			{
+				HSSnapshotInsert(pSnapshot, (ptrAny)uKey, (ptrAny)uKey);
+			});
+
+		HSHookSnapshot* pOld = g_pSnapshot.load(std::memory_order_relaxed);
+		g_pSnapshot.store(pSnapshot, std::memory_order_release);
+
+		if (pOld)
+		{
+			HSEpochManager::Retire(pOld, &HSFreeSnapshot);
+		}
+	}
+
+#if defined(HS_HAS_STUBS)
+	constexpr unsigned32 HS_EXIT_MAX_HOOKS = 64;
+	constexpr signed32 HS_EXIT_PRIORITY = 0x7FFFFFFF; // First link of the chain, the exit stub times every detour
+
+	static HSExitRecord g_aExitRecords[HS_EXIT_MAX_HOOKS];
+	static unsigned32 g_uExitNum = 0;
+	static bool g_bUnwindersHooked = false;
+
+	static void HSExitLeave(HSShadowOwner& stOwner, const HSShadowFrame& stFrame, HSShadowRegs& stRegs, unsigned64 uCycles)
+	{
+		HSExitRecord& stRecord = (HSExitRecord&)stOwner;
+		unsigned64 uCallback = stRecord.uCallback.load(std::memory_order_acquire);
+		HSExitCallback pfnExit = (HSExitCallback)(unsignedP)uCallback;
+
+		// Cleared while the call was running
+		if (pfnExit == nullptr)
+		{
+			return;
+		}
+
+		HSExitInfo stInfo = { stRecord.pSrc, stFrame.pRet, stRegs.uEax, stRegs.uEdx, uCycles };
+		pfnExit(stInfo, (ptrAny)(unsignedP)(uCallback >> 32));
+		stRegs.uEax = stInfo.uEax;
+		stRegs.uEdx = stInfo.uEdx;
+	}
+
+	static HSExitRecord* HSFindExitRecord(ptrAny pSrc)
+	{
+		for (unsigned32 i = 0; i < g_uExitNum; i++)
+		{
+			if (g_aExitRecords[i].pSrc == pSrc)
+			{
+				return &g_aExitRecords[i];
+			}
+		}
+
+		return nullptr;
+	}
+
+	static ptrU8 HSAllocShadowStub()
+	{
+		// The exit thunk is shared by every stub and never freed
+		if (!HSShadowStack::IsReady())
+		{
+			ptrU8 pThunk = (ptrU8)g_oTrampolinePool.Alloc(HSShadowStack::HS_SHADOW_STUB_SIZE);
+
+			if (pThunk == nullptr)
+			{
+				return nullptr;
+			}
+
+			HSShadowStack::Init(pThunk);
+		}
+
+		return (ptrU8)g_oTrampolinePool.Alloc(HSShadowStack::HS_SHADOW_STUB_SIZE);
+	}
+#endif
 
 	unsigned32 HSHook::GetInsSize(HSInsInfo* pInfo, unsigned32 uNum)
 	{
@@ -36,13 +342,13 @@ namespace HSLL
 		return uSize;
 	}
 
-	bool HSHook::GetBackupIns(ptrAny pIns, HSInsInfo* pInfo, unsigned32& uNum)
+	bool HSHook::GetBackupIns(ptrAny pIns, HSInsInfo* pInfo, unsigned32& uNum, unsigned32 uMinSize)
 	{
 		uNum = 0;
 		unsigned32 uNowSize = 0;
 		ptrU8 pInsPtr = (ptrU8)pIns;
 
-		while (true)
+		while (uNum < HS_MAX_BACKUP_INS)
 		{
 			if (!HSLL::HSx86Decoder::ParseCode(pInsPtr, pInfo[uNum]))
 			{
@@ -53,7 +359,7 @@ namespace HSLL
 			uNowSize += pInfo[uNum].sTotalSize;
 			uNum++;
 
-			if (uNowSize >= 5)
+			if (uNowSize >= uMinSize)
 			{
 				return true;
 			}
@@ -63,19 +369,32 @@ namespace HSLL
 				return false;
 			}
 		}
+
+		return false;
 	}
 
 	bool HSHook::GetFixedIns(ptrAny pIns, HSInsInfo* pInfo, unsigned32 uNum,
-		ptrAny pFixedIns, HSInsInfo* pFixedInfo)
+		ptrAny pFixedIns, ptrAny pFixedPos, HSInsInfo* pFixedInfo)
 	{
 		ptrU8 pInsPtr = (ptrU8)pIns;
 		ptrU8 pFixedPtr = (ptrU8)pFixedIns;
+		ptrU8 pFixedPosPtr = (ptrU8)pFixedPos;
 
 		for (unsigned32 i = 0; i < uNum; i++)
 		{
-			if (pInfo[i].bIsJmp || pInfo[i].bIsCall)
+			// Indirect jumps and calls carry no relative operand and are copied as they are
+			if (pInfo[i].bNeedReloc)
+			{
+				if (!HSx86Decoder::CallJmpConvert(pInfo[i], (unsignedP)pInsPtr, pInsPtr, pFixedInfo[i], (unsignedP)pFixedPosPtr, pFixedPtr))
+				{
+					return false;
+				}
+			}
+			else if (pInfo[i].bRipRelative)
 			{
-				if (!HSx86Decoder::CallJmpConvert(pInfo[i], (unsignedP)pInsPtr, pInsPtr, pFixedInfo[i], (unsignedP)pFixedPtr, pFixedPtr))
+				pFixedInfo[i] = pInfo[i];
+
+				if (!HSx86Decoder::RipRelativeConvert(pInfo[i], (unsignedP)pInsPtr, pInsPtr, (unsignedP)pFixedPosPtr, pFixedPtr))
 				{
 					return false;
 				}
@@ -88,32 +407,46 @@ namespace HSLL
 
 			pInsPtr += pInfo[i].sTotalSize;
 			pFixedPtr += pFixedInfo[i].sTotalSize;
+			pFixedPosPtr += pFixedInfo[i].sTotalSize;
 		}
 
 		return true;
 	}
 
-	bool HSHook::IsHookFull()
+	bool HSHook::ReserveHooks(unsigned32 uNum)
 	{
-		return g_oStaticManager.IsFull();
+		return g_oStaticManager.Reserve(uNum);
 	}
 
-	void HSHook::StoreHook(ptrAny pSrc, ptrAny pMem, ptrAny pBackup, unsigned32 uSize)
+	void HSHook::StoreHook(const HSHookPlan& stPlan)
 	{
-		g_oStaticManager.SetContext((unsignedP)pSrc, HSStaticContext{ pMem, pBackup, uSize });
+		HSStaticContext* pContext = g_oStaticManager.SetContext((unsignedP)stPlan.pSrc, HSStaticContext{ stPlan.pMem,
+			stPlan.pOriginal, stPlan.pPatch, stPlan.pMem + stPlan.uCodeSize, stPlan.uPatchSize, stPlan.uJmpSize,
+			stPlan.pRelay, stPlan.stMap, std::vector<HSHookLink>{ HSHookLink{ stPlan.pDst, stPlan.pSlot, stPlan.sPriority } },
+			stPlan.pGroup, stPlan.pGroup == nullptr, {}
+#if defined(HS_HAS_STUBS)
+			, HSStatsManager::HS_STATS_INVALID, false, nullptr, nullptr
+#endif
+			});
+
+		memcpy(pContext->pPatchCode, stPlan.pPatchCode, sizeof(stPlan.pPatchCode));
 	}
 
 	ptrAny HSHook::FindHookSrc(ptrAny pSrc)
 	{
-		HSReadLockGuard oLock(g_oHookLock);
-		HSStaticContext* pContext = FindHook(pSrc);
+		HSEpochGuard oGuard;
 
-		if (!pContext)
+		if (!oGuard.IsActive())
 		{
-			return nullptr;
+			// Without a thread record only the lock keeps writers from reclaiming the snapshot
+			HSReadLockGuard oLock(g_oHookLock);
+			ptrAny pOriginal = HSSnapshotFind(g_pSnapshot.load(std::memory_order_acquire), pSrc);
+			return pOriginal ? pOriginal : pSrc;
 		}
 
-		return pContext->pMem;
+		// Like a handle, an unhooked target is its own original
+		ptrAny pOriginal = HSSnapshotFind(g_pSnapshot.load(std::memory_order_acquire), pSrc);
+		return pOriginal ? pOriginal : pSrc;
 	}
 
 	HSStaticContext* HSHook::FindHook(ptrAny pSrc)
@@ -121,226 +454,1833 @@ namespace HSLL
 		return g_oStaticManager.FindContext((unsignedP)pSrc);
 	}
 
-	HSStaticContext* HSHook::RemoveHook(ptrAny pSrc)
+	bool HSHook::RemoveHook(ptrAny pSrc)
 	{
 		return g_oStaticManager.RemoveContext((unsignedP)pSrc);
 	}
-}
 
-#ifdef _WIN32
-#define NOMINMAX
-#include <windows.h>
-namespace HSLL
-{
-	enum HSMemProtection
-	{
-		HSMemProtection_None = PAGE_NOACCESS,
-		HSMemProtection_Read = PAGE_READONLY,
-		HSMemProtection_ReadWrite = PAGE_READWRITE,
-		HSMemProtection_Execute = PAGE_EXECUTE,
-		HSMemProtection_ReadExecute = PAGE_EXECUTE_READ,
-		HSMemProtection_ReadWriteExecute = PAGE_EXECUTE_READWRITE
-	};
+	void HSHook::SetPatchMode(HSPatchMode eMode)
+	{
+		HSWriteLockGuard oLock(g_oHookLock);
+		g_ePatchMode = eMode;
+	}
 
-	bool HSHook::SetProt(ptrAny pMem, unsigned32 uSize, unsigned32 uProt)
+	HSPatchMode HSHook::GetPatchMode()
 	{
-		if (pMem == nullptr || uSize == 0)
-		{
-			return false;
-		}
+		HSReadLockGuard oLock(g_oHookLock);
+		return g_ePatchMode;
+	}
+
+	bool HSHook::IsCodeProtected()
+	{
+		HSReadLockGuard oLock(g_oHookLock);
+		return g_oProtManager.GetDirtyNum() == 0;
+	}
 
-		DWORD uOldProtect;
-		return VirtualProtect(pMem, uSize, uProt, &uOldProtect) != 0;
+	void HSHook::GetPoolStats(HSPoolStats& stStats)
+	{
+		HSReadLockGuard oLock(g_oHookLock);
+		g_oTrampolinePool.GetStats(stStats);
 	}
 
-	ptrAny HSHook::MemAlloc(unsigned32 uSize, unsigned32 uProt)
+	void HSHook::WriteJmp(ptrU8 pCode, ptrU8 pPos, ptrAny pDst, unsigned32 uSize)
 	{
-		if (uSize == 0)
+		if (uSize == HS_ABS_JMP_SIZE)
 		{
-			return nullptr;
+			// JMP qword ptr [rip+0], the target follows the instruction
+			pCode[0] = 0xFF;
+			pCode[1] = 0x25;
+			*(ptrS32)(pCode + 2) = 0;
+			*(unsigned64*)(pCode + 6) = (unsigned64)(unsignedP)pDst;
+			return;
 		}
 
-		return VirtualAlloc(nullptr, uSize, MEM_COMMIT | MEM_RESERVE, uProt);
+		pCode[0] = 0xE9;
+		*(ptrS32)(pCode + 1) = (signed32)((unsignedP)pDst - (unsignedP)pPos - HS_JMP_SIZE);
 	}
 
-	bool HSHook::MemFree(ptrAny pMem)
+	bool HSHook::EncodeJmp(ptrU8 pCode, ptrU8 pPos, ptrAny pDst, unsigned32 uSize, ptrAny& pRelay)
 	{
-		if (!pMem)
+		pRelay = nullptr;
+
+		// A detour out of rel32 reach is entered through an absolute jump placed near the target
+		if (uSize == HS_JMP_SIZE && !HSTrampolinePool::IsNear(pDst, pPos))
 		{
-			return false;
+			if ((pRelay = g_oTrampolinePool.Alloc(HS_ABS_JMP_SIZE, pPos)) == nullptr)
+			{
+				return false;
+			}
+
+			WriteJmp((ptrU8)pRelay, (ptrU8)pRelay, pDst, HS_ABS_JMP_SIZE);
+			pDst = pRelay;
 		}
 
-		return VirtualFree(pMem, 0, MEM_RELEASE) != 0;
+		WriteJmp(pCode, pPos, pDst, uSize);
+		return true;
 	}
-}
-#elif defined(__unix__)
-#include <sys/mman.h>
-#include <unistd.h>
-
-namespace HSLL
-{
-	enum HSMemProtection
-	{
-		HSMemProtection_None = PROT_NONE,
-		HSMemProtection_Read = PROT_READ,
-		HSMemProtection_ReadWrite = PROT_READ | PROT_WRITE,
-		HSMemProtection_Execute = PROT_EXEC,
-		HSMemProtection_ReadExecute = PROT_READ | PROT_EXEC,
-		HSMemProtection_ReadWriteExecute = PROT_READ | PROT_WRITE | PROT_EXEC
-	};
 
-	bool HSHook::SetProt(ptrAny pBuf, unsignedP uSize, unsigned32 uProt)
+	bool HSHook::IsNopIns(ptrU8 pIns, const HSInsInfo& stInfo)
 	{
-		if (pBuf == nullptr || uSize == 0)
-		{
-			return false;
-		}
+		signed32 i = 0;
 
-		long uPageSize = sysconf(_SC_PAGESIZE);
-		if (uPageSize == -1)
+		while (i < stInfo.sTotalSize && pIns[i] == 0x66)
 		{
-			return false;
+			i++;
 		}
 
-		ptrU8 pAlignedAddr = (ptrU8)((unsignedP)pBuf & ~(uPageSize - 1));
-		ptrU8 pEnd = (ptrU8)pBuf + uSize;
-		ptrU8 pAlignedEnd = (ptrU8)(((unsignedP)pEnd + uPageSize - 1) & ~(uPageSize - 1));
-		unsignedP uNewSize = pAlignedEnd - pAlignedAddr;
-
-		if (uNewSize == 0)
+		// 90, 66 90 and the multi-byte 0F 1F /0 forms emitted by -fpatchable-function-entry and aligners
+		if (i == stInfo.sTotalSize - 1 && pIns[i] == 0x90)
 		{
-			return false;
+			return true;
 		}
 
-		return mprotect(pAlignedAddr, uNewSize, uProt) == 0;
+		return stInfo.bHasModrm && pIns[i] == 0x0F && pIns[i + 1] == 0x1F && ((pIns[(signed32)stInfo.sModrmOffset] >> 3) & 0x07) == 0;
 	}
 
-	ptrAny HSHook::MemAlloc(unsignedP uSize, unsigned32 uProt)
+	bool HSHook::HasPadding(ptrU8 pSrc)
 	{
-		if (uSize == 0)
-		{
-			return nullptr;
-		}
-
-		const unsignedP uHeaderSize = sizeof(unsignedP);
-		unsignedP uTotalSize = uSize + uHeaderSize;
-
-		if (uTotalSize < uSize)
+		// The bytes before the entry must be readable and the 2-byte store must not split a cache line
+		if (((unsignedP)pSrc & (HSTrampolinePool::HS_POOL_PAGE_SIZE - 1)) < HS_PADDING_SIZE || ((unsignedP)pSrc & 63) == 63)
 		{
-			return nullptr;
+			return false;
 		}
 
-		ptrAny pBuf = mmap(nullptr, uTotalSize, uProt, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-		if (pBuf == MAP_FAILED)
+		for (unsigned32 i = 1; i <= HS_PADDING_SIZE; i++)
 		{
-			return nullptr;
+			if (pSrc[-(signed32)i] != 0xCC && pSrc[-(signed32)i] != 0x90)
+			{
+				return false;
+			}
 		}
 
-		*((unsignedP*)pBuf) = uTotalSize;
-		return (ptrAny)((ptrU8)pBuf + uHeaderSize);
+		return true;
 	}
 
-	bool HSHook::MemFree(ptrAny pBuf)
+	bool HSHook::IsPatched(ptrU8 pStart, unsigned32 uSize)
 	{
-		if (!pBuf)
+		// A patch never reaches further than HS_PADDING_SIZE bytes before its entry or HS_MAX_JMP_SIZE bytes after it
+		for (ptrU8 pSrc = pStart - HS_MAX_JMP_SIZE + 1; pSrc < pStart + uSize + HS_PADDING_SIZE; pSrc++)
 		{
-			return false;
+			HSStaticContext* pContext = FindHook(pSrc);
+
+			if (pContext && pContext->pPatch < pStart + uSize && pContext->pPatch + pContext->uSize > pStart)
+			{
+				return true;
+			}
 		}
 
-		const unsignedP uHeaderSize = sizeof(unsignedP);
-		ptrAny pActualAddr = (ptrAny)((ptrU8)pBuf - uHeaderSize);
-		unsignedP uTotalSize = *((unsignedP*)pActualAddr);
+		return false;
+	}
 
-		if (uTotalSize < uHeaderSize)
+	bool HSHook::StealIns(ptrAny pSrc, const HSFlowInfo& stFlow, unsigned32 uMinSize, HSHookPlan& stPlan)
+	{
+		if (!GetBackupIns(pSrc, stPlan.pBackupInfo, stPlan.uNum, uMinSize))
 		{
 			return false;
 		}
 
-		return munmap(pActualAddr, uTotalSize) == 0;
-	}
-}
-#endif
+		stPlan.uBackUpSize = GetInsSize(stPlan.pBackupInfo, stPlan.uNum);
 
-namespace HSLL
-{
-	void HSHook::WriteJmp(ptrAny pBuf, ptrAny pDst)
-	{
-		*(ptrU8)pBuf = 0xE9;
-		*(ptrS32)((ptrU8)pBuf + 1) = (signed32)pDst - (signed32)pBuf - 5;
+		// A branch landing inside the stolen bytes would execute the middle of the patch.
+		// Offset 0 is fine, a jump back to the entry simply goes through the hook again
+		return !HSx86Analyzer::HasTarget(stFlow, 1, stPlan.uBackUpSize);
 	}
 
-	bool HSHook::Install(ptrAny pSrc, ptrAny pDst)
+	bool HSHook::PlanHook(const HSHookOp& stOp, HSHookPlan& stPlan)
 	{
-		if (pSrc == nullptr || pDst == nullptr || pSrc == pDst)
+		HSInsInfo pFixedInfo[HS_MAX_BACKUP_INS];
+		unsigned8 pFixedBuf[HS_MAX_FIXED_SIZE];
+		ptrU8 pSrc = (ptrU8)stOp.pSrc;
+		HSFlowInfo stFlow;
+
+		stPlan.pSrc = pSrc;
+		stPlan.pDst = stOp.pDst;
+		stPlan.pSlot = stOp.pSlot;
+		stPlan.sPriority = stOp.sPriority;
+		stPlan.pGroup = stOp.pGroup;
+		stPlan.pMem = nullptr;
+		stPlan.pOriginal = nullptr;
+
+		stPlan.uJmpSize = HS_JMP_SIZE;
+		stPlan.pRelay = nullptr;
+
+		// Only the stolen bytes have to decode, StealIns checks them
+		if (!HSx86Analyzer::Analyze(pSrc, stFlow))
 		{
 			return false;
 		}
 
-		HSWriteLockGuard oLock(g_oHookLock);
-
-		if (IsHookFull())
+#if defined(_M_X64) || defined(__x86_64__)
+		// Without a trampoline in rel32 reach the entry takes the absolute jump, and nothing stolen may need relocation
+		if (!g_oTrampolinePool.ReserveNear(pSrc))
 		{
-			return false;
+			stPlan.uJmpSize = HS_ABS_JMP_SIZE;
 		}
+#endif
 
-		if (FindHook(pSrc))
+		// Prefer the jump at the entry, padding mode costs a second branch on every call
+		if (StealIns(pSrc, stFlow, stPlan.uJmpSize, stPlan))
+		{
+			stPlan.pPatch = pSrc;
+			stPlan.uPatchSize = stPlan.uJmpSize;
+		}
+		else if (stPlan.uJmpSize == HS_JMP_SIZE && HasPadding(pSrc) && StealIns(pSrc, stFlow, 2, stPlan))
+		{
+			// JMP rel32 in the padding, JMP -7 at the entry
+			stPlan.pPatch = pSrc - HS_PADDING_SIZE;
+			stPlan.uPatchSize = HS_PADDING_SIZE + 2;
+		}
+		else
 		{
 			return false;
 		}
 
-		unsigned32 uNum;
-		HSInsInfo pFixedInfo[64];
-		HSInsInfo pBackupInfo[64];
-		ptrU8 pBuf = (ptrU8)MemAlloc(4096, HSMemProtection_ReadWriteExecute);
+		stPlan.uCodeSize = 0;
+		stPlan.uFixedSize = 0;
 
-		if (pBuf == nullptr)
+		for (unsigned32 i = 0; stPlan.uJmpSize == HS_ABS_JMP_SIZE && i < stPlan.uNum; i++)
 		{
-			return false;
+			if (stPlan.pBackupInfo[i].bNeedReloc || stPlan.pBackupInfo[i].bRipRelative)
+			{
+				return false;
+			}
 		}
 
-		if (!GetBackupIns(pSrc, pBackupInfo, uNum))
+		for (unsigned32 i = 0; i < stPlan.uNum; i++)
 		{
-			MemFree(pBuf);
-			return false;
+			if (!IsNopIns(pSrc + GetInsSize(stPlan.pBackupInfo, i), stPlan.pBackupInfo[i]))
+			{
+				// Relocate once in place only to learn the trampoline size, every operand is in reach from there
+				if (!GetFixedIns(pSrc, stPlan.pBackupInfo, stPlan.uNum, pFixedBuf, pSrc, pFixedInfo))
+				{
+					return false;
+				}
+
+				stPlan.uFixedSize = GetInsSize(pFixedInfo, stPlan.uNum);
+				stPlan.uCodeSize = stPlan.uFixedSize + stPlan.uJmpSize;
+				break;
+			}
 		}
 
-		if (!GetFixedIns(pSrc, pBackupInfo, uNum, pBuf, pFixedInfo))
+		return true;
+	}
+
+	bool HSHook::BuildHook(HSHookPlan& stPlan)
+	{
+		HSInsInfo pFixedInfo[HS_MAX_BACKUP_INS];
+		unsigned8 pFixedBuf[HS_MAX_FIXED_SIZE];
+
+		// A stolen NOP sled needs no copy, the original simply starts right after it
+		stPlan.pOriginal = (ptrU8)stPlan.pSrc + stPlan.uBackUpSize;
+		memset(&stPlan.stMap, 0, sizeof(stPlan.stMap));
+		stPlan.stMap.uStolen = (unsigned8)stPlan.uBackUpSize;
+
+		if (stPlan.uCodeSize)
 		{
-			MemFree(pBuf);
-			return false;
+			if (!GetFixedIns(stPlan.pSrc, stPlan.pBackupInfo, stPlan.uNum, pFixedBuf, stPlan.pMem, pFixedInfo))
+			{
+				return false;
+			}
+
+			memcpy(stPlan.pMem, pFixedBuf, stPlan.uFixedSize);
+			WriteJmp(stPlan.pMem + stPlan.uFixedSize, stPlan.pMem + stPlan.uFixedSize, (ptrU8)stPlan.pSrc + stPlan.uBackUpSize, stPlan.uJmpSize);
+			stPlan.pOriginal = stPlan.pMem;
+			stPlan.stMap.uNum = (unsigned8)stPlan.uNum;
+
+			for (unsigned32 i = 0; i < stPlan.uNum; i++)
+			{
+				stPlan.stMap.pIns[i + 1] = (unsigned8)(stPlan.stMap.pIns[i] + stPlan.pBackupInfo[i].sTotalSize);
+				stPlan.stMap.pFixed[i + 1] = (unsigned8)(stPlan.stMap.pFixed[i] + pFixedInfo[i].sTotalSize);
+				stPlan.stMap.bHasCall |= pFixedInfo[i].bIsCall;
+			}
 		}
 
-		unsigned32 uFixedSize = GetInsSize(pFixedInfo, uNum);
-		unsigned32 uBackUpSize = GetInsSize(pBackupInfo, uNum);
+		memcpy(stPlan.pMem + stPlan.uCodeSize, stPlan.pPatch, stPlan.uPatchSize);
 
-		if (!SetProt((ptrU8)pSrc, uBackUpSize, HSMemProtection_ReadWriteExecute))
+		// Jump to the replacement at pPatch, in padding mode followed by JMP -7 for the entry
+		if (!EncodeJmp(stPlan.pPatchCode, stPlan.pPatch, stPlan.pDst, stPlan.uJmpSize, stPlan.pRelay))
 		{
-			MemFree(pBuf);
 			return false;
 		}
 
-		WriteJmp(pBuf + uFixedSize, (ptrU8)pSrc + uBackUpSize);
-		memcpy(pBuf + uFixedSize + 5, pSrc, uBackUpSize);
-		WriteJmp(pSrc, pDst);
-		StoreHook(pSrc, pBuf, pBuf + uFixedSize + 5, uBackUpSize);
+		stPlan.pPatchCode[HS_JMP_SIZE] = 0xEB;
+		stPlan.pPatchCode[HS_JMP_SIZE + 1] = (unsigned8)(-(signed32)stPlan.uPatchSize);
 		return true;
 	}
 
-	bool HSHook::Remove(ptrAny pSrc)
+	void HSHook::AddPatchSites(ptrAny pSrc, ptrU8 pPatch, unsigned32 uJmpSize, const unsigned8* pPatchCode, ptrAny pDst, std::vector<HSPatchSite>& vecSites)
 	{
-		HSWriteLockGuard oLock(g_oHookLock);
-		HSStaticContext* pContext = FindHook(pSrc);
-
-		if (pContext == nullptr)
+		if (pPatch == pSrc)
 		{
-			return false;
+			vecSites.push_back(HSPatchSite{ pPatch, pPatchCode, uJmpSize, pDst });
+			return;
 		}
 
-		memcpy(pSrc, pContext->pCover, pContext->uSize);
-		MemFree(pContext->pMem);
-		RemoveHook(pSrc);
-		return true;
+		// The jump in the padding is unreachable until the entry jump lands, so it goes first
+		vecSites.push_back(HSPatchSite{ pPatch, pPatchCode, HS_PADDING_SIZE, nullptr });
+		vecSites.push_back(HSPatchSite{ (ptrU8)pSrc, pPatchCode + HS_PADDING_SIZE, 2, pDst });
+	}
+
+	void HSHook::AddRestoreSites(ptrAny pSrc, const HSStaticContext& stContext, std::vector<HSPatchSite>& vecSites)
+	{
+		unsigned32 uHead = (unsigned32)((ptrU8)pSrc - stContext.pPatch);
+		ptrU8 pCover = (ptrU8)stContext.pCover;
+
+		// Put the entry back first so nothing can reach the padding jump any more
+		vecSites.push_back(HSPatchSite{ (ptrU8)pSrc, pCover + uHead, stContext.uSize - uHead, nullptr });
+
+		if (uHead)
+		{
+			vecSites.push_back(HSPatchSite{ stContext.pPatch, pCover, uHead, nullptr });
+		}
 	}
+
+	unsignedP HSHook::MoveFromStolen(ptrAny pSrc, ptrU8 pPatch, ptrAny pMem, const HSInsMap& stMap, unsignedP uIp)
+	{
+		unsignedP uSrc = (unsignedP)pSrc;
+
+		// Padding is never meant to run, whoever is there continues at the entry
+		if (uIp >= (unsignedP)pPatch && uIp < uSrc)
+		{
+			return uSrc;
+		}
+
+		if (uIp <= uSrc || uIp >= uSrc + stMap.uStolen)
+		{
+			return uIp;
+		}
+
+		if (stMap.uNum == 0)
+		{
+			return uSrc + stMap.uStolen;
+		}
+
+		for (unsigned32 i = 1; i < stMap.uNum; i++)
+		{
+			if (uIp == uSrc + stMap.pIns[i])
+			{
+				return (unsignedP)pMem + stMap.pFixed[i];
+			}
+		}
+
+		return uIp;
+	}
+
+	unsignedP HSHook::MoveFromTrampoline(ptrAny pSrc, const HSStaticContext& stContext, unsignedP uIp)
+	{
+		const HSInsMap& stMap = stContext.stMap;
+		unsignedP uMem = (unsignedP)stContext.pMem;
+
+		if (uIp >= (unsignedP)stContext.pPatch && uIp < (unsignedP)pSrc)
+		{
+			return (unsignedP)pSrc;
+		}
+
+		if (stMap.uNum == 0 || uIp < uMem || uIp > uMem + stMap.pFixed[stMap.uNum])
+		{
+			return uIp;
+		}
+
+		for (unsigned32 i = 0; i <= stMap.uNum; i++)
+		{
+			if (uIp == uMem + stMap.pFixed[i])
+			{
+				return (unsignedP)pSrc + stMap.pIns[i];
+			}
+		}
+
+		// Stopped inside a LOOPcc/JECXZ expansion (Ex 02; EB 05; E9 rel32), take the jump it is at
+		ptrU8 pIns = (ptrU8)uIp;
+		unsignedP uTarget = (pIns[0] == 0xEB) ? uIp + 2 + (signed8)pIns[1] : uIp + 5 + *(ptrS32)(pIns + 1);
+
+		for (unsigned32 i = 0; i <= stMap.uNum; i++)
+		{
+			if (uTarget == uMem + stMap.pFixed[i])
+			{
+				return (unsignedP)pSrc + stMap.pIns[i];
+			}
+		}
+
+		return uTarget;
+	}
+
+	void HSHook::MoveThreads(const std::vector<ptrAny>& vecRemoves, const std::vector<HSHookPlan>& vecPlans)
+	{
+		for (unsigned32 t = 0; t < HSPatcher::GetStoppedNum(); t++)
+		{
+			unsignedP* pIp = HSPatcher::GetStoppedIp(t);
+
+			for (ptrAny pSrc : vecRemoves)
+			{
+				*pIp = MoveFromTrampoline(pSrc, *FindHook(pSrc), *pIp);
+			}
+
+			for (const HSHookPlan& stPlan : vecPlans)
+			{
+				if (stPlan.pGroup == nullptr)
+				{
+					*pIp = MoveFromStolen(stPlan.pSrc, stPlan.pPatch, stPlan.pMem, stPlan.stMap, *pIp);
+				}
+			}
+		}
+	}
+
+	bool HSHook::PlanLink(const HSHookOp& stOp, HSStaticContext& stContext, HSLinkOp& stLink)
+	{
+		// A link without a slot cannot pass the call on, so it can only ever be the whole chain
+		if (stOp.pDst == nullptr || stOp.pSrc == stOp.pDst || stOp.pSlot == nullptr)
+		{
+			return false;
+		}
+
+		// Group hooks are toggled as a whole and never share their target
+		if (stOp.pGroup || stContext.pGroup)
+		{
+			return false;
+		}
+
+		for (const HSHookLink& stOld : stContext.vecLinks)
+		{
+			if (stOld.pSlot == nullptr || stOld.pSlot == stOp.pSlot || stOld.pDst == stOp.pDst)
+			{
+				return false;
+			}
+		}
+
+		stLink.pSrc = stOp.pSrc;
+		stLink.pContext = &stContext;
+		stLink.vecLinks = stContext.vecLinks;
+		stLink.pUnlinked = nullptr;
+
+		// Higher priority runs first, equal priorities keep install order
+		auto it = std::find_if(stLink.vecLinks.begin(), stLink.vecLinks.end(),
+			[&](const HSHookLink& stOld) { return stOld.sPriority < stOp.sPriority; });
+
+		stLink.bNewHead = it == stLink.vecLinks.begin();
+		stLink.vecLinks.insert(it, HSHookLink{ stOp.pDst, stOp.pSlot, stOp.sPriority });
+		return true;
+	}
+
+	bool HSHook::PlanUnlink(const HSHookOp& stOp, HSStaticContext& stContext, HSLinkOp& stLink)
+	{
+		stLink.pSrc = stOp.pSrc;
+		stLink.pContext = &stContext;
+		stLink.vecLinks = stContext.vecLinks;
+		stLink.pUnlinked = stOp.pSlot;
+
+		auto it = std::find_if(stLink.vecLinks.begin(), stLink.vecLinks.end(),
+			[&](const HSHookLink& stOld) { return stOld.pSlot == stOp.pSlot; });
+
+		if (it == stLink.vecLinks.end())
+		{
+			return false;
+		}
+
+		stLink.bNewHead = it == stLink.vecLinks.begin();
+		stLink.vecLinks.erase(it);
+		return true;
+	}
+
+	void HSHook::WireLinks(const HSLinkOp& stLink)
+	{
+		ptrAny pNext = stLink.pContext->pOriginal;
+
+		// Tail first, every link already passes the call on by the time the one in front reaches it
+		for (size_t i = stLink.vecLinks.size(); i-- > 0;)
+		{
+			*stLink.vecLinks[i].pSlot = pNext;
+			pNext = stLink.vecLinks[i].pDst;
+		}
+
+#if defined(HS_HAS_STUBS)
+		if (stLink.pContext->uStatsId != HSStatsManager::HS_STATS_INVALID)
+		{
+			HSStatsManager::SetNext(stLink.pContext->uStatsId, pNext);
+		}
+
+		if (stLink.pContext->pFilter && !stLink.pContext->bStats)
+		{
+			HSStoreCell(&stLink.pContext->pFilter->pNext, pNext);
+		}
+#endif
+	}
+
+	bool HSHook::HasStub(const HSStaticContext& stContext)
+	{
+#if defined(HS_HAS_STUBS)
+		return stContext.bStats || stContext.pFilterStub;
+#else
+		(void)stContext;
+		return false;
+#endif
+	}
+
+	ptrAny HSHook::GetEntryTarget(const HSStaticContext& stContext)
+	{
+#if defined(HS_HAS_STUBS)
+		if (stContext.pFilterStub)
+		{
+			return stContext.pFilterStub;
+		}
+
+		return stContext.bStats ? HSStatsManager::GetStub(stContext.uStatsId) : stContext.vecLinks[0].pDst;
+#else
+		return stContext.vecLinks[0].pDst;
+#endif
+	}
+
+#if defined(HS_HAS_STUBS)
+	bool HSHook::RetargetPastFilter(HSStaticContext& stContext, ptrAny pTarget)
+	{
+		// Behind a filter only its pass cell moves, the entry jump stays on the filter
+		if (stContext.pFilter)
+		{
+			HSStoreCell(&stContext.pFilter->pNext, pTarget);
+			return true;
+		}
+
+		return RetargetEntry(stContext, pTarget);
+	}
+
+	bool HSHook::RetargetEntry(HSStaticContext& stContext, ptrAny pTarget)
+	{
+		unsigned8 pCode[5];
+		pCode[0] = 0xE9;
+		*(ptrS32)(pCode + 1) = (signed32)pTarget - (signed32)stContext.pPatch - 5;
+
+		// A disabled group hook only keeps the bytes for its next Enable
+		if (stContext.bEnabled)
+		{
+			HSPatchSite stSite = { stContext.pPatch, pCode, 5, pTarget };
+			HSProtRange stRange = { stContext.pPatch, 5 };
+
+			if (!HSPatcher::Prepare(g_ePatchMode) || !g_oProtManager.Unprotect(&stRange, 1))
+			{
+				return false;
+			}
+
+			// No thread can stop inside a single jump, so nobody has to be moved
+			if (g_ePatchMode == HSPatchMode_Quiesce && !HSPatcher::Stop())
+			{
+				g_oProtManager.Restore(&stRange, 1);
+				return false;
+			}
+
+			HSPatcher::Apply(&stSite, 1, g_ePatchMode);
+
+			if (g_ePatchMode == HSPatchMode_Quiesce)
+			{
+				HSPatcher::Resume();
+			}
+
+			g_oProtManager.Restore(&stRange, 1);
+		}
+
+		memcpy(stContext.pPatchCode, pCode, sizeof(pCode));
+		return true;
+	}
+#endif
+
+	void HSHook::DiscardPlans(std::vector<HSHookPlan>& vecPlans, std::vector<HSLinkOp>& vecLinkOps)
+	{
+		for (HSHookPlan& stPlan : vecPlans)
+		{
+			if (stPlan.pMem)
+			{
+				g_oTrampolinePool.Free(stPlan.pMem);
+			}
+
+			if (stPlan.pRelay)
+			{
+				g_oTrampolinePool.Free(stPlan.pRelay);
+			}
+		}
+
+		for (HSLinkOp& stLink : vecLinkOps)
+		{
+			if (stLink.pRelay)
+			{
+				g_oTrampolinePool.Free(stLink.pRelay);
+			}
+		}
+	}
+
+	bool HSHook::ApplyOps(const HSHookOp* pOps, unsigned32 uNum)
+	{
+		std::vector<HSHookPlan> vecPlans;
+		std::vector<HSLinkOp> vecLinkOps;
+		std::vector<ptrAny> vecRemoves;
+		std::vector<HSProtRange> vecRanges;
+		std::vector<ptrAny> vecSrc;
+
+		// Decode and validate everything before touching any memory
+		for (unsigned32 i = 0; i < uNum; i++)
+		{
+			const HSHookOp& stOp = pOps[i];
+
+			if (stOp.pSrc == nullptr)
+			{
+				return false;
+			}
+
+			// Cell hooks are added and removed on their own, never as part of a batch
+			if (g_oCellManager.FindContext((unsignedP)stOp.pSrc))
+			{
+				return false;
+			}
+
+			vecSrc.push_back(stOp.pSrc);
+			HSStaticContext* pContext = FindHook(stOp.pSrc);
+
+			if (stOp.bRemove && (pContext == nullptr || pContext->pGroup != stOp.pGroup))
+			{
+				return false;
+			}
+
+			if (stOp.bRemove && (stOp.pSlot == nullptr || pContext->vecLinks.size() == 1))
+			{
+				if (stOp.pSlot && pContext->vecLinks[0].pSlot != stOp.pSlot)
+				{
+					return false;
+				}
+
+				vecRemoves.push_back(stOp.pSrc);
+
+				if (pContext->bEnabled)
+				{
+					vecRanges.push_back(HSProtRange{ pContext->pPatch, pContext->uSize });
+				}
+
+				continue;
+			}
+
+			if (pContext)
+			{
+				// The target is already patched, only the chain changes and the code is not decoded again
+				vecLinkOps.emplace_back();
+				HSLinkOp& stLink = vecLinkOps.back();
+
+				if (!(stOp.bRemove ? PlanUnlink(stOp, *pContext, stLink) : PlanLink(stOp, *pContext, stLink)))
+				{
+					return false;
+				}
+
+				// Same jump at pPatch, only its target moves, in padding mode the entry keeps its JMP -7
+				if (stLink.bNewHead && !HasStub(*pContext))
+				{
+					vecRanges.push_back(HSProtRange{ pContext->pPatch, pContext->uJmpSize });
+				}
+
+				continue;
+			}
+
+			if (stOp.pDst == nullptr || stOp.pSrc == stOp.pDst)
+			{
+				return false;
+			}
+
+			vecPlans.emplace_back();
+
+			if (!PlanHook(stOp, vecPlans.back()))
+			{
+				return false;
+			}
+
+			if (IsPatched(vecPlans.back().pPatch, vecPlans.back().uPatchSize))
+			{
+				return false;
+			}
+
+			// A group hook is only built here, its patch is written when the group is enabled
+			if (stOp.pGroup == nullptr)
+			{
+				vecRanges.push_back(HSProtRange{ vecPlans.back().pPatch, vecPlans.back().uPatchSize });
+			}
+		}
+
+		std::sort(vecSrc.begin(), vecSrc.end());
+
+		if (std::adjacent_find(vecSrc.begin(), vecSrc.end()) != vecSrc.end())
+		{
+			return false;
+		}
+
+		// Storing the new hooks and publishing the table happen after patching and must not fail
+		if (!ReserveHooks((unsigned32)vecPlans.size()))
+		{
+			return false;
+		}
+
+		HSHookSnapshot* pSnapshot = nullptr;
+		HSHookSnapshot* pEarly = nullptr;
+
+		if (!vecPlans.empty() || !vecRemoves.empty())
+		{
+			// Also holds the hooks stored now, a failed Stop publishes it without the new ones
+			unsigned32 uAdded = vecPlans.size() > vecRemoves.size() ? (unsigned32)(vecPlans.size() - vecRemoves.size()) : 0;
+			pSnapshot = HSAllocSnapshot(g_oStaticManager.GetCount() + g_oCellManager.GetCount() + uAdded);
+
+			if (pSnapshot == nullptr)
+			{
+				return false;
+			}
+		}
+
+		// New targets go into a snapshot before their jump goes live, a replacement may look up its original at once
+		if (!vecPlans.empty())
+		{
+			pEarly = HSAllocSnapshot(g_oStaticManager.GetCount() + g_oCellManager.GetCount() + (unsigned32)vecPlans.size());
+
+			if (pEarly == nullptr)
+			{
+				HSFreeSnapshot(pSnapshot);
+				return false;
+			}
+		}
+
+		bool bResult = true;
+		std::vector<HSHookPlan*> vecOrder;
+
+		for (HSHookPlan& stPlan : vecPlans)
+		{
+			vecOrder.push_back(&stPlan);
+		}
+
+		std::sort(vecOrder.begin(), vecOrder.end(), [](const HSHookPlan* a, const HSHookPlan* b) { return a->pPatch < b->pPatch; });
+
+		for (size_t i = 1; i < vecOrder.size(); i++)
+		{
+			if (vecOrder[i - 1]->pPatch + vecOrder[i - 1]->uPatchSize > vecOrder[i]->pPatch)
+			{
+				bResult = false;
+			}
+		}
+
+		bResult = bResult && HSPatcher::Prepare(g_ePatchMode);
+
+		for (unsigned32 i = 0; bResult && i < vecPlans.size(); i++)
+		{
+			// Stolen code jumps back with rel32, so its trampoline has to be in reach of the target
+			HSHookPlan& stPlan = vecPlans[i];
+			stPlan.pMem = (ptrU8)g_oTrampolinePool.Alloc(stPlan.uCodeSize + stPlan.uPatchSize,
+				stPlan.uJmpSize == HS_JMP_SIZE ? stPlan.pSrc : nullptr);
+
+			if (stPlan.pMem == nullptr || !BuildHook(stPlan))
+			{
+				bResult = false;
+				break;
+			}
+		}
+
+		for (unsigned32 i = 0; bResult && i < vecLinkOps.size(); i++)
+		{
+			HSLinkOp& stLink = vecLinkOps[i];
+
+			if (stLink.bNewHead && !HasStub(*stLink.pContext))
+			{
+				bResult = EncodeJmp(stLink.pJmpCode, stLink.pContext->pPatch, stLink.vecLinks[0].pDst,
+					stLink.pContext->uJmpSize, stLink.pRelay);
+			}
+		}
+
+		if (bResult && !vecRanges.empty())
+		{
+			bResult = g_oProtManager.Unprotect(vecRanges.data(), (unsigned32)vecRanges.size());
+		}
+
+		if (!bResult)
+		{
+			DiscardPlans(vecPlans, vecLinkOps);
+
+			if (pSnapshot)
+			{
+				HSFreeSnapshot(pSnapshot);
+			}
+
+			if (pEarly)
+			{
+				HSFreeSnapshot(pEarly);
+			}
+
+			return false;
+		}
+
+		// A new trampoline runs the unhooked function, handing it out before the jump is written is harmless
+		if (pEarly)
+		{
+			for (HSHookPlan& stPlan : vecPlans)
+			{
+				HSSnapshotInsert(pEarly, stPlan.pSrc, stPlan.pOriginal);
+			}
+
+			HSPublishSnapshot(pEarly);
+		}
+
+		std::vector<HSPatchSite> vecSites;
+
+		for (ptrAny pSrc : vecRemoves)
+		{
+			if (FindHook(pSrc)->bEnabled)
+			{
+				AddRestoreSites(pSrc, *FindHook(pSrc), vecSites);
+			}
+		}
+
+		for (HSLinkOp& stLink : vecLinkOps)
+		{
+			if (stLink.bNewHead && !HasStub(*stLink.pContext))
+			{
+				vecSites.push_back(HSPatchSite{ stLink.pContext->pPatch, stLink.pJmpCode, stLink.pContext->uJmpSize, stLink.vecLinks[0].pDst });
+			}
+		}
+
+		for (HSHookPlan& stPlan : vecPlans)
+		{
+			if (stPlan.pGroup == nullptr)
+			{
+				AddPatchSites(stPlan.pSrc, stPlan.pPatch, stPlan.uJmpSize, stPlan.pPatchCode, stPlan.pDst, vecSites);
+			}
+		}
+
+		// Nothing below may allocate until Resume, a parked thread may hold the heap lock
+		if (g_ePatchMode == HSPatchMode_Quiesce && !HSPatcher::Stop())
+		{
+			g_oProtManager.Restore(vecRanges.data(), (unsigned32)vecRanges.size());
+
+			// The early snapshot may have handed the new trampolines out. The stored hooks are published
+			// again without them, then they wait for the grace period
+			if (pEarly)
+			{
+				HSPublishSnapshot(pSnapshot);
+				pSnapshot = nullptr;
+
+				for (HSHookPlan& stPlan : vecPlans)
+				{
+					HSEpochManager::Retire(stPlan.pMem, &HSFreeTrampoline);
+					stPlan.pMem = nullptr;
+				}
+			}
+
+			DiscardPlans(vecPlans, vecLinkOps);
+
+			if (pSnapshot)
+			{
+				HSFreeSnapshot(pSnapshot);
+			}
+
+			HSEpochManager::Reclaim();
+			return false;
+		}
+
+		// Slots are filled before the jump goes live, a replacement may call through them at once
+		for (HSHookPlan& stPlan : vecPlans)
+		{
+			if (stPlan.pSlot)
+			{
+				*stPlan.pSlot = stPlan.pOriginal;
+			}
+		}
+
+		for (HSLinkOp& stLink : vecLinkOps)
+		{
+			WireLinks(stLink);
+		}
+
+		HSPatcher::Apply(vecSites.data(), (unsigned32)vecSites.size(), g_ePatchMode);
+
+		if (g_ePatchMode == HSPatchMode_Quiesce)
+		{
+			MoveThreads(vecRemoves, vecPlans);
+			HSPatcher::Resume();
+		}
+
+		for (HSLinkOp& stLink : vecLinkOps)
+		{
+			if (stLink.pUnlinked)
+			{
+				*stLink.pUnlinked = stLink.pSrc;
+			}
+
+			if (stLink.bNewHead && !HasStub(*stLink.pContext))
+			{
+				memcpy(stLink.pContext->pPatchCode, stLink.pJmpCode, stLink.pContext->uJmpSize);
+
+				// The old relay is dropped only after the grace period, a thread may be about to jump through it
+				if (stLink.pContext->pRelay)
+				{
+					HSEpochManager::Retire(stLink.pContext->pRelay, &HSFreeTrampoline);
+				}
+
+				stLink.pContext->pRelay = stLink.pRelay;
+			}
+
+			stLink.pContext->vecLinks = std::move(stLink.vecLinks);
+		}
+
+		std::vector<ptrAny> vecRetired;
+
+		for (ptrAny pSrc : vecRemoves)
+		{
+			HSStaticContext* pContext = FindHook(pSrc);
+
+			for (const HSHookLink& stLink : pContext->vecLinks)
+			{
+				if (stLink.pSlot)
+				{
+					*stLink.pSlot = pSrc;
+				}
+			}
+
+#if defined(HS_HAS_STUBS)
+			// The stub is never freed, a thread still inside it goes straight to the unhooked function
+			if (pContext->uStatsId != HSStatsManager::HS_STATS_INVALID)
+			{
+				HSStatsManager::SetNext(pContext->uStatsId, pSrc);
+			}
+
+			if (pContext->pFilter)
+			{
+				HSStoreCell(&pContext->pFilter->pNext, pSrc);
+				HSStoreCell(&pContext->pFilter->pFail, pSrc);
+			}
+#endif
+
+			if (pContext->pRelay)
+			{
+				vecRetired.push_back(pContext->pRelay);
+			}
+
+			// A relocated call may still have to return into the trampoline, so it stays mapped. Others wait
+			// for the grace period, a caller inside an HSEpochGuard may still be running through it
+			if (!pContext->stMap.bHasCall)
+			{
+				vecRetired.push_back(pContext->pMem);
+			}
+
+			RemoveHook(pSrc);
+		}
+
+		for (HSHookPlan& stPlan : vecPlans)
+		{
+			StoreHook(stPlan);
+		}
+
+		if (pSnapshot)
+		{
+			HSPublishSnapshot(pSnapshot);
+		}
+
+		// Retired only once the snapshot listing them is unpublished, a reader entering later cannot find them
+		for (ptrAny pMem : vecRetired)
+		{
+			HSEpochManager::Retire(pMem, &HSFreeTrampoline);
+		}
+
+		// The hooks are live now, a page that stays writable is retried by the next patch
+		if (!vecRanges.empty())
+		{
+			g_oProtManager.Restore(vecRanges.data(), (unsigned32)vecRanges.size());
+		}
+
+		HSEpochManager::Reclaim();
+		return true;
+	}
+
+	bool HSHook::Install(ptrAny pSrc, ptrAny pDst)
+	{
+		return InstallSlot(pSrc, pDst, nullptr, 0);
+	}
+
+	bool HSHook::InstallSlot(ptrAny pSrc, ptrAny pDst, ptrAny* pSlot, signed32 sPriority)
+	{
+		HSHookOp stOp = { pSrc, pDst, pSlot, sPriority, false, nullptr };
+		HSWriteLockGuard oLock(g_oHookLock);
+		return ApplyOps(&stOp, 1);
+	}
+
+	bool HSHook::Remove(ptrAny pSrc)
+	{
+		return RemoveSlot(pSrc, nullptr);
+	}
+
+	bool HSHook::RemoveSlot(ptrAny pSrc, ptrAny* pSlot)
+	{
+		HSHookOp stOp = { pSrc, nullptr, pSlot, 0, true, nullptr };
+		HSWriteLockGuard oLock(g_oHookLock);
+
+		if (g_oCellManager.FindContext((unsignedP)pSrc))
+		{
+			return RestoreCells(pSrc, pSlot);
+		}
+
+		return ApplyOps(&stOp, 1);
+	}
+
+	bool HSHook::InstallByName(const char* pModule, const char* pSymbol, ptrAny pDst)
+	{
+		return InstallByNameSlot(pModule, pSymbol, pDst, nullptr, nullptr, 0);
+	}
+
+	bool HSHook::InstallByNameSlot(const char* pModule, const char* pSymbol, ptrAny pDst, ptrAny* pHandleSrc, ptrAny* pSlot, signed32 sPriority)
+	{
+		ptrAny pSrc;
+		HSWriteLockGuard oLock(g_oHookLock);
+
+		if (pSymbol == nullptr || !HSSymbolIndex::Resolve(pModule, &pSymbol, 1, &pSrc))
+		{
+			return false;
+		}
+
+		HSHookOp stOp = { pSrc, pDst, pSlot, sPriority, false, nullptr };
+
+		if (!ApplyOps(&stOp, 1))
+		{
+			return false;
+		}
+
+		// Set only once the hook is in, a failed install leaves the handle as it was
+		if (pHandleSrc)
+		{
+			*pHandleSrc = pSrc;
+		}
+
+		return true;
+	}
+
+	bool HSHook::InstallByName(const char* pModule, const char* const* pSymbols, const ptrAny* pDsts, unsigned32 uNum)
+	{
+		std::vector<ptrAny> vecSrc(uNum);
+		std::vector<HSHookOp> vecOps;
+		HSWriteLockGuard oLock(g_oHookLock);
+
+		if (!HSSymbolIndex::Resolve(pModule, pSymbols, uNum, vecSrc.data()))
+		{
+			return false;
+		}
+
+		for (unsigned32 i = 0; i < uNum; i++)
+		{
+			vecOps.push_back(HSHookOp{ vecSrc[i], pDsts[i], nullptr, 0, false, nullptr });
+		}
+
+		return ApplyOps(vecOps.data(), uNum);
+	}
+
+	bool HSHook::ResolveNames(const char* pModule, const char* const* pSymbols, unsigned32 uNum, ptrAny* pAddrs)
+	{
+		// The index is shared, building it is serialized with the hooks that use it
+		HSWriteLockGuard oLock(g_oHookLock);
+		return HSSymbolIndex::Resolve(pModule, pSymbols, uNum, pAddrs);
+	}
+
+	bool HSHook::InstallImport(const char* pSymbol, ptrAny pDst)
+	{
+		return InstallImportSlot(pSymbol, pDst, nullptr, nullptr);
+	}
+
+	bool HSHook::InstallImportSlot(const char* pSymbol, ptrAny pDst, ptrAny* pHandleSrc, ptrAny* pSlot)
+	{
+		ptrAny pSrc = HSImportScanner::Resolve(pSymbol);
+		std::vector<ptrAny*> vecCells;
+
+		if (pSrc == nullptr || !HSImportScanner::Find(pSymbol, vecCells))
+		{
+			return false;
+		}
+
+		HSWriteLockGuard oLock(g_oHookLock);
+
+		if (!SwapCells(pSrc, pDst, vecCells, pSlot))
+		{
+			return false;
+		}
+
+		// Only a hook that went in may be removed through the handle
+		if (pHandleSrc)
+		{
+			*pHandleSrc = pSrc;
+		}
+
+		return true;
+	}
+
+	bool HSHook::RemoveImport(const char* pSymbol)
+	{
+		ptrAny pSrc = HSImportScanner::Resolve(pSymbol);
+		HSWriteLockGuard oLock(g_oHookLock);
+
+		if (pSrc == nullptr || g_oCellManager.FindContext((unsignedP)pSrc) == nullptr)
+		{
+			return false;
+		}
+
+		return RestoreCells(pSrc, nullptr);
+	}
+
+	bool HSHook::InstallCell(ptrAny* pCell, ptrAny pDst)
+	{
+		return InstallCellSlot(pCell, pDst, nullptr, nullptr);
+	}
+
+	bool HSHook::InstallCellSlot(ptrAny* pCell, ptrAny pDst, ptrAny* pHandleSrc, ptrAny* pSlot)
+	{
+		if (pCell == nullptr)
+		{
+			return false;
+		}
+
+		HSWriteLockGuard oLock(g_oHookLock);
+		ptrAny pSrc = *pCell;
+
+		if (!SwapCells(pSrc, pDst, std::vector<ptrAny*>{ pCell }, pSlot))
+		{
+			return false;
+		}
+
+		// Set only once the hook is in, a failed install leaves the handle as it was
+		if (pHandleSrc)
+		{
+			*pHandleSrc = pSrc;
+		}
+
+		return true;
+	}
+
+	bool HSHook::InstallShadowVtable(ptrAny pObject, unsigned32 uIndex, unsigned32 uNum, ptrAny pDst)
+	{
+		return InstallShadowSlot(pObject, uIndex, uNum, pDst, nullptr, nullptr);
+	}
+
+	bool HSHook::InstallShadowSlot(ptrAny pObject, unsigned32 uIndex, unsigned32 uNum, ptrAny pDst, ptrAny* pHandleSrc, ptrAny* pSlot)
+	{
+		if (pObject == nullptr || pDst == nullptr)
+		{
+			return false;
+		}
+
+		HSWriteLockGuard oLock(g_oHookLock);
+		ptrAny* pVptr = *(ptrAny**)pObject;
+		HSVtableCopy* pCopy = g_oVtableManager.FindContext((unsignedP)pObject);
+
+		// The object no longer points at its copy, it was destroyed and its memory reused. No call can
+		// still be on its way through the copy of a destroyed object
+		if (pCopy && pVptr != pCopy->pMem + HS_VTABLE_PREFIX)
+		{
+			delete[] pCopy->pMem;
+			g_oVtableManager.RemoveContext((unsignedP)pObject);
+			pCopy = nullptr;
+		}
+
+		if (pCopy)
+		{
+			if (uIndex >= pCopy->uNum)
+			{
+				return false;
+			}
+
+			if (pHandleSrc)
+			{
+				*pHandleSrc = pCopy->pVtable[uIndex];
+			}
+
+			if (pSlot)
+			{
+				*pSlot = pCopy->pVtable[uIndex];
+			}
+
+			HSStoreCell(&pCopy->pMem[HS_VTABLE_PREFIX + uIndex], pDst);
+			return true;
+		}
+
+		if (uIndex >= uNum || !g_oVtableManager.Reserve(1))
+		{
+			return false;
+		}
+
+		ptrAny* pMem = new (std::nothrow) ptrAny[HS_VTABLE_PREFIX + uNum];
+
+		if (pMem == nullptr)
+		{
+			return false;
+		}
+
+		memcpy(pMem, pVptr - HS_VTABLE_PREFIX, (HS_VTABLE_PREFIX + uNum) * sizeof(ptrAny));
+		pMem[HS_VTABLE_PREFIX + uIndex] = pDst;
+
+		// The handle is filled first, the replacement may run as soon as the vptr flips
+		if (pHandleSrc)
+		{
+			*pHandleSrc = pVptr[uIndex];
+		}
+
+		if (pSlot)
+		{
+			*pSlot = pVptr[uIndex];
+		}
+
+		g_oVtableManager.SetContext((unsignedP)pObject, HSVtableCopy{ pVptr, pMem, uNum });
+		HSStoreCell((ptrAny*)pObject, pMem + HS_VTABLE_PREFIX);
+		return true;
+	}
+
+	bool HSHook::RemoveShadowVtable(ptrAny pObject)
+	{
+		HSWriteLockGuard oLock(g_oHookLock);
+		HSVtableCopy* pCopy = g_oVtableManager.FindContext((unsignedP)pObject);
+
+		if (pCopy == nullptr)
+		{
+			return false;
+		}
+
+		if (*(ptrAny**)pObject == pCopy->pMem + HS_VTABLE_PREFIX)
+		{
+			HSStoreCell((ptrAny*)pObject, pCopy->pVtable);
+		}
+
+		// A thread may have loaded the old vptr for a call just before it moved back, the copy is
+		// freed once no epoch section that could still read it is open
+		HSEpochManager::Retire(pCopy->pMem, &HSFreeVtableCopy);
+		g_oVtableManager.RemoveContext((unsignedP)pObject);
+		HSEpochManager::Reclaim();
+		return true;
+	}
+
+	bool HSHook::SwapCells(ptrAny pSrc, ptrAny pDst, const std::vector<ptrAny*>& vecCells, ptrAny* pSlot)
+	{
+		if (pDst == nullptr || pSrc == pDst || vecCells.empty() || FindHook(pSrc) || g_oCellManager.FindContext((unsignedP)pSrc))
+		{
+			return false;
+		}
+
+		// Storing the hook and publishing the table happen after the swap and must not fail
+		if (!g_oCellManager.Reserve(1))
+		{
+			return false;
+		}
+
+		HSHookSnapshot* pSnapshot = HSAllocSnapshot(g_oStaticManager.GetCount() + g_oCellManager.GetCount() + 1);
+
+		if (pSnapshot == nullptr)
+		{
+			return false;
+		}
+
+		std::vector<HSProtRange> vecRanges;
+		std::vector<ptrAny> vecSaved;
+
+		for (ptrAny* pCell : vecCells)
+		{
+			vecRanges.push_back(HSProtRange{ pCell, sizeof(ptrAny) });
+			vecSaved.push_back(*pCell);
+		}
+
+		// Full RELRO leaves the GOT read-only after startup
+		if (!g_oProtManager.Unprotect(vecRanges.data(), (unsigned32)vecRanges.size()))
+		{
+			HSFreeSnapshot(pSnapshot);
+			return false;
+		}
+
+		// The handle is filled first, the replacement may run as soon as the first cell flips
+		if (pSlot)
+		{
+			*pSlot = pSrc;
+		}
+
+		for (ptrAny* pCell : vecCells)
+		{
+			HSStoreCell(pCell, pDst);
+		}
+
+		g_oProtManager.Restore(vecRanges.data(), (unsigned32)vecRanges.size());
+		g_oCellManager.SetContext((unsignedP)pSrc, HSCellContext{ pDst, pSlot, vecCells, std::move(vecSaved) });
+		HSPublishSnapshot(pSnapshot);
+		HSEpochManager::Reclaim();
+		return true;
+	}
+
+	bool HSHook::RestoreCells(ptrAny pSrc, ptrAny* pSlot)
+	{
+		HSCellContext* pContext = g_oCellManager.FindContext((unsignedP)pSrc);
+
+		if (pSlot && pContext->pSlot != pSlot)
+		{
+			return false;
+		}
+
+		HSHookSnapshot* pSnapshot = HSAllocSnapshot(g_oStaticManager.GetCount() + g_oCellManager.GetCount() - 1);
+
+		if (pSnapshot == nullptr)
+		{
+			return false;
+		}
+
+		std::vector<HSProtRange> vecRanges;
+
+		for (ptrAny* pCell : pContext->vecCells)
+		{
+			vecRanges.push_back(HSProtRange{ pCell, sizeof(ptrAny) });
+		}
+
+		if (!g_oProtManager.Unprotect(vecRanges.data(), (unsigned32)vecRanges.size()))
+		{
+			HSFreeSnapshot(pSnapshot);
+			return false;
+		}
+
+		// A cell someone else re-pointed since is theirs now and stays as it is
+		for (size_t i = 0; i < pContext->vecCells.size(); i++)
+		{
+			if (*pContext->vecCells[i] == pContext->pDst)
+			{
+				HSStoreCell(pContext->vecCells[i], pContext->vecSaved[i]);
+			}
+		}
+
+		g_oProtManager.Restore(vecRanges.data(), (unsigned32)vecRanges.size());
+
+		if (pContext->pSlot)
+		{
+			*pContext->pSlot = pSrc;
+		}
+
+		g_oCellManager.RemoveContext((unsignedP)pSrc);
+		HSPublishSnapshot(pSnapshot);
+		HSEpochManager::Reclaim();
+		return true;
+	}
+
+	HSHook::Transaction::Transaction() : m_bActive(false)
+	{
+	}
+
+	HSHook::Transaction::~Transaction()
+	{
+		Abort();
+	}
+
+	void HSHook::Transaction::Begin()
+	{
+		m_vecOps.clear();
+		m_bActive = true;
+	}
+
+	bool HSHook::Transaction::Add(ptrAny pSrc, ptrAny pDst)
+	{
+		return AddSlot(pSrc, pDst, nullptr, 0);
+	}
+
+	bool HSHook::Transaction::AddSlot(ptrAny pSrc, ptrAny pDst, ptrAny* pSlot, signed32 sPriority)
+	{
+		if (!m_bActive || pSrc == nullptr || pDst == nullptr || pSrc == pDst)
+		{
+			return false;
+		}
+
+		m_vecOps.push_back(HSHookOp{ pSrc, pDst, pSlot, sPriority, false, nullptr });
+		return true;
+	}
+
+	bool HSHook::Transaction::Remove(ptrAny pSrc)
+	{
+		return RemoveSlot(pSrc, nullptr);
+	}
+
+	bool HSHook::Transaction::RemoveSlot(ptrAny pSrc, ptrAny* pSlot)
+	{
+		if (!m_bActive || pSrc == nullptr)
+		{
+			return false;
+		}
+
+		m_vecOps.push_back(HSHookOp{ pSrc, nullptr, pSlot, 0, true, nullptr });
+		return true;
+	}
+
+	bool HSHook::Transaction::Commit()
+	{
+		if (!m_bActive)
+		{
+			return false;
+		}
+
+		bool bResult = true;
+
+		if (!m_vecOps.empty())
+		{
+			HSWriteLockGuard oLock(g_oHookLock);
+			bResult = ApplyOps(m_vecOps.data(), (unsigned32)m_vecOps.size());
+		}
+
+		Abort();
+		return bResult;
+	}
+
+	void HSHook::Transaction::Abort()
+	{
+		m_vecOps.clear();
+		m_bActive = false;
+	}
+
+	bool HSHook::ToggleHooks(const std::vector<ptrAny>& vecSrc, bool bEnable)
+	{
+		std::vector<ptrAny> vecChange;
+		std::vector<HSProtRange> vecRanges;
+		std::vector<HSPatchSite> vecSites;
+
+		for (ptrAny pSrc : vecSrc)
+		{
+			HSStaticContext* pContext = FindHook(pSrc);
+
+			if (pContext == nullptr)
+			{
+				return false;
+			}
+
+			if (pContext->bEnabled == bEnable)
+			{
+				continue;
+			}
+
+			vecChange.push_back(pSrc);
+			vecRanges.push_back(HSProtRange{ pContext->pPatch, pContext->uSize });
+
+			// Everything is already built, toggling only writes the jump or the saved bytes back
+			if (bEnable)
+			{
+				AddPatchSites(pSrc, pContext->pPatch, pContext->uJmpSize, pContext->pPatchCode, GetEntryTarget(*pContext), vecSites);
+			}
+			else
+			{
+				AddRestoreSites(pSrc, *pContext, vecSites);
+			}
+		}
+
+		if (vecChange.empty())
+		{
+			return true;
+		}
+
+		if (!HSPatcher::Prepare(g_ePatchMode) || !g_oProtManager.Unprotect(vecRanges.data(), (unsigned32)vecRanges.size()))
+		{
+			return false;
+		}
+
+		if (g_ePatchMode == HSPatchMode_Quiesce && !HSPatcher::Stop())
+		{
+			g_oProtManager.Restore(vecRanges.data(), (unsigned32)vecRanges.size());
+			return false;
+		}
+
+		HSPatcher::Apply(vecSites.data(), (unsigned32)vecSites.size(), g_ePatchMode);
+
+		if (g_ePatchMode == HSPatchMode_Quiesce)
+		{
+			for (unsigned32 t = 0; t < HSPatcher::GetStoppedNum(); t++)
+			{
+				unsignedP* pIp = HSPatcher::GetStoppedIp(t);
+
+				for (ptrAny pSrc : vecChange)
+				{
+					HSStaticContext* pContext = FindHook(pSrc);
+
+					// The trampoline stays resident, only the padding has to be left on disable
+					*pIp = bEnable ? MoveFromStolen(pSrc, pContext->pPatch, pContext->pMem, pContext->stMap, *pIp)
+						: MoveFromTrampoline(pSrc, *pContext, *pIp);
+				}
+			}
+
+			HSPatcher::Resume();
+		}
+
+		for (ptrAny pSrc : vecChange)
+		{
+			FindHook(pSrc)->bEnabled = bEnable;
+		}
+
+		g_oProtManager.Restore(vecRanges.data(), (unsigned32)vecRanges.size());
+		return true;
+	}
+
+	HSHook::Group::Group() : m_bEnabled(false)
+	{
+	}
+
+	HSHook::Group::~Group()
+	{
+		Clear();
+	}
+
+	bool HSHook::Group::Add(ptrAny pSrc, ptrAny pDst)
+	{
+		return AddSlot(pSrc, pDst, nullptr);
+	}
+
+	bool HSHook::Group::AddSlot(ptrAny pSrc, ptrAny pDst, ptrAny* pSlot)
+	{
+		if (m_bEnabled)
+		{
+			return false;
+		}
+
+		HSHookOp stOp = { pSrc, pDst, pSlot, 0, false, this };
+
+		{
+			HSWriteLockGuard oLock(g_oHookLock);
+
+			if (!ApplyOps(&stOp, 1))
+			{
+				return false;
+			}
+		}
+
+		m_vecSrc.push_back(pSrc);
+		return true;
+	}
+
+	bool HSHook::Group::Enable()
+	{
+		return SetEnabled(true);
+	}
+
+	bool HSHook::Group::Disable()
+	{
+		return SetEnabled(false);
+	}
+
+	bool HSHook::Group::IsEnabled() const
+	{
+		return m_bEnabled;
+	}
+
+	bool HSHook::Group::SetEnabled(bool bEnable)
+	{
+		if (m_bEnabled == bEnable)
+		{
+			return true;
+		}
+
+		HSWriteLockGuard oLock(g_oHookLock);
+
+		if (!ToggleHooks(m_vecSrc, bEnable))
+		{
+			return false;
+		}
+
+		m_bEnabled = bEnable;
+		return true;
+	}
+
+	bool HSHook::Group::Clear()
+	{
+		std::vector<HSHookOp> vecOps;
+
+		for (ptrAny pSrc : m_vecSrc)
+		{
+			vecOps.push_back(HSHookOp{ pSrc, nullptr, nullptr, 0, true, this });
+		}
+
+		if (!vecOps.empty())
+		{
+			HSWriteLockGuard oLock(g_oHookLock);
+
+			if (!ApplyOps(vecOps.data(), (unsigned32)vecOps.size()))
+			{
+				return false;
+			}
+		}
+
+		m_vecSrc.clear();
+		m_bEnabled = false;
+		return true;
+	}
+
+#if defined(HS_HAS_STUBS)
+	bool HSHook::Stats::Enable(ptrAny pSrc)
+	{
+		HSWriteLockGuard oLock(g_oHookLock);
+		HSStaticContext* pContext = FindHook(pSrc);
+
+		if (pContext == nullptr)
+		{
+			return false;
+		}
+
+		if (pContext->bStats)
+		{
+			return true;
+		}
+
+		unsigned32 uId = HSStatsManager::Find(pSrc);
+
+		if (uId == HSStatsManager::HS_STATS_INVALID)
+		{
+			ptrU8 pMem = HSAllocShadowStub();
+
+			if (pMem == nullptr)
+			{
+				return false;
+			}
+
+			uId = HSStatsManager::Bind(pSrc, pMem);
+
+			if (uId == HSStatsManager::HS_STATS_INVALID)
+			{
+				g_oTrampolinePool.Free(pMem);
+				return false;
+			}
+		}
+
+		HookUnwinders();
+
+		// The stub must lead somewhere valid before the entry jump reaches it
+		pContext->uStatsId = uId;
+		HSStatsManager::SetNext(uId, pContext->vecLinks[0].pDst);
+
+		if (!RetargetPastFilter(*pContext, HSStatsManager::GetStub(uId)))
+		{
+			return false;
+		}
+
+		pContext->bStats = true;
+		return true;
+	}
+
+	bool HSHook::Stats::Disable(ptrAny pSrc)
+	{
+		HSWriteLockGuard oLock(g_oHookLock);
+		HSStaticContext* pContext = FindHook(pSrc);
+
+		if (pContext == nullptr)
+		{
+			return false;
+		}
+
+		if (!pContext->bStats)
+		{
+			return true;
+		}
+
+		if (!RetargetPastFilter(*pContext, pContext->vecLinks[0].pDst))
+		{
+			return false;
+		}
+
+		pContext->bStats = false;
+		return true;
+	}
+
+	bool HSHook::Stats::Read(ptrAny pSrc, HSHookStats& stStats)
+	{
+		HSReadLockGuard oLock(g_oHookLock);
+		unsigned32 uId = HSStatsManager::Find(pSrc);
+
+		if (uId == HSStatsManager::HS_STATS_INVALID)
+		{
+			return false;
+		}
+
+		HSStatsManager::Read(uId, stStats);
+		return true;
+	}
+
+	bool HSHook::Stats::Export(const char* pPath)
+	{
+		HSWriteLockGuard oLock(g_oHookLock);
+		return HSStatsManager::Export(pPath);
+	}
+
+	bool HSHook::SetFilter(ptrAny pSrc, const HSFilter* pFilters, unsigned32 uNum)
+	{
+		unsigned8 pScratch[HSFilterManager::HS_FILTER_MAX_CODE_SIZE];
+		HSWriteLockGuard oLock(g_oHookLock);
+		HSStaticContext* pContext = FindHook(pSrc);
+
+		if (pContext == nullptr || pFilters == nullptr)
+		{
+			return false;
+		}
+
+		HSFilterData* pData = new (std::nothrow) HSFilterData();
+
+		if (pData == nullptr)
+		{
+			return false;
+		}
+
+		// Emit once at a scratch position only to validate the filters and learn the stub size
+		unsigned32 uSize = HSFilterManager::Emit(pFilters, uNum, pScratch, pData);
+		ptrU8 pStub = uSize ? (ptrU8)g_oTrampolinePool.Alloc(uSize) : nullptr;
+
+		if (pStub == nullptr)
+		{
+			delete pData;
+			return false;
+		}
+
+		HSFilterManager::Emit(pFilters, uNum, pStub, pData);
+		pData->pNext = pContext->bStats ? HSStatsManager::GetStub(pContext->uStatsId) : pContext->vecLinks[0].pDst;
+		pData->pFail = pContext->pOriginal;
+
+		if (!RetargetEntry(*pContext, pStub))
+		{
+			g_oTrampolinePool.Free(pStub);
+			delete pData;
+			return false;
+		}
+
+		// A replaced stub stays mapped, a preempted thread may still be inside it
+		pContext->pFilter = pData;
+		pContext->pFilterStub = pStub;
+		return true;
+	}
+
+	bool HSHook::ClearFilter(ptrAny pSrc)
+	{
+		HSWriteLockGuard oLock(g_oHookLock);
+		HSStaticContext* pContext = FindHook(pSrc);
+
+		if (pContext == nullptr)
+		{
+			return false;
+		}
+
+		if (pContext->pFilterStub == nullptr)
+		{
+			return true;
+		}
+
+		if (!RetargetEntry(*pContext, pContext->bStats ? HSStatsManager::GetStub(pContext->uStatsId) : pContext->vecLinks[0].pDst))
+		{
+			return false;
+		}
+
+		pContext->pFilter = nullptr;
+		pContext->pFilterStub = nullptr;
+		return true;
+	}
+
+	void HSHook::HookUnwinders()
+	{
+		if (g_bUnwindersHooked)
+		{
+			return;
+		}
+
+		g_bUnwindersHooked = true;
+
+		// One at a time, a runtime without some of them or one that cannot be hooked still gets the rest
+		for (unsigned32 i = 0; i < HSShadowStack::HS_SHADOW_UNWINDER_NUM; i++)
+		{
+			ptrAny pUnwinder = HSShadowStack::GetUnwinder(i);
+
+			if (pUnwinder)
+			{
+				HSHookOp stOp = { pUnwinder, HSShadowStack::GetUnwindDetour(i), HSShadowStack::GetUnwindSlot(i), 0, false, nullptr };
+				ApplyOps(&stOp, 1);
+			}
+		}
+	}
+
+	bool HSHook::IsExitLinked(ptrAny pSrc, HSExitRecord* pRecord)
+	{
+		HSStaticContext* pContext = FindHook(pSrc);
+
+		if (pContext == nullptr || pRecord == nullptr)
+		{
+			return false;
+		}
+
+		for (const HSHookLink& stLink : pContext->vecLinks)
+		{
+			if (stLink.pSlot == &pRecord->stOwner.pNext)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool HSHook::SetExitHook(ptrAny pSrc, HSExitCallback pfnExit, ptrAny pUser)
+	{
+		if (pSrc == nullptr || pfnExit == nullptr)
+		{
+			return false;
+		}
+
+		unsigned64 uCallback = (unsigned64)(unsignedP)pfnExit | ((unsigned64)(unsignedP)pUser << 32);
+		HSWriteLockGuard oLock(g_oHookLock);
+		HSExitRecord* pRecord = HSFindExitRecord(pSrc);
+
+		if (IsExitLinked(pSrc, pRecord))
+		{
+			pRecord->uCallback.store(uCallback, std::memory_order_release);
+			return true;
+		}
+
+		if (pRecord == nullptr)
+		{
+			if (g_uExitNum >= HS_EXIT_MAX_HOOKS)
+			{
+				return false;
+			}
+
+			ptrU8 pStub = HSAllocShadowStub();
+
+			if (pStub == nullptr)
+			{
+				return false;
+			}
+
+			// A target keeps its record and stub for the process lifetime, a thread may still be inside the stub
+			pRecord = &g_aExitRecords[g_uExitNum++];
+			pRecord->stOwner = HSShadowOwner{ pSrc, nullptr, &HSExitLeave };
+			pRecord->pSrc = pSrc;
+			pRecord->pStub = pStub;
+			HSShadowStack::WriteStub(pStub, &pRecord->stOwner);
+		}
+
+		HookUnwinders();
+		pRecord->uCallback.store(uCallback, std::memory_order_release);
+
+		HSHookOp stOp = { pSrc, pRecord->pStub, &pRecord->stOwner.pNext, HS_EXIT_PRIORITY, false, nullptr };
+
+		if (!ApplyOps(&stOp, 1))
+		{
+			pRecord->uCallback.store(0, std::memory_order_release);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool HSHook::ClearExitHook(ptrAny pSrc)
+	{
+		HSWriteLockGuard oLock(g_oHookLock);
+		HSExitRecord* pRecord = HSFindExitRecord(pSrc);
+
+		if (pRecord == nullptr)
+		{
+			return false;
+		}
+
+		if (IsExitLinked(pSrc, pRecord))
+		{
+			HSHookOp stOp = { pSrc, nullptr, &pRecord->stOwner.pNext, 0, true, nullptr };
+
+			if (!ApplyOps(&stOp, 1))
+			{
+				return false;
+			}
+		}
+
+		// Calls already inside the target still return through the thunk and find no callback
+		pRecord->uCallback.store(0, std::memory_order_release);
+		return true;
+	}
+#endif
 }
 
 #endif
\ No newline at end of file
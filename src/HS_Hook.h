@@ -1,19 +1,108 @@
 #pragma once
-#if defined(_M_IX86) || defined(__i386__)
+#if defined(_M_IX86) || defined(__i386__) || defined(_M_X64) || defined(__x86_64__)
 #include "HS_Type.h"
+#include "HS_Pool.h"
+#include "HS_Patch.h"
+#include "HS_Stats.h"
+#include "HS_Filter.h"
+#include "HS_Epoch.h"
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <string.h>
 
 #if defined(_MSC_VER)
 #define HS_NOINLINE __declspec(noinline)
 #define HS_CDECL __cdecl
 #elif defined(__GNUC__) || defined(__clang__)
 #define HS_NOINLINE __attribute__((noinline))
+#if defined(__i386__)
 #define HS_CDECL __attribute__((cdecl))
+#else
+#define HS_CDECL
+#endif
+#endif
+
+// Stats, filters and exit hooks run generated stubs that exist as i386 code only
+#if defined(_M_IX86) || defined(__i386__)
+#define HS_HAS_STUBS 1
+#endif
+
+#if (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L) || __cplusplus >= 201703L
+#define HS_HAS_STATIC_HOOK 1
 #endif
 
 namespace HSLL
 {
 	struct HSInsInfo;
 	struct HSStaticContext;
+	struct HSHookPlan;
+	struct HSFlowInfo;
+	struct HSLinkOp;
+	struct HSInsMap;
+	struct HSExitRecord;
+
+	struct HSHookOp
+	{
+		ptrAny pSrc;        // Target function
+		ptrAny pDst;        // Replacement function, unused for removal
+		ptrAny* pSlot;      // Receives the next link or the trampoline, for removal the link to take out, may be null
+		signed32 sPriority; // Position in the chain of an already hooked target, higher runs first
+		bool bRemove;       // Whether this operation removes the hook or the link on pSrc
+		ptrAny pGroup;      // Owning hook group, null for ordinary hooks
+	};
+
+#if defined(HS_HAS_STUBS)
+	struct HSExitInfo
+	{
+		ptrAny pSrc;        // Target that returned
+		ptrAny pRet;        // Return address in the caller
+		unsignedP uEax;     // Return value, the caller receives whatever the callback leaves here
+		unsignedP uEdx;     // High half of a 64-bit return value
+		unsigned64 uCycles; // rdtsc ticks from entry to return, detours included
+	};
+
+	using HSExitCallback = void(*)(HSExitInfo& stInfo, ptrAny pUser);
+#endif
+
+	/**
+	 * @brief Typed handle to the original function of an installed hook
+	 * @details Holds the trampoline address directly, so calling through it is a single
+	 *          indirect call with no lock or table lookup. The hook keeps a reference to
+	 *          the handle until it is removed, after which the handle points back at the
+	 *          unhooked function. The handle must outlive the hook.
+	 */
+	template<class T>
+	class HSHookHandle
+	{
+	public:
+		HSHookHandle() : m_pSrc(nullptr), m_pOriginal(nullptr) {}
+
+		T* Original() const
+		{
+			return (T*)m_pOriginal;
+		}
+
+		template<class... Args>
+		auto operator()(Args&&... args) const -> decltype(((T*)nullptr)(std::forward<Args>(args)...))
+		{
+			return ((T*)m_pOriginal)(std::forward<Args>(args)...);
+		}
+
+		bool IsInstalled() const
+		{
+			return m_pOriginal != nullptr && m_pOriginal != m_pSrc;
+		}
+
+		HSHookHandle(const HSHookHandle&) = delete;
+		HSHookHandle& operator=(const HSHookHandle&) = delete;
+
+	private:
+		friend class HSHook;
+
+		ptrAny m_pSrc;
+		ptrAny m_pOriginal;
+	};
 
 	class HSHook
 	{
@@ -22,38 +111,473 @@ namespace HSLL
 
 		static bool Remove(ptrAny pSrc);
 
+		/**
+		 * @brief Installs a hook whose original is reached through a handle
+		 * @details A target that is already hooked through handles gets one more link in its
+		 *          dispatch chain instead of failing. Links run from the highest priority down,
+		 *          each handle holds the next link and the last one holds the trampoline, so a
+		 *          call passes every detour with one indirect jump per link and no lookup.
+		 */
+		template<class T>
+		static bool Install(T* pSrc, T* pDst, HSHookHandle<T>& oHandle, signed32 sPriority = 0)
+		{
+			oHandle.m_pSrc = (ptrAny)pSrc;
+			return InstallSlot((ptrAny)pSrc, (ptrAny)pDst, &oHandle.m_pOriginal, sPriority);
+		}
+
+		/**
+		 * @brief Removes only the link installed through this handle
+		 * @details The rest of the chain stays hooked, removing the last link unhooks the target.
+		 */
+		template<class T>
+		static bool Remove(HSHookHandle<T>& oHandle)
+		{
+			return RemoveSlot(oHandle.m_pSrc, &oHandle.m_pOriginal);
+		}
+
+		/**
+		 * @brief Installs a hook on a function named in a loaded module
+		 * @details The name is looked up through the module's symbol index (HSSymbolIndex), built once
+		 *          per module, so local functions that dlsym cannot see are found as well. pModule is
+		 *          a path or file name, null selects the main program. The hook is an ordinary inline
+		 *          hook on the resolved address.
+		 */
+		static bool InstallByName(const char* pModule, const char* pSymbol, ptrAny pDst);
+
+		template<class T>
+		static bool InstallByName(const char* pModule, const char* pSymbol, T* pDst, HSHookHandle<T>& oHandle, signed32 sPriority = 0)
+		{
+			return InstallByNameSlot(pModule, pSymbol, (ptrAny)pDst, &oHandle.m_pSrc, &oHandle.m_pOriginal, sPriority);
+		}
+
+		/**
+		 * @brief Resolves every name in one pass and installs all hooks as one all-or-nothing batch
+		 */
+		static bool InstallByName(const char* pModule, const char* const* pSymbols, const ptrAny* pDsts, unsigned32 uNum);
+
+		/**
+		 * @brief Looks up many names of one module in one pass, pAddrs[i] is null for a name not found
+		 */
+		static bool ResolveNames(const char* pModule, const char* const* pSymbols, unsigned32 uNum, ptrAny* pAddrs);
+
+		/**
+		 * @brief Returns the callable original of a target, the target itself when it is not hooked
+		 */
 		template<class T>
 		static T* Original(T* pSrc)
 		{
-			return (T*)FindHookSrc(pSrc);
+			return (T*)FindHookSrc((ptrAny)pSrc);
+		}
+
+		/**
+		 * @brief Hooks an imported function by swapping the GOT entries that call it
+		 * @details Every loaded module that calls pSymbol through its PLT gets its entry pointed at
+		 *          pDst with one aligned store. No code is decoded or patched and no trampoline is
+		 *          built, so other threads may keep calling the function during Install and Remove.
+		 *          The hook is keyed on the address dlsym returns for the name: Original, the handle
+		 *          and Remove take that address, Original returns the function itself, so a handle's
+		 *          IsInstalled reports false. Calls through GLOB_DAT entries (-fno-plt or a taken
+		 *          address), calls inside the defining module that bypass its PLT and modules loaded
+		 *          after Install are not redirected. A target cannot have an inline hook and an
+		 *          import hook at once. ELF only.
+		 */
+		static bool InstallImport(const char* pSymbol, ptrAny pDst);
+
+		template<class T>
+		static bool InstallImport(const char* pSymbol, T* pDst, HSHookHandle<T>& oHandle)
+		{
+			return InstallImportSlot(pSymbol, (ptrAny)pDst, &oHandle.m_pSrc, &oHandle.m_pOriginal);
+		}
+
+		static bool RemoveImport(const char* pSymbol);
+
+		/**
+		 * @brief Hooks one vtable or function-table entry by swapping the pointer it holds
+		 * @details The entry is pointed at pDst with one aligned store after its page is unlocked
+		 *          like a patched code page, so the function needs no decodable prologue and may be
+		 *          called meanwhile. Every caller going through the table is redirected, calls that
+		 *          reach the function any other way are not. The hook is keyed on the function the
+		 *          entry held: Original returns it, Remove takes it or the handle and writes it back.
+		 *          One entry per function, the same function in a second table cannot be hooked too.
+		 */
+		static bool InstallCell(ptrAny* pCell, ptrAny pDst);
+
+		template<class T>
+		static bool InstallCell(ptrAny* pCell, T* pDst, HSHookHandle<T>& oHandle)
+		{
+			return InstallCellSlot(pCell, (ptrAny)pDst, &oHandle.m_pSrc, &oHandle.m_pOriginal);
+		}
+
+		/**
+		 * @brief Gives one object a private copy of its vtable with entry uIndex replaced
+		 * @details Only this object is instrumented, other instances keep the shared vtable. uNum is
+		 *          the number of virtual function entries to copy. The RTTI words in front of the
+		 *          address point are copied along, so typeid and dynamic_cast keep working, classes
+		 *          with virtual bases are not supported. Later calls for the same object replace more
+		 *          entries of the same copy. The copy and the handle keep the shared entries as they
+		 *          were when the copy was made, a cell hook added or removed later does not reach
+		 *          them. The vptr is swapped with one aligned store. Remove the copy before the
+		 *          object is destroyed. A removed copy is freed after the epoch grace period, a call
+		 *          that can race the removal holds an HSEpochGuard so the copy outlives it.
+		 */
+		static bool InstallShadowVtable(ptrAny pObject, unsigned32 uIndex, unsigned32 uNum, ptrAny pDst);
+
+		template<class T>
+		static bool InstallShadowVtable(ptrAny pObject, unsigned32 uIndex, unsigned32 uNum, T* pDst, HSHookHandle<T>& oHandle)
+		{
+			return InstallShadowSlot(pObject, uIndex, uNum, (ptrAny)pDst, &oHandle.m_pSrc, &oHandle.m_pOriginal);
 		}
 
+		static bool RemoveShadowVtable(ptrAny pObject);
+
+		static void GetPoolStats(HSPoolStats& stStats);
+
+		/**
+		 * @brief Selects how Install/Remove write code bytes
+		 * @details HSPatchMode_Live lets other threads keep calling the target while it is patched.
+		 *          It does not help a thread that is already past the first patched instruction.
+		 *          HSPatchMode_Quiesce parks every other thread and moves any that stopped inside
+		 *          the patched bytes or a trampoline being removed (Linux only).
+		 */
+		static void SetPatchMode(HSPatchMode eMode);
+
+		static HSPatchMode GetPatchMode();
+
+		/**
+		 * @brief Returns false while a patched code page could not be made read-only again
+		 * @details A patch is complete once its bytes are written, a failed re-protect does not
+		 *          undo it or fail the call. The page stays writable and every later patch tries
+		 *          to put it back.
+		 */
+		static bool IsCodeProtected();
+
+#if defined(HS_HAS_STUBS)
+		/**
+		 * @brief Puts a generated filter stub in front of a hooked target's detours
+		 * @details Every filter must pass for a call to reach the detours (and the stats stub),
+		 *          any other call jumps straight to the trampoline after a few instructions and
+		 *          no C++ code. Filters run in array order, so an EveryNth after an ArgRange
+		 *          counts only the calls that matched the range. Setting a new filter replaces
+		 *          the previous one.
+		 */
+		static bool SetFilter(ptrAny pSrc, const HSFilter* pFilters, unsigned32 uNum);
+
+		static bool ClearFilter(ptrAny pSrc);
+
+		/**
+		 * @brief Calls pfnExit each time the target returns to its caller
+		 * @details The target needs no detour of its own. A generated stub becomes the first
+		 *          link of its chain, it saves the return address on a per-thread shadow stack and
+		 *          sends the return through a shared thunk that runs the callback. Recursion, longjmp
+		 *          and C++ exceptions leave the shadow stack consistent, calls left by a longjmp or
+		 *          an exception are simply not reported. Targets hooked without a handle or in a
+		 *          group are rejected, calls a filter rejects are not seen. The callback must not
+		 *          throw, and must not do floating-point math when the target returns float or
+		 *          double. Setting it again replaces the callback. Up to 64 targets.
+		 */
+		static bool SetExitHook(ptrAny pSrc, HSExitCallback pfnExit, ptrAny pUser = nullptr);
+
+		static bool ClearExitHook(ptrAny pSrc);
+#endif
+
+#if defined(HS_HAS_STATIC_HOOK)
+		/**
+		 * @brief Hook bound at compile time to one target function
+		 * @details The target's full type, calling convention included, is part of the
+		 *          template argument, so a replacement with a different signature or
+		 *          convention does not compile. The trampoline lives in a static slot
+		 *          dedicated to the target, which makes Original a direct load and call.
+		 *          Member function targets must be non-virtual, Original takes the object
+		 *          pointer as its first argument.
+		 */
+		template<auto pFunc>
+		class Static
+		{
+		public:
+			using Type = decltype(pFunc);
+
+			static_assert(std::is_member_function_pointer<Type>::value
+				|| (std::is_pointer<Type>::value && std::is_function<typename std::remove_pointer<Type>::type>::value),
+				"HSHook::Static requires a function or member function address");
+
+			static bool Install(Type pDst, signed32 sPriority = 0)
+			{
+				ptrAny pSrc = ToAddress(pFunc);
+				ptrAny pNew = ToAddress(pDst);
+
+				if (pSrc == nullptr || pNew == nullptr)
+				{
+					return false;
+				}
+
+				return InstallSlot(pSrc, pNew, &s_pOriginal, sPriority);
+			}
+
+			static bool Remove()
+			{
+				return RemoveSlot(ToAddress(pFunc), &s_pOriginal);
+			}
+
+			static Type Get()
+			{
+				if constexpr (std::is_member_function_pointer<Type>::value)
+				{
+					Type pOriginal{};
+					memcpy(&pOriginal, &s_pOriginal, sizeof(ptrAny));
+					return pOriginal;
+				}
+				else
+				{
+					return (Type)s_pOriginal;
+				}
+			}
+
+			template<class... Args>
+			static decltype(auto) Original(Args&&... args)
+			{
+				if constexpr (std::is_member_function_pointer<Type>::value)
+				{
+					return CallMember(std::forward<Args>(args)...);
+				}
+				else
+				{
+					return ((Type)s_pOriginal)(std::forward<Args>(args)...);
+				}
+			}
+
+		private:
+			static inline ptrAny s_pOriginal = nullptr;
+
+			template<class C, class... Args>
+			static decltype(auto) CallMember(C* pThis, Args&&... args)
+			{
+				return (pThis->*Get())(std::forward<Args>(args)...);
+			}
+
+			static ptrAny ToAddress(Type pTarget)
+			{
+				if constexpr (std::is_member_function_pointer<Type>::value)
+				{
+					ptrAny pAddr;
+					memcpy(&pAddr, &pTarget, sizeof(ptrAny));
+
+#if defined(__GNUC__) || defined(__clang__)
+					// Itanium ABI marks virtual member pointers with an odd vtable offset
+					if ((unsignedP)pAddr & 1)
+					{
+						return nullptr;
+					}
+#endif
+					return pAddr;
+				}
+				else
+				{
+					return (ptrAny)pTarget;
+				}
+			}
+		};
+#endif
+
+		/**
+		 * @brief Installs and removes a set of hooks as one all-or-nothing batch
+		 * @details Commit decodes and validates every operation first, allocates all
+		 *          trampolines, unlocks the affected pages in one pass and applies every
+		 *          patch under a single write lock. If anything fails nothing is changed.
+		 */
+		class Transaction
+		{
+		public:
+			Transaction();
+
+			~Transaction();
+
+			void Begin();
+
+			bool Add(ptrAny pSrc, ptrAny pDst);
+
+			template<class T>
+			bool Add(T* pSrc, T* pDst, HSHookHandle<T>& oHandle, signed32 sPriority = 0)
+			{
+				oHandle.m_pSrc = (ptrAny)pSrc;
+				return AddSlot((ptrAny)pSrc, (ptrAny)pDst, &oHandle.m_pOriginal, sPriority);
+			}
+
+			bool Remove(ptrAny pSrc);
+
+			template<class T>
+			bool Remove(HSHookHandle<T>& oHandle)
+			{
+				return RemoveSlot(oHandle.m_pSrc, &oHandle.m_pOriginal);
+			}
+
+			bool Commit();
+
+			void Abort();
+
+			Transaction(const Transaction&) = delete;
+			Transaction& operator=(const Transaction&) = delete;
+
+		private:
+			bool AddSlot(ptrAny pSrc, ptrAny pDst, ptrAny* pSlot, signed32 sPriority);
+
+			bool RemoveSlot(ptrAny pSrc, ptrAny* pSlot);
+
+			bool m_bActive;
+			std::vector<HSHookOp> m_vecOps;
+		};
+
+		/**
+		 * @brief Set of hooks that stay resident and are switched on and off together
+		 * @details Add decodes, relocates and builds each hook up front while the group is
+		 *          disabled. Enable and Disable then only write the prepared jumps or the saved
+		 *          bytes back, for the whole group under one lock and one protection pass.
+		 *          Trampolines and handles stay valid while disabled. Targets in a group cannot
+		 *          be hooked or removed outside it. Not thread-safe, the caller serializes access.
+		 */
+		class Group
+		{
+		public:
+			Group();
+
+			~Group();
+
+			bool Add(ptrAny pSrc, ptrAny pDst);
+
+			template<class T>
+			bool Add(T* pSrc, T* pDst, HSHookHandle<T>& oHandle)
+			{
+				oHandle.m_pSrc = (ptrAny)pSrc;
+				return AddSlot((ptrAny)pSrc, (ptrAny)pDst, &oHandle.m_pOriginal);
+			}
+
+			bool Enable();
+
+			bool Disable();
+
+			bool IsEnabled() const;
+
+			bool Clear();
+
+			Group(const Group&) = delete;
+			Group& operator=(const Group&) = delete;
+
+		private:
+			bool AddSlot(ptrAny pSrc, ptrAny pDst, ptrAny* pSlot);
+
+			bool SetEnabled(bool bEnable);
+
+			bool m_bEnabled;
+			std::vector<ptrAny> m_vecSrc;
+		};
+
+#if defined(HS_HAS_STUBS)
+		/**
+		 * @brief Opt-in call counters and latency histograms per hooked target
+		 * @details Enable puts a generated stub in front of the target's detour chain. It counts
+		 *          every call and times it from entry to return with rdtsc into per-thread cells,
+		 *          so instrumented calls never share a cache line. Read sums all threads without
+		 *          pausing them, Export writes the same sums into a shared-memory file for a
+		 *          sidecar. Counts survive Disable and Remove. Up to 64 targets can be instrumented.
+		 */
+		class Stats
+		{
+		public:
+			static bool Enable(ptrAny pSrc);
+
+			static bool Disable(ptrAny pSrc);
+
+			static bool Read(ptrAny pSrc, HSHookStats& stStats);
+
+			static bool Export(const char* pPath);
+		};
+#endif
+
 	private:
-		static bool SetProt(ptrAny pMem, unsigned32 uSize, unsigned32 uProt);
+		static bool InstallSlot(ptrAny pSrc, ptrAny pDst, ptrAny* pSlot, signed32 sPriority);
+
+		static bool RemoveSlot(ptrAny pSrc, ptrAny* pSlot);
+
+		static bool InstallByNameSlot(const char* pModule, const char* pSymbol, ptrAny pDst, ptrAny* pHandleSrc, ptrAny* pSlot, signed32 sPriority);
+
+		static bool InstallImportSlot(const char* pSymbol, ptrAny pDst, ptrAny* pHandleSrc, ptrAny* pSlot);
 
-		static bool MemFree(ptrAny pMem);
+		static bool InstallCellSlot(ptrAny* pCell, ptrAny pDst, ptrAny* pHandleSrc, ptrAny* pSlot);
 
-		static ptrAny MemAlloc(unsigned32 uSize, unsigned32 uProt);
+		static bool InstallShadowSlot(ptrAny pObject, unsigned32 uIndex, unsigned32 uNum, ptrAny pDst, ptrAny* pHandleSrc, ptrAny* pSlot);
+
+		static bool SwapCells(ptrAny pSrc, ptrAny pDst, const std::vector<ptrAny*>& vecCells, ptrAny* pSlot);
+
+		static bool RestoreCells(ptrAny pSrc, ptrAny* pSlot);
 
 	private:
 		static unsigned32 GetInsSize(HSInsInfo* pInfo, unsigned32 uNum);
 
-		static bool GetBackupIns(ptrAny pIns, HSInsInfo* pInfo, unsigned32& uNum);
+		static bool GetBackupIns(ptrAny pIns, HSInsInfo* pInfo, unsigned32& uNum, unsigned32 uMinSize);
+
+		static bool GetFixedIns(ptrAny pIns, HSInsInfo* pInfo, unsigned32 uNum, ptrAny pFixedIns, ptrAny pFixedPos, HSInsInfo* pFixedInfo);
+
+		static void WriteJmp(ptrU8 pCode, ptrU8 pPos, ptrAny pDst, unsigned32 uSize);
+
+		static bool EncodeJmp(ptrU8 pCode, ptrU8 pPos, ptrAny pDst, unsigned32 uSize, ptrAny& pRelay);
+
+		static bool IsNopIns(ptrU8 pIns, const HSInsInfo& stInfo);
+
+		static bool HasPadding(ptrU8 pSrc);
+
+		static bool IsPatched(ptrU8 pStart, unsigned32 uSize);
+
+		static bool StealIns(ptrAny pSrc, const HSFlowInfo& stFlow, unsigned32 uMinSize, HSHookPlan& stPlan);
 
-		static bool GetFixedIns(ptrAny pIns, HSInsInfo* pInfo, unsigned32 uNum, ptrAny pFixedIns, HSInsInfo* pFixedInfo);
+		static bool PlanHook(const HSHookOp& stOp, HSHookPlan& stPlan);
 
-		static void WriteJmp(ptrAny pBuf, ptrAny pDst);
+		static bool BuildHook(HSHookPlan& stPlan);
+
+		static void AddPatchSites(ptrAny pSrc, ptrU8 pPatch, unsigned32 uJmpSize, const unsigned8* pPatchCode, ptrAny pDst, std::vector<HSPatchSite>& vecSites);
+
+		static void AddRestoreSites(ptrAny pSrc, const HSStaticContext& stContext, std::vector<HSPatchSite>& vecSites);
+
+		static unsignedP MoveFromStolen(ptrAny pSrc, ptrU8 pPatch, ptrAny pMem, const HSInsMap& stMap, unsignedP uIp);
+
+		static unsignedP MoveFromTrampoline(ptrAny pSrc, const HSStaticContext& stContext, unsignedP uIp);
+
+		static void MoveThreads(const std::vector<ptrAny>& vecRemoves, const std::vector<HSHookPlan>& vecPlans);
+
+		static bool PlanLink(const HSHookOp& stOp, HSStaticContext& stContext, HSLinkOp& stLink);
+
+		static bool PlanUnlink(const HSHookOp& stOp, HSStaticContext& stContext, HSLinkOp& stLink);
+
+		static void WireLinks(const HSLinkOp& stLink);
+
+		static bool HasStub(const HSStaticContext& stContext);
+
+		static ptrAny GetEntryTarget(const HSStaticContext& stContext);
+
+		static void DiscardPlans(std::vector<HSHookPlan>& vecPlans, std::vector<HSLinkOp>& vecLinkOps);
+
+		static bool ApplyOps(const HSHookOp* pOps, unsigned32 uNum);
+
+		static bool ToggleHooks(const std::vector<ptrAny>& vecSrc, bool bEnable);
+
+#if defined(HS_HAS_STUBS)
+		static bool RetargetPastFilter(HSStaticContext& stContext, ptrAny pTarget);
+
+		static bool RetargetEntry(HSStaticContext& stContext, ptrAny pTarget);
+
+		static void HookUnwinders();
+
+		static bool IsExitLinked(ptrAny pSrc, HSExitRecord* pRecord);
+#endif
 
 	private:
-		static bool IsHookFull();
+		static bool ReserveHooks(unsigned32 uNum);
 
-		static void StoreHook(ptrAny pSrc, ptrAny pMem, ptrAny pBackup, unsigned32 uSize);
+		static void StoreHook(const HSHookPlan& stPlan);
 
 		static ptrAny FindHookSrc(ptrAny pSrc);
 
 		static HSStaticContext* FindHook(ptrAny pSrc);
 
-		static HSStaticContext* RemoveHook(ptrAny pSrc);
+		static bool RemoveHook(ptrAny pSrc);
 	};
 }
 
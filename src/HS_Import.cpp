@@ -0,0 +1,145 @@
+#include "HS_Import.h"
+
+#ifdef _WIN32
+namespace HSLL
+{
+	// PE modules import through the IAT, which this scanner does not read
+	bool HSImportScanner::Find(const char* pSymbol, std::vector<ptrAny*>& vecCells)
+	{
+		(void)pSymbol;
+		(void)vecCells;
+		return false;
+	}
+
+	ptrAny HSImportScanner::Resolve(const char* pSymbol)
+	{
+		(void)pSymbol;
+		return nullptr;
+	}
+}
+#elif defined(__unix__)
+#include <link.h>
+#include <dlfcn.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#define HS_ELF_R_SYM ELF64_R_SYM
+#define HS_ELF_R_TYPE ELF64_R_TYPE
+#define HS_R_JUMP_SLOT R_X86_64_JUMP_SLOT
+#else
+#define HS_ELF_R_SYM ELF32_R_SYM
+#define HS_ELF_R_TYPE ELF32_R_TYPE
+#define HS_R_JUMP_SLOT R_386_JMP_SLOT
+#endif
+
+namespace HSLL
+{
+	struct HSImportQuery
+	{
+		const char* pSymbol;
+		std::vector<ptrAny*>* pCells;
+	};
+
+	static ElfW(Addr) HSDynPtr(const dl_phdr_info* pInfo, ElfW(Addr) uPtr)
+	{
+		// glibc relocates the dynamic entries in place, the vDSO and other loaders leave them as offsets
+		return uPtr < pInfo->dlpi_addr ? pInfo->dlpi_addr + uPtr : uPtr;
+	}
+
+	static int HSScanModule(dl_phdr_info* pInfo, size_t uSize, void* pData)
+	{
+		(void)uSize;
+		HSImportQuery* pQuery = (HSImportQuery*)pData;
+		const ElfW(Dyn)* pDyn = nullptr;
+
+		for (ElfW(Half) i = 0; i < pInfo->dlpi_phnum; i++)
+		{
+			if (pInfo->dlpi_phdr[i].p_type == PT_DYNAMIC)
+			{
+				pDyn = (const ElfW(Dyn)*)(pInfo->dlpi_addr + pInfo->dlpi_phdr[i].p_vaddr);
+				break;
+			}
+		}
+
+		if (pDyn == nullptr)
+		{
+			return 0;
+		}
+
+		ElfW(Addr) uJmpRel = 0, uSymTab = 0, uStrTab = 0;
+		unsignedP uRelSize = 0, uStrSize = 0;
+		signedP sRelType = DT_REL;
+
+		for (; pDyn->d_tag != DT_NULL; pDyn++)
+		{
+			switch (pDyn->d_tag)
+			{
+			case DT_JMPREL:
+				uJmpRel = HSDynPtr(pInfo, pDyn->d_un.d_ptr);
+				break;
+			case DT_PLTRELSZ:
+				uRelSize = pDyn->d_un.d_val;
+				break;
+			case DT_PLTREL:
+				sRelType = pDyn->d_un.d_val;
+				break;
+			case DT_SYMTAB:
+				uSymTab = HSDynPtr(pInfo, pDyn->d_un.d_ptr);
+				break;
+			case DT_STRTAB:
+				uStrTab = HSDynPtr(pInfo, pDyn->d_un.d_ptr);
+				break;
+			case DT_STRSZ:
+				uStrSize = pDyn->d_un.d_val;
+				break;
+			}
+		}
+
+		if (uJmpRel == 0 || uSymTab == 0 || uStrTab == 0)
+		{
+			return 0;
+		}
+
+		const ElfW(Sym)* pSyms = (const ElfW(Sym)*)uSymTab;
+		const char* pStrings = (const char*)uStrTab;
+		unsignedP uEntSize = sRelType == DT_RELA ? sizeof(ElfW(Rela)) : sizeof(ElfW(Rel));
+
+		for (unsignedP uOffset = 0; uOffset + uEntSize <= uRelSize; uOffset += uEntSize)
+		{
+			// Rel is the head of Rela, r_offset and r_info sit at the same place in both
+			const ElfW(Rel)* pRel = (const ElfW(Rel)*)(uJmpRel + uOffset);
+
+			if (HS_ELF_R_TYPE(pRel->r_info) != HS_R_JUMP_SLOT)
+			{
+				continue;
+			}
+
+			const ElfW(Sym)& stSym = pSyms[HS_ELF_R_SYM(pRel->r_info)];
+
+			if (stSym.st_name < uStrSize && strcmp(pStrings + stSym.st_name, pQuery->pSymbol) == 0)
+			{
+				pQuery->pCells->push_back((ptrAny*)(pInfo->dlpi_addr + pRel->r_offset));
+			}
+		}
+
+		return 0;
+	}
+
+	bool HSImportScanner::Find(const char* pSymbol, std::vector<ptrAny*>& vecCells)
+	{
+		if (pSymbol == nullptr)
+		{
+			return false;
+		}
+
+		HSImportQuery stQuery = { pSymbol, &vecCells };
+		dl_iterate_phdr(&HSScanModule, &stQuery);
+		return true;
+	}
+
+	ptrAny HSImportScanner::Resolve(const char* pSymbol)
+	{
+		return pSymbol ? dlsym(RTLD_DEFAULT, pSymbol) : nullptr;
+	}
+}
+#endif
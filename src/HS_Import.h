@@ -0,0 +1,25 @@
+#pragma once
+#include "HS_Type.h"
+#include <vector>
+
+namespace HSLL
+{
+	/**
+	 * @brief Finds the GOT entries through which loaded ELF modules call an imported function
+	 * @details Walks every loaded module with dl_iterate_phdr and matches the symbol of each
+	 *          JUMP_SLOT relocation in its DT_JMPREL table (.rel.plt or .rela.plt) by name, so
+	 *          the result holds one entry per module that calls the function through its PLT.
+	 *          GLOB_DAT entries are left alone, they hold the address the program sees when it
+	 *          takes the function's address. ELF only, both calls fail on other platforms.
+	 */
+	class HSImportScanner
+	{
+	public:
+		static bool Find(const char* pSymbol, std::vector<ptrAny*>& vecCells);
+
+		/**
+		 * @brief Address the dynamic linker binds the name to, a lazily bound entry may still hold its PLT stub
+		 */
+		static ptrAny Resolve(const char* pSymbol);
+	};
+}
@@ -0,0 +1,588 @@
+#include "HS_Patch.h"
+#if defined(_M_IX86) || defined(__i386__) || defined(_M_X64) || defined(__x86_64__)
+
+#include <atomic>
+#include <thread>
+#include <string.h>
+
+namespace HSLL
+{
+	struct HSLiveSite
+	{
+		std::atomic<unsignedP> uAddr; // Address of the breakpoint, 0 when the slot is free
+		ptrAny pResume;
+	};
+
+	static HSLiveSite g_aLiveSites[HSPatcher::HS_PATCH_MAX_SITES];
+	static std::atomic<unsigned32> g_uTrapNum(0); // Trap handlers currently looking at g_aLiveSites
+
+	/**
+	 * @brief Decides where a thread that stopped on the int3 at uTrap continues
+	 * @details Async-signal-safe. Returns false for breakpoints that do not belong to a live patch.
+	 */
+	static bool HSRedirectTrap(unsignedP uTrap, unsignedP& uResume)
+	{
+		bool bResult = false;
+		g_uTrapNum.fetch_add(1, std::memory_order_acquire);
+
+		for (unsigned32 i = 0; i < HSPatcher::HS_PATCH_MAX_SITES; i++)
+		{
+			if (g_aLiveSites[i].uAddr.load(std::memory_order_acquire) != uTrap)
+			{
+				continue;
+			}
+
+			if (g_aLiveSites[i].pResume)
+			{
+				uResume = (unsignedP)g_aLiveSites[i].pResume;
+			}
+			else
+			{
+				while (g_aLiveSites[i].uAddr.load(std::memory_order_acquire) == uTrap)
+				{
+					std::this_thread::yield();
+				}
+
+				uResume = uTrap;
+			}
+
+			bResult = true;
+			break;
+		}
+
+		// The site was finished between the trap and the lookup, run the bytes now in place
+		if (!bResult && *(volatile unsigned8*)uTrap != 0xCC)
+		{
+			uResume = uTrap;
+			bResult = true;
+		}
+
+		g_uTrapNum.fetch_sub(1, std::memory_order_release);
+		return bResult;
+	}
+
+	void HSPatcher::WriteDirect(const HSPatchSite& stSite)
+	{
+		// Two bytes are the entry jump of padding mode and go out in a single store
+		if (stSite.uSize == 2)
+		{
+			*(volatile unsigned16*)stSite.pAddr = *(const unsigned16*)stSite.pBytes;
+		}
+		else
+		{
+			memcpy(stSite.pAddr, stSite.pBytes, stSite.uSize);
+		}
+	}
+
+	void HSPatcher::ApplyLive(const HSPatchSite* pSites, unsigned32 uNum)
+	{
+		// A handler that matched a slot in the previous round may still read its pResume
+		while (g_uTrapNum.load(std::memory_order_acquire))
+		{
+			std::this_thread::yield();
+		}
+
+		for (unsigned32 i = 0; i < uNum; i++)
+		{
+			g_aLiveSites[i].pResume = pSites[i].pResume;
+			g_aLiveSites[i].uAddr.store((unsignedP)pSites[i].pAddr, std::memory_order_release);
+		}
+
+		for (unsigned32 i = 0; i < uNum; i++)
+		{
+			*(volatile unsigned8*)pSites[i].pAddr = 0xCC;
+		}
+
+		SyncCores();
+
+		for (unsigned32 i = 0; i < uNum; i++)
+		{
+			memcpy(pSites[i].pAddr + 1, pSites[i].pBytes + 1, pSites[i].uSize - 1);
+		}
+
+		SyncCores();
+
+		for (unsigned32 i = 0; i < uNum; i++)
+		{
+			*(volatile unsigned8*)pSites[i].pAddr = pSites[i].pBytes[0];
+		}
+
+		SyncCores();
+
+		for (unsigned32 i = 0; i < uNum; i++)
+		{
+			g_aLiveSites[i].uAddr.store(0, std::memory_order_release);
+		}
+	}
+
+	bool HSPatcher::Prepare(HSPatchMode eMode)
+	{
+		switch (eMode)
+		{
+		case HSPatchMode_Direct:
+			return true;
+		case HSPatchMode_Live:
+			return InstallHandler();
+		case HSPatchMode_Quiesce:
+			return InstallParkHandler();
+		default:
+			return false;
+		}
+	}
+
+	void HSPatcher::Apply(const HSPatchSite* pSites, unsigned32 uNum, HSPatchMode eMode)
+	{
+		// Parked threads cannot observe a half-written site either
+		if (eMode != HSPatchMode_Live)
+		{
+			for (unsigned32 i = 0; i < uNum; i++)
+			{
+				WriteDirect(pSites[i]);
+			}
+
+			return;
+		}
+
+		for (unsigned32 i = 0; i < uNum; i += HS_PATCH_MAX_SITES)
+		{
+			ApplyLive(pSites + i, (uNum - i < HS_PATCH_MAX_SITES) ? uNum - i : HS_PATCH_MAX_SITES);
+		}
+	}
+}
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+namespace HSLL
+{
+	static LONG CALLBACK HSTrapFilter(PEXCEPTION_POINTERS pInfo)
+	{
+		unsignedP uResume;
+
+		if (pInfo->ExceptionRecord->ExceptionCode != EXCEPTION_BREAKPOINT
+			|| !HSRedirectTrap((unsignedP)pInfo->ExceptionRecord->ExceptionAddress, uResume))
+		{
+			return EXCEPTION_CONTINUE_SEARCH;
+		}
+
+#if defined(_M_X64)
+		pInfo->ContextRecord->Rip = (DWORD64)uResume;
+#else
+		pInfo->ContextRecord->Eip = (DWORD)uResume;
+#endif
+		return EXCEPTION_CONTINUE_EXECUTION;
+	}
+
+	bool HSPatcher::InstallHandler()
+	{
+		static PVOID pHandler = nullptr;
+
+		if (pHandler == nullptr)
+		{
+			pHandler = AddVectoredExceptionHandler(1, HSTrapFilter);
+		}
+
+		return pHandler != nullptr;
+	}
+
+	void HSPatcher::SyncCores()
+	{
+		// Interrupts every processor running a thread of this process, which serializes it
+		FlushProcessWriteBuffers();
+		FlushInstructionCache(GetCurrentProcess(), nullptr, 0);
+	}
+
+	bool HSPatcher::InstallParkHandler()
+	{
+		return false;
+	}
+
+	bool HSPatcher::Stop()
+	{
+		return false;
+	}
+
+	void HSPatcher::Resume()
+	{
+	}
+
+	unsigned32 HSPatcher::GetStoppedNum()
+	{
+		return 0;
+	}
+
+	unsignedP* HSPatcher::GetStoppedIp(unsigned32)
+	{
+		return nullptr;
+	}
+}
+#elif defined(__linux__)
+#include <signal.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <time.h>
+
+#if defined(__x86_64__)
+#define HS_REG_IP REG_RIP
+#else
+#define HS_REG_IP REG_EIP
+#endif
+
+namespace HSLL
+{
+	constexpr unsigned32 HS_PARK_TIMEOUT_MS = 1000;
+
+	struct HSDirent
+	{
+		unsigned64 uIno;
+		signed64 sOff;
+		unsigned16 uRecLen;
+		unsigned8 uType;
+		char pName[1];
+	};
+
+	static struct sigaction g_stOldTrap;
+	static signed32 g_sParkSignal = 0;
+	static std::atomic<signed32> g_sParkGeneration(0); // Signals from an abandoned Stop are ignored
+	static std::atomic<signed32> g_sParkRelease(0);    // Futex word the parked threads wait on
+	static std::atomic<unsigned32> g_uParkIndex(0);
+	static std::atomic<unsigned32> g_uParkArrived(0);
+	static std::atomic<unsigned32> g_uParkLeft(0);
+	static ucontext_t* g_aParked[HSPatcher::HS_PATCH_MAX_THREADS];
+	static signed32 g_aSignaled[HSPatcher::HS_PATCH_MAX_THREADS];
+	static unsigned32 g_uSignaledNum = 0;
+	static bool g_bMembarrier = false;
+	static ptrAny g_pSyncPage = nullptr;
+
+	static void HSTrapHandler(signed32 sSig, siginfo_t* pInfo, ptrAny pContext)
+	{
+		greg_t* pRegs = ((ucontext_t*)pContext)->uc_mcontext.gregs;
+		unsignedP uResume;
+
+		// The instruction pointer already points past the one-byte int3
+		if (HSRedirectTrap((unsignedP)pRegs[HS_REG_IP] - 1, uResume))
+		{
+			pRegs[HS_REG_IP] = (greg_t)uResume;
+			return;
+		}
+
+		if (g_stOldTrap.sa_flags & SA_SIGINFO)
+		{
+			g_stOldTrap.sa_sigaction(sSig, pInfo, pContext);
+		}
+		else if (g_stOldTrap.sa_handler == SIG_DFL)
+		{
+			signal(SIGTRAP, SIG_DFL);
+			raise(SIGTRAP);
+		}
+		else if (g_stOldTrap.sa_handler != SIG_IGN)
+		{
+			g_stOldTrap.sa_handler(sSig);
+		}
+	}
+
+	bool HSPatcher::InstallHandler()
+	{
+		static bool bInstalled = false;
+
+		if (bInstalled)
+		{
+			return true;
+		}
+
+		g_bMembarrier = syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_SYNC_CORE, 0, 0) == 0;
+		g_pSyncPage = mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (g_pSyncPage == MAP_FAILED)
+		{
+			g_pSyncPage = nullptr;
+			return false;
+		}
+
+		struct sigaction stAction;
+		memset(&stAction, 0, sizeof(stAction));
+		stAction.sa_sigaction = HSTrapHandler;
+		stAction.sa_flags = SA_SIGINFO | SA_RESTART | SA_NODEFER;
+		sigemptyset(&stAction.sa_mask);
+
+		if (sigaction(SIGTRAP, &stAction, &g_stOldTrap) != 0)
+		{
+			return false;
+		}
+
+		bInstalled = true;
+		return true;
+	}
+
+	static void HSParkHandler(signed32, siginfo_t* pInfo, ptrAny pContext)
+	{
+		if (pInfo->si_code != SI_QUEUE || pInfo->si_value.sival_int != g_sParkGeneration.load(std::memory_order_acquire))
+		{
+			return;
+		}
+
+		unsigned32 uIndex = g_uParkIndex.fetch_add(1, std::memory_order_relaxed);
+
+		if (uIndex < HSPatcher::HS_PATCH_MAX_THREADS)
+		{
+			g_aParked[uIndex] = (ucontext_t*)pContext;
+		}
+
+		g_uParkArrived.fetch_add(1, std::memory_order_release);
+
+		while (!g_sParkRelease.load(std::memory_order_acquire))
+		{
+			syscall(SYS_futex, &g_sParkRelease, FUTEX_WAIT_PRIVATE, 0, nullptr, nullptr, 0);
+		}
+
+		// The patcher may have moved the saved instruction pointer, returning resumes there
+		g_uParkLeft.fetch_add(1, std::memory_order_release);
+	}
+
+	static signed64 HSNowMs()
+	{
+		struct timespec stNow;
+		clock_gettime(CLOCK_MONOTONIC, &stNow);
+		return (signed64)stNow.tv_sec * 1000 + stNow.tv_nsec / 1000000;
+	}
+
+	static bool HSWaitParked()
+	{
+		signed64 sDeadline = HSNowMs() + HS_PARK_TIMEOUT_MS;
+		signed32 sPid = getpid();
+
+		while (g_uParkArrived.load(std::memory_order_acquire) < g_uSignaledNum)
+		{
+			// A thread that exited after it was signaled never arrives, stop waiting for it
+			unsigned32 uLive = 0;
+
+			for (unsigned32 i = 0; i < g_uSignaledNum; i++)
+			{
+				uLive += (syscall(SYS_tgkill, sPid, g_aSignaled[i], 0) == 0);
+			}
+
+			if (g_uParkArrived.load(std::memory_order_acquire) >= uLive)
+			{
+				return true;
+			}
+
+			if (HSNowMs() > sDeadline)
+			{
+				return false;
+			}
+
+			std::this_thread::yield();
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Signals every thread in /proc/self/task that has not been signaled yet
+	 * @details Uses getdents64 on a stack buffer, opendir could block on a malloc lock held by a
+	 *          thread parked in an earlier pass.
+	 */
+	static signed32 HSSignalTasks(signed32 sGeneration)
+	{
+		signed32 sFd = open("/proc/self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		signed32 sPid = getpid();
+		signed32 sSelf = (signed32)syscall(SYS_gettid);
+		signed32 sNewNum = 0;
+		char pBuf[4096];
+		signed32 sRead;
+
+		if (sFd < 0)
+		{
+			return -1;
+		}
+
+		while ((sRead = (signed32)syscall(SYS_getdents64, sFd, pBuf, sizeof(pBuf))) > 0)
+		{
+			for (signed32 sPos = 0; sPos < sRead; sPos += ((HSDirent*)(pBuf + sPos))->uRecLen)
+			{
+				const char* pName = ((HSDirent*)(pBuf + sPos))->pName;
+				signed32 sTid = 0;
+
+				if (*pName < '0' || *pName > '9')
+				{
+					continue;
+				}
+
+				while (*pName >= '0' && *pName <= '9')
+				{
+					sTid = sTid * 10 + (*pName++ - '0');
+				}
+
+				bool bKnown = (sTid == sSelf);
+
+				for (unsigned32 i = 0; !bKnown && i < g_uSignaledNum; i++)
+				{
+					bKnown = (g_aSignaled[i] == sTid);
+				}
+
+				if (bKnown)
+				{
+					continue;
+				}
+
+				if (g_uSignaledNum == HSPatcher::HS_PATCH_MAX_THREADS)
+				{
+					close(sFd);
+					return -1;
+				}
+
+				siginfo_t stInfo;
+				memset(&stInfo, 0, sizeof(stInfo));
+				stInfo.si_signo = g_sParkSignal;
+				stInfo.si_code = SI_QUEUE;
+				stInfo.si_pid = sPid;
+				stInfo.si_uid = getuid();
+				stInfo.si_value.sival_int = sGeneration;
+
+				// A thread that exited since the listing is simply skipped
+				if (syscall(SYS_rt_tgsigqueueinfo, sPid, sTid, g_sParkSignal, &stInfo) == 0)
+				{
+					g_aSignaled[g_uSignaledNum++] = sTid;
+					sNewNum++;
+				}
+			}
+		}
+
+		close(sFd);
+		return sRead < 0 ? -1 : sNewNum;
+	}
+
+	bool HSPatcher::InstallParkHandler()
+	{
+		if (g_sParkSignal)
+		{
+			return true;
+		}
+
+		struct sigaction stAction;
+		memset(&stAction, 0, sizeof(stAction));
+		stAction.sa_sigaction = HSParkHandler;
+		stAction.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigfillset(&stAction.sa_mask);
+
+		if (sigaction(SIGRTMIN + HS_QUIESCE_SIGNAL_OFFSET, &stAction, nullptr) != 0)
+		{
+			return false;
+		}
+
+		g_sParkSignal = SIGRTMIN + HS_QUIESCE_SIGNAL_OFFSET;
+		return true;
+	}
+
+	bool HSPatcher::Stop()
+	{
+		signed32 sGeneration = g_sParkGeneration.load(std::memory_order_relaxed) + 1;
+		signed32 sNewNum;
+
+		g_sParkRelease.store(0, std::memory_order_relaxed);
+		g_uParkIndex.store(0, std::memory_order_relaxed);
+		g_uParkArrived.store(0, std::memory_order_relaxed);
+		g_uParkLeft.store(0, std::memory_order_relaxed);
+		g_uSignaledNum = 0;
+		g_sParkGeneration.store(sGeneration, std::memory_order_release);
+
+		// Threads created while the list was read show up in the next pass
+		do
+		{
+			sNewNum = HSSignalTasks(sGeneration);
+
+			if (sNewNum < 0 || !HSWaitParked())
+			{
+				Resume();
+				return false;
+			}
+		} while (sNewNum > 0);
+
+		return true;
+	}
+
+	void HSPatcher::Resume()
+	{
+		unsigned32 uArrived = g_uParkArrived.load(std::memory_order_acquire);
+
+		// Late signals of this generation return at once instead of parking
+		g_sParkGeneration.fetch_add(1, std::memory_order_release);
+		g_sParkRelease.store(1, std::memory_order_release);
+		syscall(SYS_futex, &g_sParkRelease, FUTEX_WAKE_PRIVATE, 0x7FFFFFFF, nullptr, nullptr, 0);
+
+		// The next Stop must not reset the counters under a thread that is still leaving
+		while (g_uParkLeft.load(std::memory_order_acquire) < uArrived)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	unsigned32 HSPatcher::GetStoppedNum()
+	{
+		unsigned32 uNum = g_uParkIndex.load(std::memory_order_acquire);
+		return uNum < HS_PATCH_MAX_THREADS ? uNum : HS_PATCH_MAX_THREADS;
+	}
+
+	unsignedP* HSPatcher::GetStoppedIp(unsigned32 uIndex)
+	{
+		return (unsignedP*)&g_aParked[uIndex]->uc_mcontext.gregs[HS_REG_IP];
+	}
+
+	void HSPatcher::SyncCores()
+	{
+		if (g_bMembarrier && syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE, 0, 0) == 0)
+		{
+			return;
+		}
+
+		// Dropping write access on a touched page sends a TLB shootdown IPI to every CPU running
+		// this process, and returning from the interrupt serializes each of them
+		*(volatile unsigned8*)g_pSyncPage = 0;
+		mprotect(g_pSyncPage, 4096, PROT_READ);
+		mprotect(g_pSyncPage, 4096, PROT_READ | PROT_WRITE);
+	}
+}
+#else
+namespace HSLL
+{
+	bool HSPatcher::InstallHandler()
+	{
+		return false;
+	}
+
+	void HSPatcher::SyncCores()
+	{
+	}
+
+	bool HSPatcher::InstallParkHandler()
+	{
+		return false;
+	}
+
+	bool HSPatcher::Stop()
+	{
+		return false;
+	}
+
+	void HSPatcher::Resume()
+	{
+	}
+
+	unsigned32 HSPatcher::GetStoppedNum()
+	{
+		return 0;
+	}
+
+	unsignedP* HSPatcher::GetStoppedIp(unsigned32)
+	{
+		return nullptr;
+	}
+}
+#endif
+
+#endif
@@ -0,0 +1,70 @@
+#pragma once
+#if defined(_M_IX86) || defined(__i386__) || defined(_M_X64) || defined(__x86_64__)
+
+#include "HS_Type.h"
+
+namespace HSLL
+{
+	enum HSPatchMode
+	{
+		HSPatchMode_Direct = 0, // Plain stores, no thread may run the patched bytes meanwhile
+		HSPatchMode_Live = 1,   // int3 breakpoint protocol, the target may be called meanwhile
+		HSPatchMode_Quiesce = 2 // Every other thread is parked and moved out of the patched code (Linux)
+	};
+
+	struct HSPatchSite
+	{
+		ptrU8 pAddr;             // First byte to patch
+		const unsigned8* pBytes; // New bytes
+		unsigned32 uSize;        // Number of bytes
+		ptrAny pResume;          // Where a thread that hits the breakpoint continues, null to wait and retry
+	};
+
+	/**
+	 * @brief Writes code bytes that other threads may be executing
+	 * @details Live mode follows the text_poke_bp protocol: int3 on the first byte of every site,
+	 *          sync all cores, write the tails, sync, write the first bytes, sync. A thread that hits
+	 *          a breakpoint meanwhile is sent to pResume, or waits until its site is finished and
+	 *          runs the new bytes. Sites are written in array order in direct mode. Quiesce mode
+	 *          parks every other thread in a signal handler between Stop and Resume, so the caller
+	 *          can move their saved instruction pointers and write the sites directly. Prepare must
+	 *          succeed before Apply. Not thread-safe, the caller serializes access and makes the
+	 *          pages writable.
+	 */
+	class HSPatcher
+	{
+	public:
+		static constexpr unsigned32 HS_PATCH_MAX_SITES = 64;
+		static constexpr unsigned32 HS_PATCH_MAX_THREADS = 1024;
+		static constexpr signed32 HS_QUIESCE_SIGNAL_OFFSET = 5; // Quiesce mode parks threads with SIGRTMIN + 5
+
+		static bool Prepare(HSPatchMode eMode);
+
+		static void Apply(const HSPatchSite* pSites, unsigned32 uNum, HSPatchMode eMode);
+
+		/**
+		 * @brief Parks every other thread of the process
+		 * @details Must not allocate or take locks until Resume, a parked thread may hold them.
+		 */
+		static bool Stop();
+
+		static void Resume();
+
+		static unsigned32 GetStoppedNum();
+
+		static unsignedP* GetStoppedIp(unsigned32 uIndex);
+
+	private:
+		static void WriteDirect(const HSPatchSite& stSite);
+
+		static void ApplyLive(const HSPatchSite* pSites, unsigned32 uNum);
+
+		static bool InstallHandler();
+
+		static bool InstallParkHandler();
+
+		static void SyncCores();
+	};
+}
+
+#endif
@@ -0,0 +1,437 @@
+#include "HS_Pool.h"
+#include <new>
+
+namespace HSLL
+{
+	HSTrampolinePool::HSTrampolinePool()
+	{
+		m_pPageList = nullptr;
+		m_uPageNum = 0;
+		m_uUsedSlotNum = 0;
+		m_uBlockNum = 0;
+	}
+
+	bool HSTrampolinePool::TestBit(const unsigned32* pMap, unsigned32 uIndex)
+	{
+		return (pMap[uIndex >> 5] >> (uIndex & 31)) & 1;
+	}
+
+	void HSTrampolinePool::SetBit(unsigned32* pMap, unsigned32 uIndex, bool bValue)
+	{
+		if (bValue)
+		{
+			pMap[uIndex >> 5] |= (1u << (uIndex & 31));
+		}
+		else
+		{
+			pMap[uIndex >> 5] &= ~(1u << (uIndex & 31));
+		}
+	}
+
+	bool HSTrampolinePool::FindRun(const Page* pPage, unsigned32 uNeed, unsigned32& uStart)
+	{
+		const unsigned32 uLineSlots = HS_POOL_LINE_SIZE / HS_POOL_SLOT_SIZE;
+
+		if (HS_POOL_SLOT_NUM - pPage->uUsedNum < uNeed)
+		{
+			return false;
+		}
+
+		for (unsigned32 i = 0; i + uNeed <= HS_POOL_SLOT_NUM; i++)
+		{
+			if (pPage->aUsed[i >> 5] == 0xFFFFFFFFu)
+			{
+				i |= 31;
+				continue;
+			}
+
+			if (uNeed <= uLineSlots)
+			{
+				if ((i % uLineSlots) + uNeed > uLineSlots)
+				{
+					continue;
+				}
+			}
+			else if (i % uLineSlots)
+			{
+				continue;
+			}
+
+			unsigned32 j = 0;
+
+			while (j < uNeed && !TestBit(pPage->aUsed, i + j))
+			{
+				j++;
+			}
+
+			if (j == uNeed)
+			{
+				uStart = i;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool HSTrampolinePool::IsNear(ptrAny pAddr, ptrAny pNear)
+	{
+		// rel32 wraps around a 32-bit address space and reaches all of it
+		if (pNear == nullptr || sizeof(ptrAny) == 4)
+		{
+			return true;
+		}
+
+		unsignedP uAddr = (unsignedP)pAddr;
+		unsignedP uNear = (unsignedP)pNear;
+		return (uAddr > uNear ? uAddr - uNear : uNear - uAddr) < HS_POOL_NEAR_RANGE;
+	}
+
+	bool HSTrampolinePool::IsPageNear(const Page* pPage, ptrAny pNear)
+	{
+		return IsNear(pPage->pBase, pNear) && IsNear(pPage->pBase + HS_POOL_PAGE_SIZE, pNear);
+	}
+
+	HSTrampolinePool::Page* HSTrampolinePool::FindPage(ptrAny pMem, Page**& pLink)
+	{
+		ptrU8 pBase = (ptrU8)((unsignedP)pMem & ~(unsignedP)(HS_POOL_PAGE_SIZE - 1));
+		pLink = &m_pPageList;
+
+		while (*pLink)
+		{
+			if ((*pLink)->pBase == pBase)
+			{
+				return *pLink;
+			}
+
+			pLink = &(*pLink)->pNext;
+		}
+
+		return nullptr;
+	}
+
+	HSTrampolinePool::Page* HSTrampolinePool::NewPage(ptrAny pNear)
+	{
+		Page* pPage = new (std::nothrow) Page();
+
+		if (pPage == nullptr)
+		{
+			return nullptr;
+		}
+
+		pPage->pBase = (ptrU8)PageAlloc(pNear);
+
+		if (pPage->pBase == nullptr)
+		{
+			delete pPage;
+			return nullptr;
+		}
+
+		// The gap may have been taken by another thread's mapping in the meantime
+		if (!IsPageNear(pPage, pNear))
+		{
+			PageFree(pPage->pBase);
+			delete pPage;
+			return nullptr;
+		}
+
+		Page** pLink = &m_pPageList;
+
+		while (*pLink)
+		{
+			pLink = &(*pLink)->pNext;
+		}
+
+		*pLink = pPage;
+		m_uPageNum++;
+		return pPage;
+	}
+
+	ptrAny HSTrampolinePool::Alloc(unsigned32 uSize, ptrAny pNear)
+	{
+		if (uSize == 0 || uSize > HS_POOL_PAGE_SIZE)
+		{
+			return nullptr;
+		}
+
+		unsigned32 uNeed = (uSize + HS_POOL_SLOT_SIZE - 1) / HS_POOL_SLOT_SIZE;
+		unsigned32 uStart = 0;
+		Page* pPage = m_pPageList;
+
+		while (pPage && (!IsPageNear(pPage, pNear) || !FindRun(pPage, uNeed, uStart)))
+		{
+			pPage = pPage->pNext;
+		}
+
+		if (pPage == nullptr)
+		{
+			if ((pPage = NewPage(pNear)) == nullptr)
+			{
+				return nullptr;
+			}
+
+			uStart = 0;
+		}
+
+		for (unsigned32 i = 0; i < uNeed; i++)
+		{
+			SetBit(pPage->aUsed, uStart + i, true);
+		}
+
+		SetBit(pPage->aHead, uStart, true);
+		pPage->uUsedNum += uNeed;
+		m_uUsedSlotNum += uNeed;
+		m_uBlockNum++;
+		return pPage->pBase + uStart * HS_POOL_SLOT_SIZE;
+	}
+
+	bool HSTrampolinePool::ReserveNear(ptrAny pNear)
+	{
+		for (Page* pPage = m_pPageList; pPage; pPage = pPage->pNext)
+		{
+			if (IsPageNear(pPage, pNear) && pPage->uUsedNum < HS_POOL_SLOT_NUM)
+			{
+				return true;
+			}
+		}
+
+		// An empty page other than the first is unmapped by the next Free on it, or stays until then
+		return NewPage(pNear) != nullptr;
+	}
+
+	bool HSTrampolinePool::Free(ptrAny pMem)
+	{
+		if (pMem == nullptr || ((unsignedP)pMem & (HS_POOL_SLOT_SIZE - 1)))
+		{
+			return false;
+		}
+
+		Page** pLink;
+		Page* pPage = FindPage(pMem, pLink);
+
+		if (pPage == nullptr)
+		{
+			return false;
+		}
+
+		unsigned32 uStart = (unsigned32)((ptrU8)pMem - pPage->pBase) / HS_POOL_SLOT_SIZE;
+
+		if (!TestBit(pPage->aHead, uStart))
+		{
+			return false;
+		}
+
+		unsigned32 uNum = 0;
+		SetBit(pPage->aHead, uStart, false);
+
+		while (uStart + uNum < HS_POOL_SLOT_NUM && TestBit(pPage->aUsed, uStart + uNum)
+			&& (uNum == 0 || !TestBit(pPage->aHead, uStart + uNum)))
+		{
+			SetBit(pPage->aUsed, uStart + uNum, false);
+			uNum++;
+		}
+
+		pPage->uUsedNum -= uNum;
+		m_uUsedSlotNum -= uNum;
+		m_uBlockNum--;
+
+		// Keep the first page mapped so a remove/install cycle does not hit mmap every time
+		if (pPage->uUsedNum == 0 && pPage != m_pPageList)
+		{
+			*pLink = pPage->pNext;
+			PageFree(pPage->pBase);
+			delete pPage;
+			m_uPageNum--;
+		}
+
+		return true;
+	}
+
+	void HSTrampolinePool::GetStats(HSPoolStats& stStats) const
+	{
+		stStats.uPageNum = m_uPageNum;
+		stStats.uSlotNum = m_uPageNum * HS_POOL_SLOT_NUM;
+		stStats.uUsedSlotNum = m_uUsedSlotNum;
+		stStats.uBlockNum = m_uBlockNum;
+	}
+}
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+namespace HSLL
+{
+	ptrAny HSTrampolinePool::PageAlloc(ptrAny pNear)
+	{
+		if (pNear == nullptr || sizeof(ptrAny) == 4)
+		{
+			return VirtualAlloc(nullptr, HS_POOL_PAGE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+		}
+
+		SYSTEM_INFO stSystem;
+		GetSystemInfo(&stSystem);
+
+		unsignedP uGranularity = stSystem.dwAllocationGranularity;
+		unsignedP uMin = (unsignedP)stSystem.lpMinimumApplicationAddress;
+		unsignedP uMax = (unsignedP)stSystem.lpMaximumApplicationAddress;
+		unsignedP uStart = (unsignedP)pNear & ~(uGranularity - 1);
+		MEMORY_BASIC_INFORMATION stMem;
+
+		// Walk the regions downwards from pNear, then upwards, the first free one in reach gets the page
+		for (unsignedP uAddr = uStart; uAddr > uMin && IsNear((ptrAny)uAddr, pNear);)
+		{
+			if (VirtualQuery((ptrAny)uAddr, &stMem, sizeof(stMem)) == 0)
+			{
+				break;
+			}
+
+			if (stMem.State == MEM_FREE)
+			{
+				ptrAny pPage = VirtualAlloc((ptrAny)uAddr, HS_POOL_PAGE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+
+				if (pPage)
+				{
+					return pPage;
+				}
+
+				uAddr -= uGranularity;
+				continue;
+			}
+
+			uAddr = ((unsignedP)stMem.AllocationBase & ~(uGranularity - 1)) - uGranularity;
+		}
+
+		for (unsignedP uAddr = uStart + uGranularity; uAddr < uMax && IsNear((ptrAny)(uAddr + HS_POOL_PAGE_SIZE), pNear);)
+		{
+			if (VirtualQuery((ptrAny)uAddr, &stMem, sizeof(stMem)) == 0)
+			{
+				break;
+			}
+
+			if (stMem.State == MEM_FREE)
+			{
+				ptrAny pPage = VirtualAlloc((ptrAny)uAddr, HS_POOL_PAGE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+
+				if (pPage)
+				{
+					return pPage;
+				}
+			}
+
+			unsignedP uNext = ((unsignedP)stMem.BaseAddress + stMem.RegionSize + uGranularity - 1) & ~(uGranularity - 1);
+			uAddr = uNext > uAddr ? uNext : uAddr + uGranularity;
+		}
+
+		return nullptr;
+	}
+
+	bool HSTrampolinePool::PageFree(ptrAny pPage)
+	{
+		return VirtualFree(pPage, 0, MEM_RELEASE) != 0;
+	}
+}
+#elif defined(__unix__)
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace HSLL
+{
+#if defined(__x86_64__)
+	constexpr unsignedP HS_POOL_LOWEST_ADDR = 0x10000;        // Default vm.mmap_min_addr
+	constexpr unsignedP HS_POOL_HIGHEST_ADDR = 0x7FFFFFFFF000; // Top of the 47-bit user address space
+
+	/**
+	 * @brief Page-aligned address in a free gap of /proc/self/maps as close to pNear as possible, 0 if none is in reach
+	 */
+	static unsignedP HSFindGap(ptrAny pNear)
+	{
+		FILE* pFile = fopen("/proc/self/maps", "r");
+
+		if (pFile == nullptr)
+		{
+			return 0;
+		}
+
+		const unsignedP uPage = HSTrampolinePool::HS_POOL_PAGE_SIZE;
+		unsignedP uNear = (unsignedP)pNear & ~(uPage - 1);
+		unsignedP uPrevEnd = HS_POOL_LOWEST_ADDR;
+		unsignedP uBest = 0;
+		unsignedP uBestDistance = HSTrampolinePool::HS_POOL_NEAR_RANGE;
+		char pLine[512];
+		bool bLast = false;
+
+		// Lines are sorted by address, the gap after the last mapping runs up to the top of user space
+		while (!bLast)
+		{
+			unsignedP uStart = HS_POOL_HIGHEST_ADDR;
+			unsignedP uEnd = HS_POOL_HIGHEST_ADDR;
+
+			if (fgets(pLine, sizeof(pLine), pFile))
+			{
+				char* pDash;
+				uStart = (unsignedP)strtoull(pLine, &pDash, 16);
+				uEnd = (unsignedP)strtoull(pDash + 1, nullptr, 16);
+
+				// A line longer than the buffer continues without an address
+				if (*pDash != '-' || uStart > HS_POOL_HIGHEST_ADDR)
+				{
+					continue;
+				}
+			}
+			else
+			{
+				bLast = true;
+			}
+
+			if (uStart >= uPrevEnd + uPage)
+			{
+				unsignedP uCandidate = uNear < uPrevEnd ? uPrevEnd : uNear + uPage > uStart ? uStart - uPage : uNear;
+				unsignedP uDistance = uCandidate > uNear ? uCandidate + uPage - uNear : uNear - uCandidate;
+
+				if (uDistance < uBestDistance)
+				{
+					uBest = uCandidate;
+					uBestDistance = uDistance;
+				}
+			}
+
+			uPrevEnd = uEnd > uPrevEnd ? uEnd : uPrevEnd;
+		}
+
+		fclose(pFile);
+		return uBest;
+	}
+#endif
+
+	ptrAny HSTrampolinePool::PageAlloc(ptrAny pNear)
+	{
+		ptrAny pHint = nullptr;
+
+#if defined(__x86_64__)
+		if (pNear && (pHint = (ptrAny)HSFindGap(pNear)) == nullptr)
+		{
+			return nullptr;
+		}
+#else
+		// Every address is in rel32 reach of every other one
+		(void)pNear;
+#endif
+
+		// Without MAP_FIXED a hint that is still free is taken as it is, NewPage checks the result
+		ptrAny pPage = mmap(pHint, HS_POOL_PAGE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (pPage == MAP_FAILED)
+		{
+			return nullptr;
+		}
+
+		return pPage;
+	}
+
+	bool HSTrampolinePool::PageFree(ptrAny pPage)
+	{
+		return munmap(pPage, HS_POOL_PAGE_SIZE) == 0;
+	}
+}
+#endif
@@ -0,0 +1,84 @@
+#pragma once
+#include "HS_Type.h"
+
+namespace HSLL
+{
+	struct HSPoolStats
+	{
+		unsigned32 uPageNum;     // Number of executable pages mapped by the pool
+		unsigned32 uSlotNum;     // Total number of slots in those pages
+		unsigned32 uUsedSlotNum; // Number of slots currently handed out
+		unsigned32 uBlockNum;    // Number of live allocations
+	};
+
+	/**
+	 * @brief Packs trampolines densely into shared executable pages
+	 * @details Pages are split into 16-byte slots. Blocks up to a cache line never straddle
+	 *          a 64-byte line, larger blocks start on one. Allocation is first-fit from the
+	 *          oldest page so live trampolines stay packed together. On x86-64 a block can be
+	 *          asked for within rel32 reach of an address, pages for it are mapped into a free
+	 *          gap next to that address. Not thread-safe, the caller serializes access.
+	 */
+	class HSTrampolinePool
+	{
+	public:
+		static constexpr unsigned32 HS_POOL_PAGE_SIZE = 4096;
+		static constexpr unsigned32 HS_POOL_SLOT_SIZE = 16;
+		static constexpr unsigned32 HS_POOL_LINE_SIZE = 64;
+		static constexpr unsigned32 HS_POOL_SLOT_NUM = HS_POOL_PAGE_SIZE / HS_POOL_SLOT_SIZE;
+		static constexpr unsigned32 HS_POOL_MAP_NUM = HS_POOL_SLOT_NUM / 32;
+		static constexpr unsignedP HS_POOL_NEAR_RANGE = 0x7FFF0000; // Leaves 64 KB of the rel32 range for code around pNear
+
+		HSTrampolinePool();
+
+		/**
+		 * @param pNear Every byte of the block lies within HS_POOL_NEAR_RANGE of it, null for anywhere
+		 */
+		ptrAny Alloc(unsigned32 uSize, ptrAny pNear = nullptr);
+
+		/**
+		 * @brief Whether a block near pNear can be handed out, maps a page for it if needed
+		 */
+		bool ReserveNear(ptrAny pNear);
+
+		static bool IsNear(ptrAny pAddr, ptrAny pNear);
+
+		bool Free(ptrAny pMem);
+
+		void GetStats(HSPoolStats& stStats) const;
+
+		HSTrampolinePool(const HSTrampolinePool&) = delete;
+		HSTrampolinePool& operator=(const HSTrampolinePool&) = delete;
+
+	private:
+		struct Page
+		{
+			ptrU8 pBase;
+			Page* pNext;
+			unsigned32 uUsedNum;
+			unsigned32 aUsed[HS_POOL_MAP_NUM]; // Slot is handed out
+			unsigned32 aHead[HS_POOL_MAP_NUM]; // Slot starts a block
+		};
+
+		Page* m_pPageList;
+		unsigned32 m_uPageNum;
+		unsigned32 m_uUsedSlotNum;
+		unsigned32 m_uBlockNum;
+
+		static bool TestBit(const unsigned32* pMap, unsigned32 uIndex);
+
+		static void SetBit(unsigned32* pMap, unsigned32 uIndex, bool bValue);
+
+		static bool FindRun(const Page* pPage, unsigned32 uNeed, unsigned32& uStart);
+
+		static bool IsPageNear(const Page* pPage, ptrAny pNear);
+
+		Page* FindPage(ptrAny pMem, Page**& pLink);
+
+		Page* NewPage(ptrAny pNear);
+
+		static ptrAny PageAlloc(ptrAny pNear);
+
+		static bool PageFree(ptrAny pPage);
+	};
+}
@@ -0,0 +1,393 @@
+#include "HS_Prot.h"
+#include <algorithm>
+
+namespace HSLL
+{
+	void HSProtManager::CollectPages(const HSProtRange* pRanges, unsigned32 uNum, std::vector<unsignedP>& vecPages)
+	{
+		unsignedP uPageSize = PageSize();
+
+		for (unsigned32 i = 0; i < uNum; i++)
+		{
+			if (pRanges[i].pAddr == nullptr || pRanges[i].uSize == 0)
+			{
+				continue;
+			}
+
+			unsignedP uStart = (unsignedP)pRanges[i].pAddr & ~(uPageSize - 1);
+			unsignedP uEnd = (unsignedP)pRanges[i].pAddr + pRanges[i].uSize;
+
+			for (unsignedP uPage = uStart; uPage < uEnd; uPage += uPageSize)
+			{
+				vecPages.push_back(uPage);
+			}
+		}
+
+		std::sort(vecPages.begin(), vecPages.end());
+		vecPages.erase(std::unique(vecPages.begin(), vecPages.end()), vecPages.end());
+	}
+
+	bool HSProtManager::ApplyRuns(const unsignedP* pPages, const unsigned32* pProt, unsigned32 uNum)
+	{
+		unsignedP uPageSize = PageSize();
+		unsigned32 uStart = 0;
+
+		for (unsigned32 i = 1; i <= uNum; i++)
+		{
+			if (i < uNum && pPages[i] == pPages[i - 1] + uPageSize && pProt[i] == pProt[uStart])
+			{
+				continue;
+			}
+
+			if (!SetProt(pPages[uStart], pPages[i - 1] + uPageSize - pPages[uStart], pProt[uStart]))
+			{
+				return false;
+			}
+
+			uStart = i;
+		}
+
+		return true;
+	}
+
+	bool HSProtManager::Unprotect(const HSProtRange* pRanges, unsigned32 uNum)
+	{
+		std::vector<unsignedP> vecPages;
+		CollectPages(pRanges, uNum, vecPages);
+
+		if (vecPages.empty())
+		{
+			return false;
+		}
+
+		// Only pages never seen before cost a protection query, the others keep their original
+		std::vector<unsignedP> vecNew;
+
+		for (unsignedP uPage : vecPages)
+		{
+			if (!m_oPages.FindContext(uPage))
+			{
+				vecNew.push_back(uPage);
+			}
+		}
+
+		if (!vecNew.empty())
+		{
+			std::vector<unsigned32> vecOriginal(vecNew.size());
+
+			if (!QueryProt(vecNew.data(), (unsigned32)vecNew.size(), vecOriginal.data())
+				|| !m_oPages.Reserve((unsigned32)vecNew.size()))
+			{
+				return false;
+			}
+
+			for (size_t i = 0; i < vecNew.size(); i++)
+			{
+				m_oPages.SetContext(vecNew[i], HSPageContext{ vecOriginal[i], 0, false });
+			}
+		}
+
+		std::vector<unsignedP> vecChange;
+		std::vector<unsigned32> vecWritable;
+		std::vector<unsigned32> vecRollback;
+
+		for (unsignedP uPage : vecPages)
+		{
+			HSPageContext* pContext = m_oPages.FindContext(uPage);
+
+			if (pContext->uRefCount == 0 && MakeWritable(pContext->uOriginal) != pContext->uOriginal)
+			{
+				vecChange.push_back(uPage);
+				vecWritable.push_back(MakeWritable(pContext->uOriginal));
+				vecRollback.push_back(pContext->uOriginal);
+			}
+		}
+
+		if (!vecChange.empty() && !ApplyRuns(vecChange.data(), vecWritable.data(), (unsigned32)vecChange.size()))
+		{
+			ApplyRuns(vecChange.data(), vecRollback.data(), (unsigned32)vecChange.size());
+
+			// The cached protection may be stale (the mapping was replaced), query it again next time
+			for (unsignedP uPage : vecPages)
+			{
+				HSPageContext* pContext = m_oPages.FindContext(uPage);
+
+				if (pContext->uRefCount == 0)
+				{
+					m_uDirtyNum -= pContext->bDirty ? 1 : 0;
+					m_oPages.RemoveContext(uPage);
+				}
+			}
+
+			return false;
+		}
+
+		for (unsignedP uPage : vecPages)
+		{
+			HSPageContext* pContext = m_oPages.FindContext(uPage);
+
+			if (pContext->bDirty)
+			{
+				pContext->bDirty = false;
+				m_uDirtyNum--;
+			}
+
+			pContext->uRefCount++;
+		}
+
+		return true;
+	}
+
+	bool HSProtManager::Restore(const HSProtRange* pRanges, unsigned32 uNum)
+	{
+		std::vector<unsignedP> vecPages;
+		CollectPages(pRanges, uNum, vecPages);
+
+		bool bResult = !vecPages.empty();
+		std::vector<unsignedP> vecRelease;
+
+		for (unsignedP uPage : vecPages)
+		{
+			HSPageContext* pContext = m_oPages.FindContext(uPage);
+
+			if (pContext == nullptr || pContext->uRefCount == 0)
+			{
+				bResult = false;
+				continue;
+			}
+
+			if (--pContext->uRefCount == 0)
+			{
+				vecRelease.push_back(uPage);
+			}
+		}
+
+		// Pages an earlier Restore failed to put back are retried along with this batch
+		if (m_uDirtyNum)
+		{
+			m_oPages.ForEach([&](unsignedP uPage, const HSPageContext& stContext)
+				{
+					if (stContext.bDirty)
+					{
+						vecRelease.push_back(uPage);
+					}
+				});
+
+			std::sort(vecRelease.begin(), vecRelease.end());
+			vecRelease.erase(std::unique(vecRelease.begin(), vecRelease.end()), vecRelease.end());
+		}
+
+		std::vector<unsignedP> vecChange;
+		std::vector<unsigned32> vecOriginal;
+
+		for (unsignedP uPage : vecRelease)
+		{
+			HSPageContext* pContext = m_oPages.FindContext(uPage);
+
+			if (MakeWritable(pContext->uOriginal) != pContext->uOriginal)
+			{
+				vecChange.push_back(uPage);
+				vecOriginal.push_back(pContext->uOriginal);
+			}
+		}
+
+		bool bRestored = vecChange.empty() || ApplyRuns(vecChange.data(), vecOriginal.data(), (unsigned32)vecChange.size());
+
+		for (unsignedP uPage : vecChange)
+		{
+			HSPageContext* pContext = m_oPages.FindContext(uPage);
+
+			if (pContext->bDirty != !bRestored)
+			{
+				pContext->bDirty = !bRestored;
+				m_uDirtyNum += bRestored ? (unsigned32)-1 : 1;
+			}
+		}
+
+		return bResult && bRestored;
+	}
+
+	unsigned32 HSProtManager::GetDirtyNum() const
+	{
+		return m_uDirtyNum;
+	}
+}
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+namespace HSLL
+{
+	unsignedP HSProtManager::PageSize()
+	{
+		static unsignedP uPageSize = 0;
+
+		if (uPageSize == 0)
+		{
+			SYSTEM_INFO stInfo;
+			GetSystemInfo(&stInfo);
+			uPageSize = stInfo.dwPageSize;
+		}
+
+		return uPageSize;
+	}
+
+	bool HSProtManager::QueryProt(const unsignedP* pPages, unsigned32 uNum, unsigned32* pProt)
+	{
+		for (unsigned32 i = 0; i < uNum; i++)
+		{
+			MEMORY_BASIC_INFORMATION stInfo;
+
+			if (VirtualQuery((LPCVOID)pPages[i], &stInfo, sizeof(stInfo)) == 0 || stInfo.State != MEM_COMMIT)
+			{
+				return false;
+			}
+
+			pProt[i] = stInfo.Protect;
+		}
+
+		return true;
+	}
+
+	bool HSProtManager::SetProt(unsignedP uAddr, unsignedP uSize, unsigned32 uProt)
+	{
+		DWORD uOldProtect;
+		return VirtualProtect((LPVOID)uAddr, uSize, uProt, &uOldProtect) != 0;
+	}
+
+	unsigned32 HSProtManager::MakeWritable(unsigned32 uProt)
+	{
+		unsigned32 uModifier = uProt & ~0xFFu;
+
+		switch (uProt & 0xFF)
+		{
+		case PAGE_READONLY:
+			return PAGE_READWRITE | uModifier;
+		case PAGE_EXECUTE:
+		case PAGE_EXECUTE_READ:
+			return PAGE_EXECUTE_READWRITE | uModifier;
+		default:
+			return uProt;
+		}
+	}
+}
+#elif defined(__unix__)
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace HSLL
+{
+	unsignedP HSProtManager::PageSize()
+	{
+		static unsignedP uPageSize = 0;
+
+		if (uPageSize == 0)
+		{
+			long sPageSize = sysconf(_SC_PAGESIZE);
+			uPageSize = sPageSize > 0 ? (unsignedP)sPageSize : 4096;
+		}
+
+		return uPageSize;
+	}
+
+	static bool HSParseHex(const char*& pCur, const char* pEnd, unsignedP& uValue)
+	{
+		const char* pStart = pCur;
+		uValue = 0;
+
+		for (; pCur < pEnd; pCur++)
+		{
+			char c = *pCur;
+
+			if (c >= '0' && c <= '9')
+			{
+				uValue = (uValue << 4) | (unsignedP)(c - '0');
+			}
+			else if (c >= 'a' && c <= 'f')
+			{
+				uValue = (uValue << 4) | (unsignedP)(c - 'a' + 10);
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		return pCur != pStart;
+	}
+
+	bool HSProtManager::QueryProt(const unsignedP* pPages, unsigned32 uNum, unsigned32* pProt)
+	{
+		signed32 sFd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+
+		if (sFd < 0)
+		{
+			return false;
+		}
+
+		std::vector<char> vecMaps;
+		char pChunk[4096];
+		ssize_t sRead;
+
+		while ((sRead = read(sFd, pChunk, sizeof(pChunk))) > 0)
+		{
+			vecMaps.insert(vecMaps.end(), pChunk, pChunk + sRead);
+		}
+
+		close(sFd);
+
+		// Both the maps file and the page list are sorted, walk them together in one pass
+		const char* pCur = vecMaps.data();
+		const char* pEnd = pCur + vecMaps.size();
+		unsigned32 uIndex = 0;
+
+		while (pCur < pEnd && uIndex < uNum)
+		{
+			unsignedP uStart, uEnd;
+			const char* pLine = pCur;
+
+			while (pCur < pEnd && *pCur != '\n')
+			{
+				pCur++;
+			}
+
+			const char* pLineEnd = pCur++;
+
+			if (!HSParseHex(pLine, pLineEnd, uStart) || pLine >= pLineEnd || *pLine++ != '-'
+				|| !HSParseHex(pLine, pLineEnd, uEnd) || pLineEnd - pLine < 4)
+			{
+				continue;
+			}
+
+			pLine++;
+			unsigned32 uProt = PROT_NONE;
+			uProt |= (pLine[0] == 'r') ? PROT_READ : 0;
+			uProt |= (pLine[1] == 'w') ? PROT_WRITE : 0;
+			uProt |= (pLine[2] == 'x') ? PROT_EXEC : 0;
+
+			if (pPages[uIndex] < uStart)
+			{
+				return false;
+			}
+
+			while (uIndex < uNum && pPages[uIndex] < uEnd)
+			{
+				pProt[uIndex++] = uProt;
+			}
+		}
+
+		return uIndex == uNum;
+	}
+
+	bool HSProtManager::SetProt(unsignedP uAddr, unsignedP uSize, unsigned32 uProt)
+	{
+		return mprotect((ptrAny)uAddr, uSize, uProt) == 0;
+	}
+
+	unsigned32 HSProtManager::MakeWritable(unsigned32 uProt)
+	{
+		return uProt | PROT_READ | PROT_WRITE;
+	}
+}
+#endif
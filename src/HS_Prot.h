@@ -0,0 +1,71 @@
+#pragma once
+#include "HS_Type.h"
+#include "HS_Context.h"
+#include <vector>
+
+namespace HSLL
+{
+	struct HSProtRange
+	{
+		ptrAny pAddr;    // Start of the code to be patched
+		unsignedP uSize; // Number of bytes to be patched
+	};
+
+	/**
+	 * @brief Makes patched code pages writable for the duration of a patch
+	 * @details Each page remembers the protection it had before it was first unlocked and is
+	 *          refcounted, so pages shared by several patches are unlocked once and put back
+	 *          once the last user is done. The original protection stays cached after that,
+	 *          only pages never seen before are queried (a /proc/self/maps read on Linux). A
+	 *          page Restore fails to put back is kept dirty and retried by every later Restore.
+	 *          Adjacent pages that need the same protection are changed with a single syscall.
+	 *          Not thread-safe, the caller serializes access.
+	 */
+	class HSProtManager
+	{
+	public:
+		HSProtManager() : m_uDirtyNum(0)
+		{
+		}
+
+		/**
+		 * @brief Makes every page of the ranges writable, nothing is changed on failure
+		 */
+		bool Unprotect(const HSProtRange* pRanges, unsigned32 uNum);
+
+		/**
+		 * @brief Puts back the pages no other Unprotect still covers
+		 * @details Returns false if any page could not be re-protected, the refcounts are
+		 *          released anyway and the failed pages are retried by the next Restore.
+		 */
+		bool Restore(const HSProtRange* pRanges, unsigned32 uNum);
+
+		/**
+		 * @brief Number of released pages still left writable by a failed Restore
+		 */
+		unsigned32 GetDirtyNum() const;
+
+	private:
+		struct HSPageContext
+		{
+			unsigned32 uOriginal; // Protection before the first Unprotect
+			unsigned32 uRefCount; // Number of outstanding Unprotect calls covering the page
+			bool bDirty;          // Released but still writable, the last Restore failed
+		};
+
+		HSContextManager<HSPageContext> m_oPages;
+		unsigned32 m_uDirtyNum;
+
+		static unsignedP PageSize();
+
+		static void CollectPages(const HSProtRange* pRanges, unsigned32 uNum, std::vector<unsignedP>& vecPages);
+
+		static bool ApplyRuns(const unsignedP* pPages, const unsigned32* pProt, unsigned32 uNum);
+
+		static bool QueryProt(const unsignedP* pPages, unsigned32 uNum, unsigned32* pProt);
+
+		static bool SetProt(unsignedP uAddr, unsignedP uSize, unsigned32 uProt);
+
+		static unsigned32 MakeWritable(unsigned32 uProt);
+	};
+}
@@ -3,222 +3,276 @@
 #include <atomic>
 #include <thread>
 
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#if defined(_MSC_VER)
+#pragma comment(lib, "Synchronization.lib")
+#endif
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <sched.h>
+#include <stddef.h>
+
+extern "C"
+{
+	// Exported by glibc 2.35 and later, unresolved (null) with an older C library
+	extern const ptrdiff_t __rseq_offset __attribute__((weak));
+	extern const unsigned int __rseq_size __attribute__((weak));
+}
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 namespace HSLL
 {
 	namespace INNER
 	{
 		constexpr signedP HS_SPINRWLOCK_MAXSLOTS = 32;
-		constexpr signedP HS_SPINRWLOCK_MAXREADER = (sizeof(signedP) == 4 ? (1 << 30) : (1LL << 62));
+		constexpr unsigned32 HS_SPINRWLOCK_MINSPIN = 16;
+		constexpr unsigned32 HS_SPINRWLOCK_MAXSPIN = 4096;
 
+		/**
+		 * @brief Number of the CPU the calling thread runs on, only used to spread readers
+		 */
+		inline unsigned32 HSCurrentCpu() noexcept
+		{
+#if defined(_WIN32)
+			return (unsigned32)GetCurrentProcessorNumber();
+#elif defined(__linux__)
+#if defined(__i386__) || defined(__x86_64__)
+			// A registered rseq area holds the CPU number, one load instead of a vDSO call
+			if (&__rseq_size != nullptr && __rseq_size != 0)
+			{
+				unsignedP uThread;
+#if defined(__i386__)
+				__asm__("movl %%gs:0, %0" : "=r"(uThread));
+#else
+				__asm__("movq %%fs:0, %0" : "=r"(uThread));
+#endif
+				// struct rseq: cpu_id_start, then cpu_id
+				return *(volatile unsigned32*)(uThread + __rseq_offset + 4);
+			}
+#endif
+			signed32 sCpu = sched_getcpu();
+			return sCpu < 0 ? 0 : (unsigned32)sCpu;
+#else
+			static std::atomic<unsigned32> s_uNext(0);
+			static thread_local unsigned32 s_uIndex = s_uNext.fetch_add(1, std::memory_order_relaxed);
+			return s_uIndex;
+#endif
+		}
+
+		inline void HSCpuRelax() noexcept
+		{
+#if defined(_MSC_VER)
+			_mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+			__builtin_ia32_pause();
+#endif
+		}
+
+		inline void HSFutexWait(std::atomic<unsigned32>& uWord, unsigned32 uExpected) noexcept
+		{
+#if defined(_WIN32)
+			WaitOnAddress((volatile VOID*)&uWord, &uExpected, sizeof(uExpected), INFINITE);
+#elif defined(__linux__)
+			syscall(SYS_futex, (unsigned32*)&uWord, FUTEX_WAIT_PRIVATE, uExpected, nullptr, nullptr, 0);
+#else
+			(void)uWord;
+			(void)uExpected;
+			std::this_thread::yield();
+#endif
+		}
+
+		inline void HSFutexWake(std::atomic<unsigned32>& uWord) noexcept
+		{
+#if defined(_WIN32)
+			WakeByAddressAll((PVOID)&uWord);
+#elif defined(__linux__)
+			syscall(SYS_futex, (unsigned32*)&uWord, FUTEX_WAKE_PRIVATE, 0x7FFFFFFF, nullptr, nullptr, 0);
+#else
+			(void)uWord;
+#endif
+		}
+
+		/**
+		 * @brief Reader-writer lock with per-CPU reader slots and FIFO writers
+		 * @details A reader counts itself in the slot of the CPU it runs on, so readers on
+		 *          different cores touch different cache lines and threads sharing a core share
+		 *          one. Writers take tickets and are served in order. The serving writer closes
+		 *          the gate, readers that see it closed step back out, and it waits for the slots
+		 *          to drain. Every wait spins for an adaptive budget that grows while spinning
+		 *          pays off and shrinks when it does not, then sleeps on a futex (WaitOnAddress on
+		 *          Windows). Nobody makes a syscall to wake threads unless a thread is asleep.
+		 */
 		class HSSpinRWLock
 		{
 		private:
 
-			class alignas(64) InnerLock
+			struct alignas(64) ReaderSlot
 			{
-			private:
 				std::atomic<signedP> uCount;
+			};
 
-			public:
-
-				InnerLock() noexcept : uCount(0) {}
+			// Read by every reader, written only when a writer enters or leaves
+			alignas(64) std::atomic<unsigned32> m_uWriting; // 1 while the serving writer holds or waits for the readers
+			std::atomic<unsigned32> m_uSleepers;            // Threads in a futex wait on any word of the lock
 
-				void LockRead() noexcept
-				{
-					signedP uOld = uCount.fetch_add(1, std::memory_order_acquire);
+			alignas(64) std::atomic<unsigned32> m_uTicket;  // Next writer ticket
+			std::atomic<unsigned32> m_uServing;             // Ticket allowed to write
+			std::atomic<unsigned32> m_uDrain;               // Bumped when a reader empties a slot while a writer waits
+			std::atomic<unsigned32> m_uSpin;                // Current spin budget
 
-					while (uOld < 0)
-					{
-						uCount.fetch_sub(1, std::memory_order_relaxed);
+			ReaderSlot m_oSlots[HS_SPINRWLOCK_MAXSLOTS];
 
-						std::this_thread::yield();
+			template <typename Pred>
+			void Wait(std::atomic<unsigned32>& uWord, Pred fnReady) noexcept
+			{
+				unsigned32 uLimit = m_uSpin.load(std::memory_order_relaxed);
 
-						while (uCount.load(std::memory_order_relaxed) < 0)
-							std::this_thread::yield();
+				for (unsigned32 i = 0; i < uLimit; ++i)
+				{
+					if (fnReady())
+					{
+						if (uLimit < HS_SPINRWLOCK_MAXSPIN)
+							m_uSpin.store(uLimit + uLimit / 4, std::memory_order_relaxed);
 
-						uOld = uCount.fetch_add(1, std::memory_order_acquire);
+						return;
 					}
-				}
 
-				void UnlockRead() noexcept
-				{
-					uCount.fetch_sub(1, std::memory_order_relaxed);
+					HSCpuRelax();
 				}
 
-				bool MarkWrite() noexcept
-				{
-					return !uCount.fetch_sub(HS_SPINRWLOCK_MAXREADER, std::memory_order_relaxed);
-				}
+				if (uLimit > HS_SPINRWLOCK_MINSPIN)
+					m_uSpin.store(uLimit / 2, std::memory_order_relaxed);
 
-				void UnmarkWrite(bool bReady) noexcept
+				// Whoever makes fnReady true changes uWord before looking at m_uSleepers, so the wait cannot miss it
+				while (!fnReady())
 				{
-					if (bReady)
-						uCount.store(0, std::memory_order_relaxed);
-					else
-						uCount.fetch_add(HS_SPINRWLOCK_MAXREADER, std::memory_order_relaxed);
-				}
+					unsigned32 uValue = uWord.load(std::memory_order_seq_cst);
+					m_uSleepers.fetch_add(1, std::memory_order_seq_cst);
 
-				void UnlockWrite() noexcept
-				{
-					uCount.store(0, std::memory_order_release);
-				}
+					if (!fnReady())
+						HSFutexWait(uWord, uValue);
 
-				bool IsWriteReady() noexcept
-				{
-					return uCount.load(std::memory_order_relaxed) == -HS_SPINRWLOCK_MAXREADER;
+					m_uSleepers.fetch_sub(1, std::memory_order_relaxed);
 				}
-			};
+			}
 
-			class LocalReadLock
+			void WakeAll(std::atomic<unsigned32>& uWord) noexcept
 			{
-				InnerLock& m_oLocalLock;
-
-			public:
-
-				explicit LocalReadLock(InnerLock& oLocalLock) noexcept : m_oLocalLock(oLocalLock) {}
-
-				void LockRead() noexcept
-				{
-					m_oLocalLock.LockRead();
-				}
+				if (m_uSleepers.load(std::memory_order_seq_cst))
+					HSFutexWake(uWord);
+			}
 
-				void UnlockRead() noexcept
+			void Release(ReaderSlot& stSlot) noexcept
+			{
+				// The last reader out of a slot while a writer waits lets it check again
+				if (stSlot.uCount.fetch_sub(1, std::memory_order_seq_cst) == 1 && m_uWriting.load(std::memory_order_seq_cst))
 				{
-					m_oLocalLock.UnlockRead();
+					m_uDrain.fetch_add(1, std::memory_order_seq_cst);
+					WakeAll(m_uDrain);
 				}
-			};
-
-			std::atomic<bool> m_bFlag;
-			InnerLock m_oRWLocks[HS_SPINRWLOCK_MAXSLOTS];
-
-			thread_local static signedP m_uLocalIndex;
-			static std::atomic<signedP> m_uGlobalIndex;
-
-			inline LocalReadLock GetLocalLock() noexcept
-			{
-				signedP uIndex = m_uLocalIndex;
-
-				if (uIndex == -1)
-					uIndex = m_uLocalIndex = m_uGlobalIndex.fetch_add(1, std::memory_order_relaxed) % HS_SPINRWLOCK_MAXSLOTS;
-
-				return LocalReadLock(m_oRWLocks[uIndex]);
 			}
 
-			bool TryMarkWrite(bool pFlagArray[HS_SPINRWLOCK_MAXSLOTS]) noexcept
+			bool IsDrained() noexcept
 			{
-				bool uOld = true;
-
-				if (!m_bFlag.compare_exchange_strong(uOld, false, std::memory_order_acquire, std::memory_order_relaxed))
-					return false;
-
 				for (signedP i = 0; i < HS_SPINRWLOCK_MAXSLOTS; ++i)
-					pFlagArray[i] = m_oRWLocks[i].MarkWrite();
+				{
+					if (m_oSlots[i].uCount.load(std::memory_order_seq_cst) != 0)
+						return false;
+				}
 
 				return true;
 			}
 
-			bool TryMarkWriteCheckBefore(bool pFlagArray[HS_SPINRWLOCK_MAXSLOTS]) noexcept
-			{
-				if (!m_bFlag.load(std::memory_order_relaxed))
-					return false;
-
-				return TryMarkWrite(pFlagArray);
-			}
-
-			void MarkWrite(bool pFlagArray[HS_SPINRWLOCK_MAXSLOTS]) noexcept
-			{
-				if (TryMarkWrite(pFlagArray))
-					return;
-
-				std::this_thread::yield();
-
-				while (!TryMarkWriteCheckBefore(pFlagArray))
-					std::this_thread::yield();
-			}
+		public:
 
-			void UnmarkWrite(bool pFlagArray[HS_SPINRWLOCK_MAXSLOTS]) noexcept
+			HSSpinRWLock() noexcept : m_uWriting(0), m_uSleepers(0), m_uTicket(0), m_uServing(0), m_uDrain(0), m_uSpin(256)
 			{
 				for (signedP i = 0; i < HS_SPINRWLOCK_MAXSLOTS; ++i)
-					m_oRWLocks[i].UnmarkWrite(pFlagArray[i]);
-
-				m_bFlag.store(true, std::memory_order_relaxed);
+					m_oSlots[i].uCount.store(0, std::memory_order_relaxed);
 			}
 
-			signedP ReadyCount(signedP uStartIndex, bool pFlagArray[HS_SPINRWLOCK_MAXSLOTS]) noexcept
+			/**
+			 * @return Slot the reader counted itself in, UnlockRead needs it back since the thread may migrate
+			 */
+			signedP LockRead() noexcept
 			{
-				signedP uIndex = HS_SPINRWLOCK_MAXSLOTS;
+				signedP uSlot = (signedP)(HSCurrentCpu() % HS_SPINRWLOCK_MAXSLOTS);
+				ReaderSlot& stSlot = m_oSlots[uSlot];
 
-				for (signedP i = uStartIndex; i < HS_SPINRWLOCK_MAXSLOTS; ++i)
+				while (true)
 				{
-					if (pFlagArray[i])
-						continue;
+					stSlot.uCount.fetch_add(1, std::memory_order_seq_cst);
 
-					pFlagArray[i] = m_oRWLocks[i].IsWriteReady();
+					if (m_uWriting.load(std::memory_order_seq_cst) == 0)
+						return uSlot;
 
-					if (!pFlagArray[i] && i < uIndex)
-						uIndex = i;
+					// A writer closed the gate, step back out of its way until it is done
+					Release(stSlot);
+					Wait(m_uWriting, [this]() { return m_uWriting.load(std::memory_order_acquire) == 0; });
 				}
-
-				return uIndex;
-			}
-
-		public:
-
-			HSSpinRWLock() noexcept : m_bFlag(true) {}
-
-			void LockRead() noexcept
-			{
-				GetLocalLock().LockRead();
 			}
 
-			void UnlockRead() noexcept
+			void UnlockRead(signedP uSlot) noexcept
 			{
-				GetLocalLock().UnlockRead();
+				Release(m_oSlots[uSlot]);
 			}
 
 			void LockWrite() noexcept
 			{
-				bool aFlagArray[HS_SPINRWLOCK_MAXSLOTS];
+				unsigned32 uTicket = m_uTicket.fetch_add(1, std::memory_order_relaxed);
 
-				MarkWrite(aFlagArray);
+				if (m_uServing.load(std::memory_order_acquire) != uTicket)
+					Wait(m_uServing, [this, uTicket]() { return m_uServing.load(std::memory_order_acquire) == uTicket; });
 
-				signedP uNextCheckIndex = 0;
+				m_uWriting.store(1, std::memory_order_seq_cst);
 
-				while ((uNextCheckIndex = ReadyCount(uNextCheckIndex, aFlagArray)) != HS_SPINRWLOCK_MAXSLOTS)
-					std::this_thread::yield();
+				if (!IsDrained())
+					Wait(m_uDrain, [this]() { return IsDrained(); });
 			}
 
 			void UnlockWrite() noexcept
 			{
-				for (signedP i = 0; i < HS_SPINRWLOCK_MAXSLOTS; ++i)
-					m_oRWLocks[i].UnlockWrite();
+				// Readers get in between two writers, the next one closes the gate again once it is served
+				m_uWriting.store(0, std::memory_order_seq_cst);
+				m_uServing.fetch_add(1, std::memory_order_seq_cst);
 
-				m_bFlag.store(true, std::memory_order_release);
+				if (m_uSleepers.load(std::memory_order_seq_cst))
+				{
+					HSFutexWake(m_uWriting);
+					HSFutexWake(m_uServing);
+				}
 			}
 
 			HSSpinRWLock(const HSSpinRWLock&) = delete;
 			HSSpinRWLock& operator=(const HSSpinRWLock&) = delete;
 		};
 
-		std::atomic<signedP> HSSpinRWLock::m_uGlobalIndex{ 0 };
-		thread_local signedP HSSpinRWLock::m_uLocalIndex{ -1 };
-
 		class HSReadLockGuard
 		{
 		private:
 
 			HSSpinRWLock& oLock;
+			signedP uSlot;
 
 		public:
 
-			explicit HSReadLockGuard(HSSpinRWLock& oLock) noexcept : oLock(oLock)
+			explicit HSReadLockGuard(HSSpinRWLock& oLock) noexcept : oLock(oLock), uSlot(oLock.LockRead())
 			{
-				oLock.LockRead();
 			}
 
 			~HSReadLockGuard() noexcept
 			{
-				oLock.UnlockRead();
+				oLock.UnlockRead(uSlot);
 			}
 
 			HSReadLockGuard(const HSReadLockGuard&) = delete;
@@ -0,0 +1,249 @@
+#include "HS_Shadow.h"
+#if defined(_M_IX86) || defined(__i386__)
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define HS_SHADOW_CDECL __cdecl
+#else
+#include <x86intrin.h>
+#define HS_SHADOW_CDECL __attribute__((cdecl))
+#endif
+
+namespace HSLL
+{
+	struct HSShadowThread
+	{
+		HSShadowFrame* pFrames;
+		unsigned32 uDepth;
+		unsigned32 uCapacity;
+		bool bGrowing; // Set while the frames are reallocated, and for good once the thread is torn down
+
+		~HSShadowThread()
+		{
+			// Destructors of other thread locals may still reach a stub, they find no room and go untracked
+			free(pFrames);
+			pFrames = nullptr;
+			uDepth = uCapacity = 0;
+			bGrowing = true;
+		}
+	};
+
+	static ptrAny g_pExitThunk = nullptr;
+	static thread_local HSShadowThread g_oShadow = {};
+
+	static bool HSGrow(HSShadowThread& stThread)
+	{
+		if (stThread.bGrowing || stThread.uCapacity >= HSShadowStack::HS_SHADOW_MAX_DEPTH)
+		{
+			return false;
+		}
+
+		unsigned32 uCapacity = stThread.uCapacity ? stThread.uCapacity * 2 : HSShadowStack::HS_SHADOW_INIT_DEPTH;
+
+		// An instrumented allocator would come straight back here, the stack is full so it goes untracked
+		stThread.bGrowing = true;
+		HSShadowFrame* pFrames = (HSShadowFrame*)realloc(stThread.pFrames, uCapacity * sizeof(HSShadowFrame));
+		stThread.bGrowing = false;
+
+		if (pFrames == nullptr)
+		{
+			return false;
+		}
+
+		stThread.pFrames = pFrames;
+		stThread.uCapacity = uCapacity;
+		return true;
+	}
+
+	static void HS_SHADOW_CDECL HSShadowEnter(HSShadowOwner* pOwner, ptrAny* pSlot)
+	{
+		if (pOwner->pfnEnter)
+		{
+			pOwner->pfnEnter(*pOwner);
+		}
+
+		HSShadowThread& stThread = g_oShadow;
+
+		// Live callers sit higher on the stack, a frame at or below the new return slot was left behind by a longjmp
+		while (stThread.uDepth > 0 && stThread.pFrames[stThread.uDepth - 1].pSlot <= pSlot)
+		{
+			stThread.uDepth--;
+		}
+
+		// Past the depth limit or out of memory the call still runs, its exit is just not seen
+		if (stThread.uDepth == stThread.uCapacity && !HSGrow(stThread))
+		{
+			return;
+		}
+
+		// Claim the frame first, a signal handler running an instrumented function takes the next one
+		HSShadowFrame& stFrame = stThread.pFrames[stThread.uDepth++];
+		stFrame.pSlot = pSlot;
+		stFrame.pRet = *pSlot;
+		stFrame.pOwner = pOwner;
+		*pSlot = g_pExitThunk;
+		stFrame.uStart = __rdtsc();
+	}
+
+	static ptrAny HS_SHADOW_CDECL HSShadowLeave(ptrU8 pStack)
+	{
+		unsigned64 uEnd = __rdtsc();
+		HSShadowThread& stThread = g_oShadow;
+		unsigned32 i = stThread.uDepth - 1;
+
+		// Older frames sit higher on the stack, one below the caller's stack pointer means a longjmp left the frames above it behind
+		while (i > 0 && (ptrU8)stThread.pFrames[i - 1].pSlot < pStack)
+		{
+			i--;
+		}
+
+		// Pop before the owner runs, it may call instrumented functions itself
+		HSShadowFrame stFrame = stThread.pFrames[i];
+		stThread.uDepth = i;
+
+		// The thunk pushed eax, edx and ecx below the slot of the real return address
+		HSShadowRegs& stRegs = *(HSShadowRegs*)(pStack - 4 - sizeof(HSShadowRegs));
+		stFrame.pOwner->pfnLeave(*stFrame.pOwner, stFrame, stRegs, uEnd - stFrame.uStart);
+		return stFrame.pRet;
+	}
+
+	static ptrU8 HSEmitCall(ptrU8 pCode, ptrAny pFunc)
+	{
+		*pCode = 0xE8;
+		*(ptrS32)(pCode + 1) = (signed32)pFunc - (signed32)pCode - 5;
+		return pCode + 5;
+	}
+
+	static ptrU8 HSEmitBytes(ptrU8 pCode, const unsigned8* pBytes, unsigned32 uSize)
+	{
+		memcpy(pCode, pBytes, uSize);
+		return pCode + uSize;
+	}
+
+	bool HSShadowStack::IsReady()
+	{
+		return g_pExitThunk != nullptr;
+	}
+
+	void HSShadowStack::Init(ptrU8 pThunk)
+	{
+		// sub esp,4 (slot for the real return address), push eax/edx/ecx (return value), lea eax,[esp+16],
+		// push ebp, mov ebp,esp, and esp,-16, sub esp,12, push eax
+		static const unsigned8 pHead[] = { 0x83, 0xEC, 0x04, 0x50, 0x52, 0x51, 0x8D, 0x44, 0x24, 0x10,
+			0x55, 0x89, 0xE5, 0x83, 0xE4, 0xF0, 0x83, 0xEC, 0x0C, 0x50 };
+		// mov esp,ebp, pop ebp, mov [esp+12],eax, pop ecx/edx/eax, ret
+		static const unsigned8 pTail[] = { 0x89, 0xEC, 0x5D, 0x89, 0x44, 0x24, 0x0C, 0x59, 0x5A, 0x58, 0xC3 };
+
+		ptrU8 pCode = HSEmitBytes(pThunk, pHead, sizeof(pHead));
+		pCode = HSEmitCall(pCode, (ptrAny)&HSShadowLeave);
+		HSEmitBytes(pCode, pTail, sizeof(pTail));
+		g_pExitThunk = pThunk;
+	}
+
+	void HSShadowStack::WriteStub(ptrU8 pStub, HSShadowOwner* pOwner)
+	{
+		// push ecx/edx/eax (register arguments), lea eax,[esp+12] (return slot), push ebp, mov ebp,esp,
+		// and esp,-16, sub esp,8, push eax
+		static const unsigned8 pHead[] = { 0x51, 0x52, 0x50, 0x8D, 0x44, 0x24, 0x0C, 0x55, 0x89, 0xE5, 0x83, 0xE4, 0xF0, 0x83, 0xEC, 0x08, 0x50 };
+		// mov esp,ebp, pop ebp, pop eax/edx/ecx
+		static const unsigned8 pTail[] = { 0x89, 0xEC, 0x5D, 0x58, 0x5A, 0x59 };
+
+		ptrU8 pCode = HSEmitBytes(pStub, pHead, sizeof(pHead));
+		*pCode = 0x68;
+		*(HSShadowOwner**)(pCode + 1) = pOwner;
+		pCode = HSEmitCall(pCode + 5, (ptrAny)&HSShadowEnter);
+		pCode = HSEmitBytes(pCode, pTail, sizeof(pTail));
+
+		// jmp dword ptr [pNext]
+		pCode[0] = 0xFF;
+		pCode[1] = 0x25;
+		*(ptrAny**)(pCode + 2) = &pOwner->pNext;
+	}
+
+	void HSShadowStack::Unwind()
+	{
+		HSShadowThread& stThread = g_oShadow;
+
+		while (stThread.uDepth > 0)
+		{
+			const HSShadowFrame& stFrame = stThread.pFrames[--stThread.uDepth];
+
+			// A frame a longjmp left behind may point at a slot that has been reused since
+			if (*stFrame.pSlot == g_pExitThunk)
+			{
+				*stFrame.pSlot = stFrame.pRet;
+			}
+		}
+	}
+}
+
+#ifdef _WIN32
+namespace HSLL
+{
+	ptrAny HSShadowStack::GetUnwinder(unsigned32)
+	{
+		return nullptr;
+	}
+
+	ptrAny HSShadowStack::GetUnwindDetour(unsigned32)
+	{
+		return nullptr;
+	}
+
+	ptrAny* HSShadowStack::GetUnwindSlot(unsigned32)
+	{
+		return nullptr;
+	}
+}
+#elif defined(__unix__)
+#include <dlfcn.h>
+
+namespace HSLL
+{
+	static ptrAny g_pUnwindSlots[HSShadowStack::HS_SHADOW_UNWINDER_NUM];
+
+	using HSUnwind1 = signed32(*)(ptrAny);
+	using HSUnwind3 = signed32(*)(ptrAny, ptrAny, ptrAny);
+
+	static signed32 HSRaiseException(ptrAny pException)
+	{
+		HSShadowStack::Unwind();
+		return ((HSUnwind1)g_pUnwindSlots[0])(pException);
+	}
+
+	static signed32 HSResumeOrRethrow(ptrAny pException)
+	{
+		HSShadowStack::Unwind();
+		return ((HSUnwind1)g_pUnwindSlots[1])(pException);
+	}
+
+	static signed32 HSForcedUnwind(ptrAny pException, ptrAny pStop, ptrAny pParam)
+	{
+		HSShadowStack::Unwind();
+		return ((HSUnwind3)g_pUnwindSlots[2])(pException, pStop, pParam);
+	}
+
+	ptrAny HSShadowStack::GetUnwinder(unsigned32 uIndex)
+	{
+		// The DWARF unwinder walks return addresses, it must never find the exit thunk on the stack
+		static const char* pNames[HS_SHADOW_UNWINDER_NUM] = { "_Unwind_RaiseException", "_Unwind_Resume_or_Rethrow", "_Unwind_ForcedUnwind" };
+		return uIndex < HS_SHADOW_UNWINDER_NUM ? dlsym(RTLD_DEFAULT, pNames[uIndex]) : nullptr;
+	}
+
+	ptrAny HSShadowStack::GetUnwindDetour(unsigned32 uIndex)
+	{
+		static const ptrAny pDetours[HS_SHADOW_UNWINDER_NUM] = { (ptrAny)&HSRaiseException, (ptrAny)&HSResumeOrRethrow, (ptrAny)&HSForcedUnwind };
+		return uIndex < HS_SHADOW_UNWINDER_NUM ? pDetours[uIndex] : nullptr;
+	}
+
+	ptrAny* HSShadowStack::GetUnwindSlot(unsigned32 uIndex)
+	{
+		return uIndex < HS_SHADOW_UNWINDER_NUM ? &g_pUnwindSlots[uIndex] : nullptr;
+	}
+}
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+#if defined(_M_IX86) || defined(__i386__)
+
+#include "HS_Type.h"
+
+namespace HSLL
+{
+	struct HSShadowOwner;
+	struct HSShadowFrame;
+
+	struct HSShadowRegs
+	{
+		unsignedP uEcx;
+		unsignedP uEdx; // High half of a 64-bit return value
+		unsignedP uEax; // Return value, written back when the thunk returns
+	};
+
+	using HSShadowEnterFn = void(*)(HSShadowOwner& stOwner);
+	using HSShadowLeaveFn = void(*)(HSShadowOwner& stOwner, const HSShadowFrame& stFrame, HSShadowRegs& stRegs, unsigned64 uCycles);
+
+	struct HSShadowOwner
+	{
+		ptrAny pNext;             // Cell the entry stub jumps through after Enter
+		HSShadowEnterFn pfnEnter; // Runs on every call, may be null
+		HSShadowLeaveFn pfnLeave; // Runs when a tracked call returns through the exit thunk
+	};
+
+	struct HSShadowFrame
+	{
+		ptrAny* pSlot; // Stack slot of the return address, now holding the exit thunk
+		ptrAny pRet;
+		HSShadowOwner* pOwner;
+		unsigned64 uStart;
+	};
+
+	/**
+	 * @brief Per-thread shadow return stack behind generated entry stubs and one exit thunk
+	 * @details An entry stub calls Enter with its owner and the address of the return slot.
+	 *          Enter saves the return address in the calling thread's shadow stack, which is
+	 *          allocated on first use and doubles when full, and swaps it for the exit thunk.
+	 *          The thunk calls Leave, which pops the frame, lets the owner look at the return
+	 *          registers and hands back the real return address. A longjmp is detected from the
+	 *          stack pointer, frames whose return slot lies at or below a newer one are dropped.
+	 *          Exceptions are handled by hooking the unwinder entry points, which give every
+	 *          pending return address back before the unwinder walks the stack (Unix). Windows
+	 *          x86 unwinds through the SEH chain and never reads return addresses. Code that
+	 *          switches a thread between stacks (fibers, coroutines) is not supported.
+	 */
+	class HSShadowStack
+	{
+	public:
+		static constexpr unsigned32 HS_SHADOW_STUB_SIZE = 48;
+		static constexpr unsigned32 HS_SHADOW_INIT_DEPTH = 16;
+		static constexpr unsigned32 HS_SHADOW_MAX_DEPTH = 65536;
+		static constexpr unsigned32 HS_SHADOW_UNWINDER_NUM = 3;
+
+		static bool IsReady();
+
+		/**
+		 * @brief Writes the exit thunk, HS_SHADOW_STUB_SIZE executable bytes, once per process
+		 */
+		static void Init(ptrU8 pThunk);
+
+		static void WriteStub(ptrU8 pStub, HSShadowOwner* pOwner);
+
+		/**
+		 * @brief Gives every pending return address of the calling thread back to its caller
+		 * @details The exits of those calls are not reported.
+		 */
+		static void Unwind();
+
+		/**
+		 * @brief Unwinder entry point i, null when the process has none to hook
+		 */
+		static ptrAny GetUnwinder(unsigned32 uIndex);
+
+		static ptrAny GetUnwindDetour(unsigned32 uIndex);
+
+		static ptrAny* GetUnwindSlot(unsigned32 uIndex);
+	};
+}
+
+#endif
@@ -0,0 +1,306 @@
+#include "HS_Stats.h"
+#if defined(_M_IX86) || defined(__i386__)
+
+#include "HS_Shadow.h"
+#include <atomic>
+#include <string>
+#include <vector>
+#include <new>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace HSLL
+{
+	struct alignas(64) HSStatsCell
+	{
+		std::atomic<unsigned32> uSeq; // Odd while the owning thread updates the cell
+		unsigned64 uCalls;
+		unsigned64 uCycles;
+		unsigned64 pBuckets[HS_STATS_BUCKET_NUM];
+	};
+
+	struct HSStatsThread
+	{
+		HSStatsCell pCells[HSStatsManager::HS_STATS_MAX_HOOKS];
+		HSStatsThread* pNext;
+	};
+
+	struct HSStatsHook
+	{
+		HSShadowOwner stOwner; // First, the shadow stack hands it back to the callbacks
+		ptrAny pSrc;
+		ptrAny pStub;
+		unsigned32 uId;
+	};
+
+	static HSStatsHook g_aHooks[HSStatsManager::HS_STATS_MAX_HOOKS];
+	static unsigned32 g_uHookNum = 0;
+	static std::atomic<HSStatsThread*> g_pThreads(nullptr); // Blocks of exited threads stay listed, their counts still add up
+	static thread_local HSStatsThread* g_pThread = nullptr;
+	static thread_local bool g_bThreadInit = false;
+	static ptrAny g_pFile = nullptr;
+	static std::string g_strFilePath;
+
+	static HSStatsThread* HSGetThread()
+	{
+		if (g_pThread || g_bThreadInit)
+		{
+			return g_pThread;
+		}
+
+		// An instrumented allocator would come straight back here
+		g_bThreadInit = true;
+		HSStatsThread* pThread = new (std::nothrow) HSStatsThread();
+		g_bThreadInit = false;
+
+		if (pThread == nullptr)
+		{
+			return nullptr;
+		}
+
+		pThread->pNext = g_pThreads.load(std::memory_order_relaxed);
+
+		while (!g_pThreads.compare_exchange_weak(pThread->pNext, pThread, std::memory_order_release, std::memory_order_relaxed))
+		{
+		}
+
+		g_pThread = pThread;
+		return pThread;
+	}
+
+	static void HSBeginWrite(HSStatsCell& stCell)
+	{
+		stCell.uSeq.store(stCell.uSeq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	static void HSEndWrite(HSStatsCell& stCell)
+	{
+		stCell.uSeq.store(stCell.uSeq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	static unsigned32 HSBucket(unsigned64 uDelta)
+	{
+		if (uDelta >> 32)
+		{
+			return HS_STATS_BUCKET_NUM - 1;
+		}
+
+		unsigned32 uLow = (unsigned32)uDelta | 1;
+#if defined(_MSC_VER)
+		unsigned long uIndex;
+		_BitScanReverse(&uIndex, uLow);
+		return (unsigned32)uIndex;
+#else
+		return 31 - (unsigned32)__builtin_clz(uLow);
+#endif
+	}
+
+	static void HSStatsEnter(HSShadowOwner& stOwner)
+	{
+		HSStatsThread* pThread = HSGetThread();
+
+		if (pThread == nullptr)
+		{
+			return;
+		}
+
+		HSStatsCell& stCell = pThread->pCells[((HSStatsHook&)stOwner).uId];
+		HSBeginWrite(stCell);
+		stCell.uCalls++;
+		HSEndWrite(stCell);
+	}
+
+	static void HSStatsLeave(HSShadowOwner& stOwner, const HSShadowFrame&, HSShadowRegs&, unsigned64 uCycles)
+	{
+		// A thread whose block could not be allocated was not counted either
+		HSStatsThread* pThread = g_pThread;
+
+		if (pThread == nullptr)
+		{
+			return;
+		}
+
+		HSStatsCell& stCell = pThread->pCells[((HSStatsHook&)stOwner).uId];
+		HSBeginWrite(stCell);
+		stCell.uCycles += uCycles;
+		stCell.pBuckets[HSBucket(uCycles)]++;
+		HSEndWrite(stCell);
+	}
+
+	unsigned32 HSStatsManager::Find(ptrAny pSrc)
+	{
+		for (unsigned32 i = 0; i < g_uHookNum; i++)
+		{
+			if (g_aHooks[i].pSrc == pSrc)
+			{
+				return i;
+			}
+		}
+
+		return HS_STATS_INVALID;
+	}
+
+	unsigned32 HSStatsManager::Bind(ptrAny pSrc, ptrU8 pMem)
+	{
+		if (g_uHookNum >= HS_STATS_MAX_HOOKS)
+		{
+			return HS_STATS_INVALID;
+		}
+
+		unsigned32 uId = g_uHookNum;
+		g_aHooks[uId] = HSStatsHook{ { pSrc, &HSStatsEnter, &HSStatsLeave }, pSrc, pMem, uId };
+		HSShadowStack::WriteStub(pMem, &g_aHooks[uId].stOwner);
+		g_uHookNum++;
+		return uId;
+	}
+
+	ptrAny HSStatsManager::GetStub(unsigned32 uId)
+	{
+		return g_aHooks[uId].pStub;
+	}
+
+	void HSStatsManager::SetNext(unsigned32 uId, ptrAny pNext)
+	{
+		// One aligned store, a thread in the stub jumps either to the old or the new target
+		*(ptrAny volatile*)&g_aHooks[uId].stOwner.pNext = pNext;
+	}
+
+	void HSStatsManager::Read(unsigned32 uId, HSHookStats& stStats)
+	{
+		memset(&stStats, 0, sizeof(stStats));
+
+		for (HSStatsThread* pThread = g_pThreads.load(std::memory_order_acquire); pThread; pThread = pThread->pNext)
+		{
+			const HSStatsCell& stCell = pThread->pCells[uId];
+			HSHookStats stCopy;
+			unsigned32 uSeq;
+
+			do
+			{
+				while ((uSeq = stCell.uSeq.load(std::memory_order_acquire)) & 1)
+				{
+				}
+
+				stCopy.uCalls = stCell.uCalls;
+				stCopy.uCycles = stCell.uCycles;
+				memcpy(stCopy.pBuckets, stCell.pBuckets, sizeof(stCopy.pBuckets));
+				std::atomic_thread_fence(std::memory_order_acquire);
+
+			} while (stCell.uSeq.load(std::memory_order_relaxed) != uSeq);
+
+			stStats.uCalls += stCopy.uCalls;
+			stStats.uCycles += stCopy.uCycles;
+
+			for (unsigned32 i = 0; i < HS_STATS_BUCKET_NUM; i++)
+			{
+				stStats.pBuckets[i] += stCopy.pBuckets[i];
+			}
+		}
+	}
+
+	bool HSStatsManager::Export(const char* pPath)
+	{
+		unsigned32 uSize = sizeof(HSStatsFileHeader) + HS_STATS_MAX_HOOKS * sizeof(HSStatsFileRecord);
+
+		if (pPath == nullptr)
+		{
+			return false;
+		}
+
+		if (g_pFile == nullptr || g_strFilePath != pPath)
+		{
+			ptrAny pFile = MapFile(pPath, uSize);
+
+			if (pFile == nullptr)
+			{
+				return false;
+			}
+
+			HSStatsFileHeader* pHeader = (HSStatsFileHeader*)pFile;
+			pHeader->uMagic = HS_STATS_FILE_MAGIC;
+			pHeader->uVersion = HS_STATS_FILE_VERSION;
+			g_pFile = pFile;
+			g_strFilePath = pPath;
+		}
+
+		// Sum everything first so the odd window a reader can observe stays short
+		std::vector<HSStatsFileRecord> vecRecords(g_uHookNum);
+
+		for (unsigned32 i = 0; i < g_uHookNum; i++)
+		{
+			vecRecords[i].uSrc = (unsignedP)g_aHooks[i].pSrc;
+			Read(i, vecRecords[i].stStats);
+		}
+
+		HSStatsFileHeader* pHeader = (HSStatsFileHeader*)g_pFile;
+		pHeader->uSeq = pHeader->uSeq + 1;
+		std::atomic_thread_fence(std::memory_order_release);
+
+		if (!vecRecords.empty())
+		{
+			memcpy(pHeader + 1, vecRecords.data(), vecRecords.size() * sizeof(HSStatsFileRecord));
+		}
+
+		pHeader->uNum = g_uHookNum;
+		std::atomic_thread_fence(std::memory_order_release);
+		pHeader->uSeq = pHeader->uSeq + 1;
+		return true;
+	}
+}
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+namespace HSLL
+{
+	ptrAny HSStatsManager::MapFile(const char* pPath, unsigned32 uSize)
+	{
+		// A named mapping backed by the page file, the sidecar opens it with OpenFileMapping
+		HANDLE hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, uSize, pPath);
+
+		if (hMapping == nullptr)
+		{
+			return nullptr;
+		}
+
+		ptrAny pView = MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, uSize);
+
+		// The view keeps the mapping alive
+		CloseHandle(hMapping);
+		return pView;
+	}
+}
+#elif defined(__unix__)
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace HSLL
+{
+	ptrAny HSStatsManager::MapFile(const char* pPath, unsigned32 uSize)
+	{
+		signed32 sFd = open(pPath, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+		if (sFd < 0)
+		{
+			return nullptr;
+		}
+
+		if (ftruncate(sFd, uSize) != 0)
+		{
+			close(sFd);
+			return nullptr;
+		}
+
+		ptrAny pView = mmap(nullptr, uSize, PROT_READ | PROT_WRITE, MAP_SHARED, sFd, 0);
+		close(sFd);
+		return pView == MAP_FAILED ? nullptr : pView;
+	}
+}
+#endif
+
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+#if defined(_M_IX86) || defined(__i386__)
+
+#include "HS_Type.h"
+
+namespace HSLL
+{
+	constexpr unsigned32 HS_STATS_BUCKET_NUM = 32;
+	constexpr unsigned32 HS_STATS_FILE_MAGIC = 0x54534848; // "HHST"
+	constexpr unsigned32 HS_STATS_FILE_VERSION = 1;
+
+	struct HSHookStats
+	{
+		unsigned64 uCalls;                         // Calls that entered the hook
+		unsigned64 uCycles;                        // Sum of rdtsc deltas of the calls that returned
+		unsigned64 pBuckets[HS_STATS_BUCKET_NUM];  // Bucket i counts deltas in [2^i, 2^(i+1)) cycles, the last one everything above
+	};
+
+	struct HSStatsFileHeader
+	{
+		unsigned32 uMagic;        // HS_STATS_FILE_MAGIC
+		unsigned32 uVersion;      // HS_STATS_FILE_VERSION
+		volatile unsigned32 uSeq; // Odd while a snapshot is written, a reader retries until it sees the same even value twice
+		unsigned32 uNum;          // Number of records following the header
+	};
+
+	struct HSStatsFileRecord
+	{
+		unsigned64 uSrc; // Address of the hooked function
+		HSHookStats stStats;
+	};
+
+	/**
+	 * @brief Per-thread call counters and latency histograms for instrumented hooks
+	 * @details Every instrumented target gets a shadow stack stub (HSShadowStack) in front of
+	 *          its detour chain. Its enter callback counts the call, the exit thunk times it when
+	 *          it returns to the real caller. Counters live in cache-line padded cells of
+	 *          a block owned by each thread, so threads never write shared memory. Each cell is a
+	 *          seqlock with a single writer, readers sum all blocks without stopping anyone.
+	 *          A target keeps its id and stub for the process lifetime. Registration is not
+	 *          thread-safe, the caller serializes it with Read and Export.
+	 */
+	class HSStatsManager
+	{
+	public:
+		static constexpr unsigned32 HS_STATS_MAX_HOOKS = 64;
+		static constexpr unsigned32 HS_STATS_INVALID = 0xFFFFFFFF;
+
+		static unsigned32 Find(ptrAny pSrc);
+
+		/**
+		 * @brief Writes the stub of pSrc into HS_SHADOW_STUB_SIZE executable bytes at pMem
+		 */
+		static unsigned32 Bind(ptrAny pSrc, ptrU8 pMem);
+
+		static ptrAny GetStub(unsigned32 uId);
+
+		/**
+		 * @brief Points the stub at the head of the detour chain, or back at the target
+		 */
+		static void SetNext(unsigned32 uId, ptrAny pNext);
+
+		static void Read(unsigned32 uId, HSHookStats& stStats);
+
+		/**
+		 * @brief Writes a snapshot of every bound target into a shared-memory file
+		 * @details The file is created on the first call and kept mapped. Call it periodically,
+		 *          a sidecar maps the same file and polls it under the header's sequence counter.
+		 */
+		static bool Export(const char* pPath);
+
+	private:
+		static ptrAny MapFile(const char* pPath, unsigned32 uSize);
+	};
+}
+
+#endif
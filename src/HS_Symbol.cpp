@@ -0,0 +1,420 @@
+#include "HS_Symbol.h"
+
+#ifdef _WIN32
+namespace HSLL
+{
+	// PE modules carry no symbol table of their own, names come from PDB files this index does not read
+	bool HSSymbolIndex::Resolve(const char* pModule, const char* const* pNames, unsigned32 uNum, ptrAny* pAddrs)
+	{
+		(void)pModule;
+		(void)pNames;
+
+		for (unsigned32 i = 0; i < uNum; i++)
+		{
+			pAddrs[i] = nullptr;
+		}
+
+		return false;
+	}
+}
+#elif defined(__unix__)
+#include <link.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <new>
+
+#if defined(__x86_64__)
+#define HS_ELF_ST_TYPE ELF64_ST_TYPE
+#else
+#define HS_ELF_ST_TYPE ELF32_ST_TYPE
+#endif
+
+namespace HSLL
+{
+	struct HSSymbolEntry
+	{
+		const char* pName; // Points into the mapped file
+		ptrAny pAddr;
+	};
+
+	struct HSSymbolModule
+	{
+		std::string strPath;  // dlpi_name, empty for the main program
+		ElfW(Addr) uBase;     // Load bias, symbol values are relative to it
+		const unsigned32* pGnuHash;
+		const ElfW(Sym)* pSyms;
+		const char* pStrings;
+		const ElfW(Versym)* pVersyms;
+		bool bFileLoaded;     // The file index was attempted, it stays empty if the file could not be read
+		ptrAny pMap;
+		unsignedP uMapSize;
+		std::vector<HSSymbolEntry> vecFile; // Sorted by name
+	};
+
+	struct HSModuleQuery
+	{
+		const char* pModule;
+		const dl_phdr_info* pFound;
+		dl_phdr_info stInfo;
+	};
+
+	static std::vector<HSSymbolModule*> g_vecModules;
+
+	static bool HSMatchModule(const char* pPath, const char* pModule)
+	{
+		if (pModule == nullptr || *pModule == 0)
+		{
+			return *pPath == 0;
+		}
+
+		if (strcmp(pPath, pModule) == 0)
+		{
+			return true;
+		}
+
+		const char* pFile = strrchr(pPath, '/');
+		pFile = pFile ? pFile + 1 : pPath;
+		unsignedP uLen = strlen(pModule);
+
+		// "libc.so" names "libc.so.6" as well, a version suffix follows a dot
+		return strncmp(pFile, pModule, uLen) == 0 && (pFile[uLen] == 0 || pFile[uLen] == '.');
+	}
+
+	static int HSFindModule(dl_phdr_info* pInfo, size_t uSize, void* pData)
+	{
+		(void)uSize;
+		HSModuleQuery* pQuery = (HSModuleQuery*)pData;
+
+		if (pInfo->dlpi_name == nullptr || !HSMatchModule(pInfo->dlpi_name, pQuery->pModule))
+		{
+			return 0;
+		}
+
+		pQuery->stInfo = *pInfo;
+		pQuery->pFound = &pQuery->stInfo;
+		return 1;
+	}
+
+	static ElfW(Addr) HSDynPtr(const dl_phdr_info* pInfo, ElfW(Addr) uPtr)
+	{
+		// glibc relocates the dynamic entries in place, the vDSO and other loaders leave them as offsets
+		return uPtr < pInfo->dlpi_addr ? pInfo->dlpi_addr + uPtr : uPtr;
+	}
+
+	static HSSymbolModule* HSLoadModule(const dl_phdr_info* pInfo)
+	{
+		for (HSSymbolModule* pModule : g_vecModules)
+		{
+			if (pModule->uBase == pInfo->dlpi_addr && pModule->strPath == pInfo->dlpi_name)
+			{
+				return pModule;
+			}
+		}
+
+		HSSymbolModule* pModule = new (std::nothrow) HSSymbolModule{ pInfo->dlpi_name, pInfo->dlpi_addr, nullptr, nullptr, nullptr, nullptr, false, nullptr, 0, {} };
+
+		if (pModule == nullptr)
+		{
+			return nullptr;
+		}
+
+		for (ElfW(Half) i = 0; i < pInfo->dlpi_phnum; i++)
+		{
+			if (pInfo->dlpi_phdr[i].p_type != PT_DYNAMIC)
+			{
+				continue;
+			}
+
+			for (const ElfW(Dyn)* pDyn = (const ElfW(Dyn)*)(pInfo->dlpi_addr + pInfo->dlpi_phdr[i].p_vaddr); pDyn->d_tag != DT_NULL; pDyn++)
+			{
+				switch (pDyn->d_tag)
+				{
+				case DT_GNU_HASH:
+					pModule->pGnuHash = (const unsigned32*)HSDynPtr(pInfo, pDyn->d_un.d_ptr);
+					break;
+				case DT_SYMTAB:
+					pModule->pSyms = (const ElfW(Sym)*)HSDynPtr(pInfo, pDyn->d_un.d_ptr);
+					break;
+				case DT_STRTAB:
+					pModule->pStrings = (const char*)HSDynPtr(pInfo, pDyn->d_un.d_ptr);
+					break;
+				case DT_VERSYM:
+					pModule->pVersyms = (const ElfW(Versym)*)HSDynPtr(pInfo, pDyn->d_un.d_ptr);
+					break;
+				}
+			}
+		}
+
+		if (pModule->pSyms == nullptr || pModule->pStrings == nullptr)
+		{
+			pModule->pGnuHash = nullptr;
+		}
+
+		g_vecModules.push_back(pModule);
+		return pModule;
+	}
+
+	static unsigned32 HSGnuHash(const char* pName)
+	{
+		unsigned32 uHash = 5381;
+
+		for (const unsigned8* p = (const unsigned8*)pName; *p; p++)
+		{
+			uHash = uHash * 33 + *p;
+		}
+
+		return uHash;
+	}
+
+	static bool HSIsFunction(const ElfW(Sym)& stSym)
+	{
+		unsigned32 uType = HS_ELF_ST_TYPE(stSym.st_info);
+		return (uType == STT_FUNC || uType == STT_GNU_IFUNC) && stSym.st_shndx != SHN_UNDEF && stSym.st_value != 0;
+	}
+
+	static ptrAny HSBindIfunc(const HSSymbolModule& stModule, const char* pName)
+	{
+		// The symbol value is the selector, the dynamic linker knows what it picked
+		void* pHandle = dlopen(stModule.strPath.empty() ? nullptr : stModule.strPath.c_str(), RTLD_LAZY | RTLD_NOLOAD);
+
+		if (pHandle == nullptr)
+		{
+			return nullptr;
+		}
+
+		ptrAny pAddr = dlsym(pHandle, pName);
+		dlclose(pHandle);
+		return pAddr;
+	}
+
+	static ptrAny HSFindExported(const HSSymbolModule& stModule, const char* pName)
+	{
+		if (stModule.pGnuHash == nullptr)
+		{
+			return nullptr;
+		}
+
+		const unsigned32 uBucketNum = stModule.pGnuHash[0];
+		const unsigned32 uSymOffset = stModule.pGnuHash[1];
+		const unsigned32 uBloomSize = stModule.pGnuHash[2];
+		const unsigned32 uBloomShift = stModule.pGnuHash[3];
+		const ElfW(Addr)* pBloom = (const ElfW(Addr)*)(stModule.pGnuHash + 4);
+		const unsigned32* pBuckets = (const unsigned32*)(pBloom + uBloomSize);
+		const unsigned32* pChain = pBuckets + uBucketNum;
+
+		constexpr unsigned32 uBits = sizeof(ElfW(Addr)) * 8;
+		unsigned32 uHash = HSGnuHash(pName);
+		ElfW(Addr) uWord = pBloom[(uHash / uBits) & (uBloomSize - 1)];
+		ElfW(Addr) uMask = ((ElfW(Addr))1 << (uHash % uBits)) | ((ElfW(Addr))1 << ((uHash >> uBloomShift) % uBits));
+
+		// The bloom filter turns most misses away before a bucket is touched
+		if ((uWord & uMask) != uMask)
+		{
+			return nullptr;
+		}
+
+		unsigned32 uIndex = pBuckets[uHash % uBucketNum];
+
+		if (uIndex < uSymOffset)
+		{
+			return nullptr;
+		}
+
+		for (;; uIndex++)
+		{
+			unsigned32 uChain = pChain[uIndex - uSymOffset];
+			const ElfW(Sym)& stSym = stModule.pSyms[uIndex];
+
+			// Bit 15 of the version marks a hidden, non-default version of the name
+			if ((uChain | 1) == (uHash | 1) && HSIsFunction(stSym) && strcmp(stModule.pStrings + stSym.st_name, pName) == 0
+				&& (stModule.pVersyms == nullptr || (stModule.pVersyms[uIndex] & 0x8000) == 0))
+			{
+				if (HS_ELF_ST_TYPE(stSym.st_info) == STT_GNU_IFUNC)
+				{
+					return HSBindIfunc(stModule, pName);
+				}
+
+				return (ptrAny)(stModule.uBase + stSym.st_value);
+			}
+
+			if (uChain & 1)
+			{
+				return nullptr;
+			}
+		}
+	}
+
+	static void HSLoadFileIndex(HSSymbolModule& stModule)
+	{
+		stModule.bFileLoaded = true;
+		signed32 sFd = open(stModule.strPath.empty() ? "/proc/self/exe" : stModule.strPath.c_str(), O_RDONLY | O_CLOEXEC);
+
+		if (sFd < 0)
+		{
+			return;
+		}
+
+		struct stat stStat;
+		ptrAny pMap = MAP_FAILED;
+
+		if (fstat(sFd, &stStat) == 0 && (unsignedP)stStat.st_size >= sizeof(ElfW(Ehdr)))
+		{
+			pMap = mmap(nullptr, (unsignedP)stStat.st_size, PROT_READ, MAP_PRIVATE, sFd, 0);
+		}
+
+		close(sFd);
+
+		if (pMap == MAP_FAILED)
+		{
+			return;
+		}
+
+		unsignedP uSize = (unsignedP)stStat.st_size;
+		const unsigned8* pFile = (const unsigned8*)pMap;
+		const ElfW(Ehdr)* pEhdr = (const ElfW(Ehdr)*)pFile;
+
+		if (memcmp(pEhdr->e_ident, ELFMAG, SELFMAG) != 0 || pEhdr->e_ident[EI_CLASS] != (sizeof(ptrAny) == 8 ? ELFCLASS64 : ELFCLASS32)
+			|| pEhdr->e_shentsize != sizeof(ElfW(Shdr)) || pEhdr->e_shoff > uSize
+			|| (uSize - pEhdr->e_shoff) / sizeof(ElfW(Shdr)) < pEhdr->e_shnum)
+		{
+			munmap(pMap, uSize);
+			return;
+		}
+
+		const ElfW(Shdr)* pSections = (const ElfW(Shdr)*)(pFile + pEhdr->e_shoff);
+		const ElfW(Shdr)* pTable = nullptr;
+
+		// A stripped file still has .dynsym, which at least covers the exports of a module without DT_GNU_HASH
+		for (ElfW(Half) i = 0; i < pEhdr->e_shnum; i++)
+		{
+			if (pSections[i].sh_type == SHT_SYMTAB || (pSections[i].sh_type == SHT_DYNSYM && pTable == nullptr))
+			{
+				pTable = &pSections[i];
+			}
+		}
+
+		if (pTable == nullptr || pTable->sh_link >= pEhdr->e_shnum || pTable->sh_offset > uSize
+			|| pTable->sh_size > uSize - pTable->sh_offset)
+		{
+			munmap(pMap, uSize);
+			return;
+		}
+
+		const ElfW(Shdr)& stStrings = pSections[pTable->sh_link];
+
+		if (stStrings.sh_offset > uSize || stStrings.sh_size > uSize - stStrings.sh_offset)
+		{
+			munmap(pMap, uSize);
+			return;
+		}
+
+		const ElfW(Sym)* pSyms = (const ElfW(Sym)*)(pFile + pTable->sh_offset);
+		const char* pStrings = (const char*)(pFile + stStrings.sh_offset);
+		unsignedP uNum = pTable->sh_size / sizeof(ElfW(Sym));
+
+		for (unsignedP i = 0; i < uNum; i++)
+		{
+			// An IFUNC from the file has no binding to go by, only plain functions are taken
+			if (HS_ELF_ST_TYPE(pSyms[i].st_info) == STT_FUNC && HSIsFunction(pSyms[i]) && pSyms[i].st_name < stStrings.sh_size
+				&& memchr(pStrings + pSyms[i].st_name, 0, stStrings.sh_size - pSyms[i].st_name))
+			{
+				stModule.vecFile.push_back(HSSymbolEntry{ pStrings + pSyms[i].st_name, (ptrAny)(stModule.uBase + pSyms[i].st_value) });
+			}
+		}
+
+		std::sort(stModule.vecFile.begin(), stModule.vecFile.end(), [](const HSSymbolEntry& a, const HSSymbolEntry& b)
+			{
+				signed32 sOrder = strcmp(a.pName, b.pName);
+				return sOrder < 0 || (sOrder == 0 && a.pAddr < b.pAddr);
+			});
+
+		stModule.pMap = pMap;
+		stModule.uMapSize = uSize;
+	}
+
+	bool HSSymbolIndex::Resolve(const char* pModule, const char* const* pNames, unsigned32 uNum, ptrAny* pAddrs)
+	{
+		for (unsigned32 i = 0; i < uNum; i++)
+		{
+			pAddrs[i] = nullptr;
+		}
+
+		HSModuleQuery stQuery = { pModule, nullptr, {} };
+		dl_iterate_phdr(&HSFindModule, &stQuery);
+
+		if (stQuery.pFound == nullptr)
+		{
+			return false;
+		}
+
+		HSSymbolModule* pIndex = HSLoadModule(stQuery.pFound);
+		std::vector<unsigned32> vecMiss;
+
+		if (pIndex == nullptr)
+		{
+			return false;
+		}
+
+		for (unsigned32 i = 0; i < uNum; i++)
+		{
+			if ((pAddrs[i] = HSFindExported(*pIndex, pNames[i])) == nullptr)
+			{
+				vecMiss.push_back(i);
+			}
+		}
+
+		if (vecMiss.empty())
+		{
+			return true;
+		}
+
+		if (!pIndex->bFileLoaded)
+		{
+			HSLoadFileIndex(*pIndex);
+		}
+
+		std::sort(vecMiss.begin(), vecMiss.end(), [pNames](unsigned32 a, unsigned32 b) { return strcmp(pNames[a], pNames[b]) < 0; });
+
+		// Both sides are sorted by name, one sweep serves the whole batch
+		const std::vector<HSSymbolEntry>& vecFile = pIndex->vecFile;
+		size_t uPos = 0;
+		bool bResult = true;
+
+		for (unsigned32 uMiss : vecMiss)
+		{
+			const char* pName = pNames[uMiss];
+
+			while (uPos < vecFile.size() && strcmp(vecFile[uPos].pName, pName) < 0)
+			{
+				uPos++;
+			}
+
+			size_t uEnd = uPos;
+
+			while (uEnd < vecFile.size() && strcmp(vecFile[uEnd].pName, pName) == 0)
+			{
+				uEnd++;
+			}
+
+			// Aliases share an address, distinct local functions of the same name are ambiguous
+			if (uEnd > uPos && vecFile[uEnd - 1].pAddr == vecFile[uPos].pAddr)
+			{
+				pAddrs[uMiss] = vecFile[uPos].pAddr;
+			}
+			else
+			{
+				bResult = false;
+			}
+		}
+
+		return bResult;
+	}
+}
+#endif
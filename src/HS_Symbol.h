@@ -0,0 +1,28 @@
+#pragma once
+#include "HS_Type.h"
+
+namespace HSLL
+{
+	/**
+	 * @brief Resolves function names inside one loaded ELF module
+	 * @details Every module gets its index once, on first use, and keeps it for the process.
+	 *          Exported functions are found through the module's own DT_GNU_HASH table in memory,
+	 *          non-default symbol versions are skipped and IFUNCs are bound through dlsym. Names
+	 *          the table misses (local functions, or a module without one) go to a name-sorted
+	 *          copy of .symtab, or .dynsym when the file is stripped, read from the ELF file on disk
+	 *          with mmap. A batch probes the hash table name by name, then sorts the leftovers and
+	 *          walks them and the file index together once. A local name defined at several
+	 *          addresses is left unresolved. Not thread-safe, the caller serializes access. ELF only.
+	 */
+	class HSSymbolIndex
+	{
+	public:
+		/**
+		 * @param pModule Path or file name of the module, "libc.so" also matches "libc.so.6".
+		 *                Null or empty selects the main program.
+		 * @param pAddrs  Receives the address of each name, null for the ones not found
+		 * @return true if the module is loaded and every name was found
+		 */
+		static bool Resolve(const char* pModule, const char* const* pNames, unsigned32 uNum, ptrAny* pAddrs);
+	};
+}
@@ -0,0 +1,101 @@
+#include "HS_Hook.h"
+#include <stdio.h>
+
+using namespace HSLL;
+
+constexpr unsigned32 HS_POOL_CYCLES = 2000;
+
+static volatile signed32 g_sBias = 0;
+
+// The volatile load keeps each target longer than the entry jump, and neither target calls
+// out, so every trampoline is released on Remove
+HS_NOINLINE static signed32 HSPoolTargetA(signed32 sValue)
+{
+	return sValue * 3 + 1 + g_sBias;
+}
+
+HS_NOINLINE static signed32 HSPoolTargetB(signed32 sValue)
+{
+	return sValue * 5 + 2 + g_sBias;
+}
+
+static HSHookHandle<signed32(signed32)> g_oFirst;
+static HSHookHandle<signed32(signed32)> g_oSecond;
+
+HS_NOINLINE static signed32 HSPoolDetour(signed32 sValue)
+{
+	return HSHook::Original(&HSPoolTargetA)(sValue) + 1;
+}
+
+HS_NOINLINE static signed32 HSPoolFirst(signed32 sValue)
+{
+	return g_oFirst(sValue) + 1;
+}
+
+HS_NOINLINE static signed32 HSPoolSecond(signed32 sValue)
+{
+	return g_oSecond(sValue) + 1;
+}
+
+/**
+ * @brief One hook by address and one chain of two handles, each installed, called and removed
+ * @details Removing the higher link changes the chain head, so its relay is retired as well
+ */
+static bool HSRunCycle()
+{
+	signed32(*volatile pfnA)(signed32) = &HSPoolTargetA;
+	signed32(*volatile pfnB)(signed32) = &HSPoolTargetB;
+
+	if (!HSHook::Install((ptrAny)&HSPoolTargetA, (ptrAny)&HSPoolDetour))
+		return false;
+
+	bool bOk = pfnA(1) == 5;
+
+	if (!HSHook::Remove((ptrAny)&HSPoolTargetA) || !bOk)
+		return false;
+
+	if (!HSHook::Install(&HSPoolTargetB, &HSPoolFirst, g_oFirst, 1))
+		return false;
+
+	if (!HSHook::Install(&HSPoolTargetB, &HSPoolSecond, g_oSecond, 2))
+	{
+		HSHook::Remove(g_oFirst);
+		return false;
+	}
+
+	bOk = pfnB(1) == 9;
+
+	if (!HSHook::Remove(g_oSecond) || !HSHook::Remove(g_oFirst) || !bOk)
+		return false;
+
+	return pfnA(1) == 4 && pfnB(1) == 7;
+}
+
+int main()
+{
+	HSPoolStats stBefore;
+	HSHook::GetPoolStats(stBefore);
+
+	for (unsigned32 i = 0; i < HS_POOL_CYCLES; i++)
+	{
+		if (!HSRunCycle())
+		{
+			fprintf(stderr, "FAIL cycle %u: install, call or remove failed\n", i);
+			return 1;
+		}
+	}
+
+	HSPoolStats stAfter;
+	HSHook::GetPoolStats(stAfter);
+
+	fprintf(stderr, "%u cycles: blocks %u -> %u, used slots %u -> %u, pages %u -> %u\n", HS_POOL_CYCLES,
+		stBefore.uBlockNum, stAfter.uBlockNum, stBefore.uUsedSlotNum, stAfter.uUsedSlotNum, stBefore.uPageNum, stAfter.uPageNum);
+
+	if (stAfter.uBlockNum != stBefore.uBlockNum || stAfter.uUsedSlotNum != stBefore.uUsedSlotNum)
+	{
+		fprintf(stderr, "FAIL removed trampolines were not returned to the pool\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,181 @@
+#include "HS_Hook.h"
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+using namespace HSLL;
+
+static ptrU8 HSAllocCode(unsigned32 uSize);
+
+constexpr unsigned32 HS_CASE_SIZE = 64;
+
+struct HSRelocCase
+{
+	const char* pName;
+	std::vector<unsigned8> vecCode; // Function body, the relocated instructions are at its entry
+	signed32 sExpect;               // Return value of the unhooked function
+};
+
+using HSCaseFn = signed32(*)();
+
+static HSHookHandle<signed32()> g_oHandle;
+
+HS_NOINLINE static signed32 HSCaseDetour()
+{
+	return g_oHandle();
+}
+
+/**
+ * @brief Both outcomes of a Jcc rel8 at the entry, the stolen copy becomes a Jcc rel32
+ * @details xor eax, eax; jcc +6; mov eax, 2; ret; mov eax, 1; ret
+ */
+static void HSAddJccCases(std::vector<HSRelocCase>& vecCases)
+{
+	vecCases.push_back(HSRelocCase{ "jcc_rel8_taken", { 0x31, 0xC0, 0x74, 0x06, 0xB8, 2, 0, 0, 0, 0xC3, 0xB8, 1, 0, 0, 0, 0xC3 }, 1 });
+	vecCases.push_back(HSRelocCase{ "jcc_rel8_not_taken", { 0x31, 0xC0, 0x75, 0x06, 0xB8, 2, 0, 0, 0, 0xC3, 0xB8, 1, 0, 0, 0, 0xC3 }, 2 });
+}
+
+/**
+ * @brief JECXZ and LOOP have no rel32 form, the copy branches over a JMP to a JMP rel32
+ * @details LOOP returns ecx when it branches, so the decrement is checked too
+ */
+static void HSAddLoopCases(std::vector<HSRelocCase>& vecCases)
+{
+	// xor ecx, ecx; jecxz +6; mov eax, 2; ret; mov eax, 1; ret
+	vecCases.push_back(HSRelocCase{ "jecxz_taken", { 0x31, 0xC9, 0xE3, 0x06, 0xB8, 2, 0, 0, 0, 0xC3, 0xB8, 1, 0, 0, 0, 0xC3 }, 1 });
+
+	// push 1; pop ecx; jecxz +6; mov eax, 2; ret; mov eax, 1; ret
+	vecCases.push_back(HSRelocCase{ "jecxz_not_taken", { 0x6A, 0x01, 0x59, 0xE3, 0x06, 0xB8, 2, 0, 0, 0, 0xC3, 0xB8, 1, 0, 0, 0, 0xC3 }, 2 });
+
+	// push n; pop ecx; loop +6; mov eax, 2; ret; mov eax, ecx; ret
+	vecCases.push_back(HSRelocCase{ "loop_taken", { 0x6A, 0x04, 0x59, 0xE2, 0x06, 0xB8, 2, 0, 0, 0, 0xC3, 0x89, 0xC8, 0xC3 }, 3 });
+	vecCases.push_back(HSRelocCase{ "loop_not_taken", { 0x6A, 0x01, 0x59, 0xE2, 0x06, 0xB8, 2, 0, 0, 0, 0xC3, 0x89, 0xC8, 0xC3 }, 2 });
+}
+
+#if defined(_M_IX86) || defined(__i386__)
+static void HSPutU32(std::vector<unsigned8>& vecCode, unsigned32 uPos, unsigned32 uValue)
+{
+	memcpy(vecCode.data() + uPos, &uValue, 4);
+}
+
+/**
+ * @brief PC getters at the entry: the copy must load the original return address, not its own
+ * @details Each returns eax minus the address after the call, 0 when the right address was loaded
+ */
+static void HSAddPcCases(std::vector<HSRelocCase>& vecCases, ptrU8 pCode, unsigned32 uFirst)
+{
+	// call $+5; pop eax; sub eax, next; ret
+	ptrU8 pFunc = pCode + uFirst * HS_CASE_SIZE;
+	HSRelocCase stCall = { "call_next", { 0xE8, 0, 0, 0, 0, 0x58, 0x2D, 0, 0, 0, 0, 0xC3 }, 0 };
+	HSPutU32(stCall.vecCode, 7, (unsigned32)(unsignedP)(pFunc + 5));
+	vecCases.push_back(stCall);
+
+	// call thunk; sub eax, next; ret; then the thunk: mov eax, [esp]; ret
+	pFunc += HS_CASE_SIZE;
+	HSRelocCase stThunk = { "get_pc_thunk", { 0xE8, 0, 0, 0, 0, 0x2D, 0, 0, 0, 0, 0xC3, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0x8B, 0x04, 0x24, 0xC3 }, 0 };
+	HSPutU32(stThunk.vecCode, 1, 16 - 5);
+	HSPutU32(stThunk.vecCode, 6, (unsigned32)(unsignedP)(pFunc + 5));
+	vecCases.push_back(stThunk);
+}
+#elif defined(_M_X64) || defined(__x86_64__)
+/**
+ * @brief RIP-relative operands at the entry, the copy must reach the same data from the trampoline
+ * @details Each loads a constant stored past its ret
+ */
+static void HSAddRipCases(std::vector<HSRelocCase>& vecCases)
+{
+	// mov eax, [rip + 2]; ret; int3; dd 0x12345678
+	vecCases.push_back(HSRelocCase{ "rip_mov", { 0x8B, 0x05, 2, 0, 0, 0, 0xC3, 0xCC, 0x78, 0x56, 0x34, 0x12 }, 0x12345678 });
+
+	// lea rax, [rip + 5]; mov eax, [rax]; ret; int3; int3; dd 0x07654321
+	vecCases.push_back(HSRelocCase{ "rip_lea", { 0x48, 0x8D, 0x05, 5, 0, 0, 0, 0x8B, 0x00, 0xC3, 0xCC, 0xCC, 0x21, 0x43, 0x65, 0x07 }, 0x07654321 });
+}
+#endif
+
+static bool HSRunCase(const HSRelocCase& stCase, ptrU8 pFunc)
+{
+	HSCaseFn pfnCase = (HSCaseFn)pFunc;
+	signed32 sBefore = pfnCase();
+
+	if (sBefore != stCase.sExpect)
+	{
+		fprintf(stderr, "%-20s crafted code returned %d, expected %d\n", stCase.pName, sBefore, stCase.sExpect);
+		return false;
+	}
+
+	if (!HSHook::Install(pfnCase, &HSCaseDetour, g_oHandle))
+	{
+		fprintf(stderr, "%-20s install failed\n", stCase.pName);
+		return false;
+	}
+
+	// Through the entry jump into the detour and back through the relocated copy, then the copy alone
+	signed32 sHooked = pfnCase();
+	signed32 sOriginal = g_oHandle();
+	bool bRemoved = HSHook::Remove(g_oHandle);
+	signed32 sAfter = pfnCase();
+
+	if (sHooked != sBefore || sOriginal != sBefore || !bRemoved || sAfter != sBefore)
+	{
+		fprintf(stderr, "%-20s returned %d hooked, %d through the trampoline, %d after remove (%s), expected %d\n",
+			stCase.pName, sHooked, sOriginal, sAfter, bRemoved ? "removed" : "remove failed", sBefore);
+		return false;
+	}
+
+	fprintf(stderr, "%-20s ok\n", stCase.pName);
+	return true;
+}
+
+int main()
+{
+	std::vector<HSRelocCase> vecCases;
+	HSAddJccCases(vecCases);
+	HSAddLoopCases(vecCases);
+#if defined(_M_X64) || defined(__x86_64__)
+	HSAddRipCases(vecCases);
+#endif
+
+	ptrU8 pCode = HSAllocCode(16 * HS_CASE_SIZE);
+
+	if (pCode == nullptr)
+	{
+		fprintf(stderr, "cannot allocate executable memory\n");
+		return 1;
+	}
+
+#if defined(_M_IX86) || defined(__i386__)
+	HSAddPcCases(vecCases, pCode, (unsigned32)vecCases.size());
+#endif
+
+	// int3 between the cases, nothing may run past the end of a crafted body
+	memset(pCode, 0xCC, 16 * HS_CASE_SIZE);
+	unsigned32 uFailed = 0;
+
+	for (size_t i = 0; i < vecCases.size(); i++)
+	{
+		ptrU8 pFunc = pCode + i * HS_CASE_SIZE;
+		memcpy(pFunc, vecCases[i].vecCode.data(), vecCases[i].vecCode.size());
+		uFailed += HSRunCase(vecCases[i], pFunc) ? 0 : 1;
+	}
+
+	fprintf(stderr, "%u of %u cases failed\n", uFailed, (unsigned32)vecCases.size());
+	return uFailed ? 1 : 0;
+}
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+
+static ptrU8 HSAllocCode(unsigned32 uSize)
+{
+	return (ptrU8)VirtualAlloc(nullptr, uSize, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+}
+#elif defined(__unix__)
+#include <sys/mman.h>
+
+static ptrU8 HSAllocCode(unsigned32 uSize)
+{
+	ptrAny pMem = mmap(nullptr, uSize, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return pMem == MAP_FAILED ? nullptr : (ptrU8)pMem;
+}
+#endif